@@ -0,0 +1,407 @@
+/* FCE Ultra - NES/Famicom Emulator
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "types.h"
+#include "fceu.h"
+#include "driver.h"
+#include "audio.h"
+#include "utils/endian.h"
+
+#include <climits>
+#include <cstring>
+#include <string>
+
+//--------------------------------------------------------------------
+
+AudioStream::AudioStream(int capacity)
+	: ring(capacity)
+	, frac(0)
+	, scale(256)
+	, rate(44100)
+{
+	resetStats();
+}
+
+void AudioStream::noteWrite(int count, int written)
+{
+	framesQueued++;
+	samplesQueued += written;
+	if(written < count)
+	{
+		overruns++;
+		overrunSamples += count - written;
+	}
+
+	bufferedAtEnqueue = ring.size();
+	if(bufferedAtEnqueue > maxBufferedAtEnqueue)
+		maxBufferedAtEnqueue = bufferedAtEnqueue;
+}
+
+int AudioStream::write(const int32 *samples, int count)
+{
+	//convert in small chunks so nothing has to be allocated per frame
+	int16 temp[256];
+	int done = 0;
+	while(done < count)
+	{
+		int todo = count - done;
+		if(todo > 256) todo = 256;
+		for(int i=0;i<todo;i++)
+		{
+			int32 s = samples[done+i];
+			if(s > 32767) s = 32767;
+			else if(s < -32768) s = -32768;
+			temp[i] = (int16)s;
+		}
+		int written = ring.write(temp, todo);
+		done += written;
+		if(written < todo) break;
+	}
+	noteWrite(count, done);
+	return done;
+}
+
+int AudioStream::write(const int16 *samples, int count)
+{
+	int done = ring.write(samples, count);
+	noteWrite(count, done);
+	return done;
+}
+
+//returns the 16.16 step between output samples for the current fill level
+uint32 AudioStream::step(int available)
+{
+	int64 incr = 65536;
+
+	//if we're we're too far behind, playback faster
+	if(available > rate*3/60)
+	{
+		int64 behind = available - rate/60;
+		incr = behind*65536*60/rate/2;
+		//we multiply our playback rate by 1/2 the number of frames we're behind
+	}
+
+	incr = (incr*scale.load())>>8; //apply scaling factor
+	if(incr < 1) incr = 1;
+	return (uint32)incr;
+}
+
+int AudioStream::read(int16 *out, int count)
+{
+	int available = ring.size();
+	bufferedAtDequeue.store(available, std::memory_order_relaxed);
+	if(available < minBufferedAtDequeue.load(std::memory_order_relaxed))
+		minBufferedAtDequeue.store(available, std::memory_order_relaxed);
+	if(available < 2) return 0;
+
+	uint32 incr = step(available);
+	lastStep.store(incr, std::memory_order_relaxed);
+
+	//interpolate between queue[pos>>16] and the sample after it
+	uint64 pos = frac;
+	int done = 0;
+	while(done < count)
+	{
+		int index = (int)(pos>>16);
+		if(index+1 >= available) break;
+		int32 s0 = ring.peek(index);
+		int32 s1 = ring.peek(index+1);
+		int32 f = (int32)(pos & 0xFFFF);
+		//the difference can take 17 bits, and the fraction 16
+		out[done++] = (int16)(s0 + (int32)(((int64)(s1 - s0) * f) >> 16));
+		pos += incr;
+	}
+
+	int consumed = (int)(pos>>16);
+	if(consumed > available-1) consumed = available-1;
+	ring.skip(consumed);
+	frac = (uint32)(pos - ((uint64)consumed<<16));
+	if(frac > 0xFFFF) frac = 0xFFFF;
+	samplesPlayed.fetch_add(done, std::memory_order_relaxed);
+	return done;
+}
+
+void AudioStream::generate(int16 *out, int count)
+{
+	int done = read(out, count);
+	if(done < count)
+	{
+		memset(out+done, 0, (count-done)*sizeof(int16));
+		underruns.fetch_add(1, std::memory_order_relaxed);
+		underrunSamples.fetch_add(count-done, std::memory_order_relaxed);
+	}
+}
+
+void AudioStream::clear()
+{
+	ring.clear();
+	frac = 0;
+}
+
+void AudioStream::setSynthesisTime(double seconds)
+{
+	synthesisTime = seconds;
+	if(seconds > maxSynthesisTime)
+		maxSynthesisTime = seconds;
+}
+
+void AudioStream::getStats(AudioStats *stats) const
+{
+	stats->framesQueued = framesQueued;
+	stats->samplesQueued = samplesQueued;
+	stats->samplesPlayed = samplesPlayed.load(std::memory_order_relaxed);
+	stats->underrunSamples = underrunSamples.load(std::memory_order_relaxed);
+	stats->underruns = underruns.load(std::memory_order_relaxed);
+	stats->overrunSamples = overrunSamples;
+	stats->overruns = overruns;
+	stats->bufferedAtEnqueue = bufferedAtEnqueue;
+	stats->maxBufferedAtEnqueue = maxBufferedAtEnqueue;
+	stats->bufferedAtDequeue = bufferedAtDequeue.load(std::memory_order_relaxed);
+	stats->minBufferedAtDequeue = minBufferedAtDequeue.load(std::memory_order_relaxed);
+	if(stats->minBufferedAtDequeue == INT_MAX) stats->minBufferedAtDequeue = 0;
+	stats->playbackRatio = lastStep.load(std::memory_order_relaxed) / 65536.0;
+	stats->synthesisTime = synthesisTime;
+	stats->maxSynthesisTime = maxSynthesisTime;
+}
+
+//the consumer may be updating its counters at the same time; at worst one read is lost
+void AudioStream::resetStats()
+{
+	framesQueued = samplesQueued = overrunSamples = 0;
+	overruns = 0;
+	bufferedAtEnqueue = maxBufferedAtEnqueue = 0;
+	synthesisTime = maxSynthesisTime = 0;
+
+	samplesPlayed.store(0);
+	underrunSamples.store(0);
+	underruns.store(0);
+	bufferedAtDequeue.store(0);
+	minBufferedAtDequeue.store(INT_MAX);
+	lastStep.store(65536);
+}
+
+//--------------------------------------------------------------------
+
+bool NullAudioBackend::open(AudioStream *stream, int rate)
+{
+	this->stream = stream;
+	stream->setRate(rate);
+	return true;
+}
+
+void NullAudioBackend::close()
+{
+	stream = 0;
+}
+
+void NullAudioBackend::update()
+{
+	if(stream) stream->clear();
+}
+
+//--------------------------------------------------------------------
+
+WaveFileAudioBackend::WaveFileAudioBackend(const char *fname)
+	: fname(fname)
+	, fp(0)
+	, datasize(0)
+	, stream(0)
+{
+}
+
+WaveFileAudioBackend::~WaveFileAudioBackend()
+{
+	close();
+}
+
+bool WaveFileAudioBackend::open(AudioStream *stream, int rate)
+{
+	close();
+	if(!(fp = FCEUD_UTF8fopen(fname.c_str(),"wb")))
+		return false;
+
+	this->stream = stream;
+	stream->setRate(rate);
+	datasize = 0;
+	temp.resize(rate/10);
+
+	//header. sizes are patched in by close()
+	fputs("RIFF",fp);
+	write32le(0,fp);
+	fputs("WAVEfmt ",fp);
+	write32le(16,fp);
+	write16le(1,fp);     // PCM
+	write16le(1,fp);     // Monophonic
+	write32le(rate,fp);
+	write32le(rate*2,fp);
+	write16le(2,fp);
+	write16le(16,fp);
+	fputs("data",fp);
+	write32le(0,fp);
+	return true;
+}
+
+void WaveFileAudioBackend::update()
+{
+	if(!fp) return;
+
+	for(;;)
+	{
+		int count = stream->read(&temp[0], (int)temp.size());
+		if(!count) break;
+		for(int i=0;i<count;i++)
+			write16le((uint16)temp[i],fp);
+		datasize += count*2;
+	}
+}
+
+void WaveFileAudioBackend::close()
+{
+	if(!fp) return;
+
+	update();
+	fseek(fp,4,SEEK_SET);
+	write32le(datasize+36,fp);
+	fseek(fp,40,SEEK_SET);
+	write32le(datasize,fp);
+	fclose(fp);
+	fp = 0;
+	stream = 0;
+}
+
+//--------------------------------------------------------------------
+
+static AudioStream audioStream;
+static AudioBackend *audioBackend = 0;
+
+AudioStream *FCEUI_GetAudioStream()
+{
+	return &audioStream;
+}
+
+AudioBackend *FCEUI_GetAudioBackend()
+{
+	return audioBackend;
+}
+
+bool FCEUI_SetAudioBackend(AudioBackend *backend, int rate)
+{
+	if(audioBackend)
+	{
+		audioBackend->close();
+		delete audioBackend;
+		audioBackend = 0;
+	}
+
+	audioStream.clear();
+	if(!backend) return true;
+
+	if(!backend->open(&audioStream, rate))
+	{
+		delete backend;
+		return false;
+	}
+	audioBackend = backend;
+	return true;
+}
+
+//one frame of the rolling audio log
+struct AudioLogEntry
+{
+	uint32 frame;
+	int queued;
+	int bufferedAtEnqueue;
+	int bufferedAtDequeue;
+	uint32 underrunSamples;     //during this frame
+	uint32 overrunSamples;
+	double playbackRatio;
+	double synthesisTime;
+};
+
+static std::vector<AudioLogEntry> audioLog;
+static uint32 audioLogCount = 0; //entries ever recorded, the next one goes to audioLogCount % size
+static uint64 audioLogUnderruns = 0, audioLogOverruns = 0; //the stream's counts when the last entry was recorded
+
+void FCEUI_WriteAudio(const int32 *samples, int count)
+{
+	if(!audioBackend) return;
+	if(samples && count)
+		audioStream.write(samples, count);
+	audioBackend->update();
+
+	if(audioLog.empty()) return;
+
+	AudioStats stats;
+	audioStream.getStats(&stats);
+	AudioLogEntry &e = audioLog[audioLogCount % audioLog.size()];
+	e.frame = (uint32)stats.framesQueued;
+	e.queued = count;
+	e.bufferedAtEnqueue = stats.bufferedAtEnqueue;
+	e.bufferedAtDequeue = stats.bufferedAtDequeue;
+	e.underrunSamples = (uint32)(stats.underrunSamples - audioLogUnderruns);
+	e.overrunSamples = (uint32)(stats.overrunSamples - audioLogOverruns);
+	audioLogUnderruns = stats.underrunSamples;
+	audioLogOverruns = stats.overrunSamples;
+	e.playbackRatio = stats.playbackRatio;
+	e.synthesisTime = stats.synthesisTime;
+	audioLogCount++;
+}
+
+void FCEUI_GetAudioStats(AudioStats *stats)
+{
+	audioStream.getStats(stats);
+}
+
+void FCEUI_ResetAudioStats()
+{
+	audioStream.resetStats();
+	audioLogCount = 0;
+	audioLogUnderruns = audioLogOverruns = 0;
+}
+
+void FCEUI_SetAudioLogSize(int frames)
+{
+	if(frames < 0) frames = 0;
+	audioLog.assign(frames, AudioLogEntry());
+	audioLogCount = 0;
+
+	AudioStats stats;
+	audioStream.getStats(&stats);
+	audioLogUnderruns = stats.underrunSamples;
+	audioLogOverruns = stats.overrunSamples;
+}
+
+bool FCEUI_DumpAudioLog(const char *fname)
+{
+	FILE *fp = FCEUD_UTF8fopen(fname,"w");
+	if(!fp) return false;
+
+	fputs("frame,queued,buffered_enqueue,buffered_dequeue,underrun_samples,overrun_samples,playback_ratio,synthesis_us\n",fp);
+
+	uint32 size = (uint32)audioLog.size();
+	uint32 count = audioLogCount < size ? audioLogCount : size;
+	uint32 first = audioLogCount - count;
+	for(uint32 i=0;i<count;i++)
+	{
+		const AudioLogEntry &e = audioLog[(first+i) % size];
+		fprintf(fp,"%u,%d,%d,%d,%u,%u,%.5f,%.1f\n",e.frame,e.queued,e.bufferedAtEnqueue,e.bufferedAtDequeue,
+			e.underrunSamples,e.overrunSamples,e.playbackRatio,e.synthesisTime*1000000.0);
+	}
+
+	fclose(fp);
+	return true;
+}
@@ -0,0 +1,170 @@
+#ifndef _AUDIO_H_
+#define _AUDIO_H_
+
+#include "types.h"
+#include "utils/ringbuffer.h"
+
+#include <atomic>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+//Counters describing the health of the audio path. Everything accumulates from the last
+//AudioStream::resetStats(). The stream tracks what it can see itself, the synthesis time is
+//reported by the core around FlushEmulateSound().
+struct AudioStats
+{
+	uint64 framesQueued;        //write() calls
+	uint64 samplesQueued;       //samples accepted by write()
+	uint64 samplesPlayed;       //samples produced by read() and generate(), not counting silence
+	uint64 underrunSamples;     //silence generate() inserted because the queue ran dry
+	uint32 underruns;           //generate() calls that had to insert silence
+	uint64 overrunSamples;      //samples write() dropped because the queue was full
+	uint32 overruns;            //write() calls that dropped samples
+	int bufferedAtEnqueue;      //queue fill level right after the last write()
+	int maxBufferedAtEnqueue;
+	int bufferedAtDequeue;      //queue fill level right before the last read()
+	int minBufferedAtDequeue;
+	double playbackRatio;       //queued samples consumed per played sample in the last read(), 1.0 = nominal
+	double synthesisTime;       //seconds the last frame spent in FlushEmulateSound()
+	double maxSynthesisTime;
+};
+
+//Queue of mono 16bit samples between the emulation thread (which writes one frame of
+//FlushEmulateSound() output at a time) and the audio device (which pulls at its own pace).
+//The consumer resamples with linear interpolation, so playback speed can be adjusted
+//in small steps without clicks.
+class AudioStream
+{
+public:
+	AudioStream(int capacity = 32768);
+
+	//--- producer side (emulation thread)
+
+	//enqueues samples, returns how many fit. anything that does not fit is dropped.
+	int write(const int32 *samples, int count);
+	int write(const int16 *samples, int count);
+
+	//output sample rate, used to decide when playback is too far behind
+	void setRate(int rate) { this->rate = rate; }
+	int getRate() const { return rate; }
+
+	//playback speed multiplier in 1/256ths, same units as fps_scale
+	void setScale(int scale) { this->scale.store(scale); }
+
+	//--- consumer side (audio thread)
+
+	//resamples as many samples as the queue can provide, up to count. returns the number produced.
+	int read(int16 *out, int count);
+
+	//always produces count samples, the ones the queue couldn't provide are silence
+	void generate(int16 *out, int count);
+
+	//drops everything queued (call while the consumer is idle)
+	void clear();
+
+	//--- either side
+
+	//samples waiting to be played
+	int buffered() const { return ring.size(); }
+	int capacity() const { return ring.capacity(); }
+
+	//--- telemetry (producer side). collecting it costs a few counter updates per call
+
+	void getStats(AudioStats *stats) const;
+	void resetStats();
+
+	//time FlushEmulateSound() took for the frame whose samples are written next
+	void setSynthesisTime(double seconds);
+
+private:
+	RingBuffer<int16> ring;
+	uint32 frac; //16.16 position between the first and second queued sample
+	std::atomic<int> scale;
+	int rate;
+
+	uint32 step(int available);
+	void noteWrite(int count, int written);
+
+	//producer-owned statistics
+	uint64 framesQueued, samplesQueued, overrunSamples;
+	uint32 overruns;
+	int bufferedAtEnqueue, maxBufferedAtEnqueue;
+	double synthesisTime, maxSynthesisTime;
+
+	//consumer-owned statistics, read by the producer
+	std::atomic<uint64> samplesPlayed, underrunSamples;
+	std::atomic<uint32> underruns;
+	std::atomic<int> bufferedAtDequeue, minBufferedAtDequeue;
+	std::atomic<uint32> lastStep;
+};
+
+//Somewhere the samples of an AudioStream end up. Backends driven by a device callback
+//pull from the stream on their own thread; others do their work in update().
+class AudioBackend
+{
+public:
+	virtual ~AudioBackend() {}
+
+	//starts consuming mono 16bit samples at the given rate from the stream
+	virtual bool open(AudioStream *stream, int rate) = 0;
+	virtual void close() = 0;
+
+	//called on the emulation thread after each frame's samples were queued
+	virtual void update() {}
+};
+
+//Discards everything it is given. Used for headless runs and when no device is available.
+class NullAudioBackend : public AudioBackend
+{
+public:
+	NullAudioBackend() : stream(0) {}
+	virtual bool open(AudioStream *stream, int rate);
+	virtual void close();
+	virtual void update();
+
+private:
+	AudioStream *stream;
+};
+
+//Writes the played samples to a .wav file.
+class WaveFileAudioBackend : public AudioBackend
+{
+public:
+	WaveFileAudioBackend(const char *fname);
+	virtual ~WaveFileAudioBackend();
+	virtual bool open(AudioStream *stream, int rate);
+	virtual void close();
+	virtual void update();
+
+private:
+	std::string fname;
+	FILE *fp;
+	long datasize;
+	AudioStream *stream;
+	std::vector<int16> temp;
+};
+
+//core-owned stream that the driver feeds its sound output into
+AudioStream *FCEUI_GetAudioStream();
+
+//installs the backend which plays FCEUI_GetAudioStream(), taking ownership of it.
+//the previous backend is closed and deleted. passing NULL just closes the current one.
+bool FCEUI_SetAudioBackend(AudioBackend *backend, int rate);
+AudioBackend *FCEUI_GetAudioBackend();
+
+//queues one frame of FCEUI_Emulate() sound output and lets the backend process it
+void FCEUI_WriteAudio(const int32 *samples, int count);
+
+//statistics of the core audio stream, see AudioStats
+void FCEUI_GetAudioStats(AudioStats *stats);
+void FCEUI_ResetAudioStats();
+
+//keeps a per-frame history of the last `frames` frames of audio statistics (0 turns it off),
+//so it can be written out when something goes wrong
+void FCEUI_SetAudioLogSize(int frames);
+
+//writes the rolling history as CSV, oldest frame first. returns false if it can't be written
+bool FCEUI_DumpAudioLog(const char *fname);
+
+#endif
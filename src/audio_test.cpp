@@ -0,0 +1,316 @@
+/* FCE Ultra - NES/Famicom Emulator
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+//Standalone test of RingBuffer, AudioStream and the null and wave file backends.
+//Not part of the emulator build:
+//  g++ -std=c++11 -DPSS_STYLE=1 -I. audio_test.cpp audio.cpp utils/endian.cpp -pthread -o audio_test
+
+#include "audio.h"
+#include "utils/ringbuffer.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+static int failures = 0;
+
+#define CHECK(cond) do { if(!(cond)) { printf("%s:%d: failed: %s\n", __FILE__, __LINE__, #cond); failures++; } } while(0)
+
+//the driver's, which audio.cpp opens the wave file with
+FILE *FCEUD_UTF8fopen(const char *fn, const char *mode)
+{
+	return fopen(fn, mode);
+}
+
+//the capacity is rounded up to a power of two, and a full buffer takes nothing more
+static void TestRingFullEmpty()
+{
+	RingBuffer<int> ring(5);
+	CHECK(ring.capacity() == 8);
+	CHECK(ring.size() == 0);
+	CHECK(ring.space() == 8);
+
+	int out[16];
+	CHECK(ring.read(out, 4) == 0);
+	CHECK(ring.skip(4) == 0);
+
+	int in[16];
+	for(int i = 0; i < 16; i++)
+		in[i] = i;
+	CHECK(ring.write(in, 10) == 8);
+	CHECK(ring.size() == 8);
+	CHECK(ring.space() == 0);
+	CHECK(ring.write(in, 1) == 0);
+
+	CHECK(ring.read(out, 16) == 8);
+	for(int i = 0; i < 8; i++)
+		CHECK(out[i] == i);
+	CHECK(ring.size() == 0);
+
+	ring.write(in, 3);
+	ring.clear();
+	CHECK(ring.size() == 0);
+	CHECK(ring.space() == 8);
+}
+
+//writes and reads that straddle the end of the storage come out whole and in order
+static void TestRingWraparound()
+{
+	RingBuffer<int> ring(8);
+	int next = 0, expect = 0;
+	bool ordered = true;
+	for(int round = 0; round < 100; round++)
+	{
+		int in[5];
+		for(int i = 0; i < 5; i++)
+			in[i] = next++;
+		CHECK(ring.write(in, 5) == 5);
+
+		CHECK(ring.peek(0) == expect);
+		CHECK(ring.peek(4) == expect + 4);
+
+		int out[5];
+		int got = ring.read(out, 3);
+		CHECK(got == 3);
+		for(int i = 0; i < got; i++)
+			if(out[i] != expect++)
+				ordered = false;
+		CHECK(ring.skip(2) == 2);
+		expect += 2;
+	}
+	CHECK(ordered);
+	CHECK(ring.size() == 0);
+}
+
+//a producer and a consumer on their own threads, with no locking: everything arrives once, in order
+static void TestRingThreads()
+{
+	RingBuffer<int> ring(64);
+	const int total = 200000;
+	bool ordered = true;
+
+	std::thread producer([&ring, total]() {
+		int next = 0;
+		while(next < total)
+		{
+			int in[37];
+			int count = total - next < 37 ? total - next : 37;
+			for(int i = 0; i < count; i++)
+				in[i] = next + i;
+			int written = ring.write(in, count);
+			if(!written)
+				std::this_thread::yield();
+			next += written;
+		}
+	});
+
+	int expect = 0;
+	while(expect < total)
+	{
+		int out[23];
+		int got = ring.read(out, 23);
+		if(!got)
+			std::this_thread::yield();
+		for(int i = 0; i < got; i++)
+			if(out[i] != expect++)
+				ordered = false;
+	}
+	producer.join();
+
+	CHECK(ordered);
+	CHECK(expect == total);
+	CHECK(ring.size() == 0);
+}
+
+//at the nominal rate the samples come out as they went in; at half speed every other one is
+//halfway between its neighbours
+static void TestStreamInterpolation()
+{
+	AudioStream stream(1024);
+	stream.setRate(44100);
+
+	int16 in[100];
+	for(int i = 0; i < 100; i++)
+		in[i] = (int16)(i * 100);
+	stream.write(in, 100);
+
+	int16 out[200];
+	int got = stream.read(out, 50);
+	CHECK(got == 50);
+	bool same = true;
+	for(int i = 0; i < got; i++)
+		if(out[i] != in[i])
+			same = false;
+	CHECK(same);
+
+	stream.setScale(128);
+	got = stream.read(out, 20);
+	CHECK(got == 20);
+	CHECK(out[0] == 5000);
+	CHECK(out[1] == 5050);
+	CHECK(out[2] == 5100);
+
+	//int32 input is clipped to 16 bits
+	AudioStream clipped(64);
+	int32 loud[3] = { 40000, -40000, 123 };
+	CHECK(clipped.write(loud, 3) == 3);
+	CHECK(clipped.read(out, 2) == 2);
+	CHECK(out[0] == 32767);
+	CHECK(out[1] == -32768);
+}
+
+//more than three frames behind, playback speeds up to catch up
+static void TestStreamCatchUp()
+{
+	AudioStream stream(32768);
+	stream.setRate(44100);
+
+	int16 in[4410];
+	for(int i = 0; i < 4410; i++)
+		in[i] = 0;
+	stream.write(in, 4410);
+
+	int16 out[100];
+	int got = stream.read(out, 100);
+	CHECK(got == 100);
+	AudioStats stats;
+	stream.getStats(&stats);
+	CHECK(stats.playbackRatio > 1.0);
+	CHECK(stream.buffered() < 4410 - 100);
+
+	//close to a frame queued, it plays at the nominal rate
+	stream.clear();
+	stream.write(in, 735);
+	stream.read(out, 100);
+	stream.getStats(&stats);
+	CHECK(stats.playbackRatio == 1.0);
+	CHECK(stream.buffered() == 635);
+}
+
+//generate() pads with silence and counts it; write() counts what didn't fit
+static void TestStreamUnderrunOverrun()
+{
+	AudioStream stream(64);
+	stream.resetStats();
+
+	int16 in[100];
+	for(int i = 0; i < 100; i++)
+		in[i] = 1000;
+	CHECK(stream.write(in, 100) == 64);
+
+	int16 out[100];
+	stream.generate(out, 100);
+	CHECK(out[0] == 1000);
+	CHECK(out[62] == 1000);
+	CHECK(out[99] == 0);
+
+	AudioStats stats;
+	stream.getStats(&stats);
+	CHECK(stats.framesQueued == 1);
+	CHECK(stats.samplesQueued == 64);
+	CHECK(stats.overruns == 1);
+	CHECK(stats.overrunSamples == 36);
+	CHECK(stats.underruns == 1);
+	CHECK(stats.samplesPlayed + stats.underrunSamples == 100);
+
+	stream.generate(out, 10);
+	stream.getStats(&stats);
+	CHECK(stats.underruns == 2);
+
+	stream.resetStats();
+	stream.getStats(&stats);
+	CHECK(stats.underruns == 0);
+	CHECK(stats.overruns == 0);
+}
+
+//the null backend throws away what it's given
+static void TestNullBackend()
+{
+	AudioStream stream(1024);
+	NullAudioBackend backend;
+	CHECK(backend.open(&stream, 48000));
+	CHECK(stream.getRate() == 48000);
+
+	int16 in[100] = { 0 };
+	stream.write(in, 100);
+	backend.update();
+	CHECK(stream.buffered() == 0);
+	backend.close();
+}
+
+static uint32 Read32(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32)p[3] << 24);
+}
+
+//the wave file backend writes what's played behind a header with the sizes filled in
+static void TestWaveFileBackend()
+{
+	const char *fname = "audio_test.wav";
+	AudioStream stream(4096);
+	WaveFileAudioBackend *backend = new WaveFileAudioBackend(fname);
+	CHECK(backend->open(&stream, 44100));
+
+	int16 in[500];
+	for(int i = 0; i < 500; i++)
+		in[i] = (int16)(i - 250);
+	stream.write(in, 500);
+	backend->update();
+	delete backend; //closes it
+
+	FILE *fp = fopen(fname, "rb");
+	CHECK(fp != NULL);
+	if(!fp)
+		return;
+	unsigned char file[2048];
+	size_t size = fread(file, 1, sizeof(file), fp);
+	fclose(fp);
+	remove(fname);
+
+	//the last sample stays queued, as the one the next would be interpolated towards
+	uint32 datasize = 499 * 2;
+	CHECK(size == 44 + datasize);
+	CHECK(memcmp(file, "RIFF", 4) == 0);
+	CHECK(Read32(file + 4) == datasize + 36);
+	CHECK(memcmp(file + 8, "WAVEfmt ", 8) == 0);
+	CHECK(Read32(file + 24) == 44100);
+	CHECK(memcmp(file + 36, "data", 4) == 0);
+	CHECK(Read32(file + 40) == datasize);
+	CHECK((int16)(file[44] | (file[45] << 8)) == -250);
+	CHECK((int16)(file[44 + 2 * 498] | (file[45 + 2 * 498] << 8)) == 248);
+}
+
+int main()
+{
+	TestRingFullEmpty();
+	TestRingWraparound();
+	TestRingThreads();
+	TestStreamInterpolation();
+	TestStreamCatchUp();
+	TestStreamUnderrunOverrun();
+	TestNullBackend();
+	TestWaveFileBackend();
+
+	if(failures)
+	{
+		printf("%d checks failed\n", failures);
+		return 1;
+	}
+	printf("all passed\n");
+	return 0;
+}
@@ -0,0 +1,627 @@
+/* FCE Ultra - NES/Famicom Emulator
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "batchverify.h"
+#include "fceu.h"
+#include "movie.h"
+#include "driver.h"
+#include "video.h"
+
+#include "rapidjson/document.h"
+#include "rapidjson/prettywriter.h"
+#include "rapidjson/ostreamwrapper.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <new>
+#include <thread>
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <cerrno>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#define VERIFY_MAX_PROCESSES 64 //WaitForMultipleObjects() waits for no more
+
+extern int EnableAutosave;
+extern int disableBatteryLoading;
+extern int disableBatterySaving;
+
+enum
+{
+	VS_PENDING,
+	VS_CLAIMED,
+	VS_DONE
+};
+
+enum
+{
+	VR_NOT_RUN,
+	VR_PASS,
+	VR_MISMATCH,   //a hash didn't match, or the movie ended before a frame that has one
+	VR_NO_ROM,
+	VR_NO_MOVIE,
+	VR_STOPPED,    //emulation stopped before the end of the movie
+	VR_CRASHED     //the worker died while replaying it
+};
+
+static const char *ResultName(int result)
+{
+	switch(result)
+	{
+	case VR_PASS: return "pass";
+	case VR_MISMATCH: return "mismatch";
+	case VR_NO_ROM: return "no_rom";
+	case VR_NO_MOVIE: return "no_movie";
+	case VR_STOPPED: return "stopped";
+	case VR_CRASHED: return "crashed";
+	default: return "not_run";
+	}
+}
+
+//a movie's result, filled in by the worker that claimed it
+struct VerifySlot
+{
+	std::atomic<uint32> state;
+	int32 worker;
+	int32 result;
+	int32 firstMismatch;  //-1 if none
+	uint32 frames;        //emulated
+	uint32 hashed;
+	uint64 expected;      //at the first mismatch
+	uint64 actual;
+	uint64 finalHash;
+	bool haveFinal;
+	double seconds;
+};
+
+//what the workers share: the next movie to claim, then a slot for every movie
+struct VerifyShared
+{
+	std::atomic<uint32> next;
+	uint32 count;
+
+	VerifySlot *slots() { return (VerifySlot *)(this + 1); }
+	static size_t size(uint32 count) { return sizeof(VerifyShared) + count * sizeof(VerifySlot); }
+};
+
+static uint64 HashPicture()
+{
+	uint64 hash = 14695981039346656037ULL;
+	for(size_t i = 0; i < 256 * 240; i++)
+		hash = (hash ^ XBuf[i]) * 1099511628211ULL;
+	return hash;
+}
+
+static std::string HashString(uint64 hash)
+{
+	char buf[24];
+	sprintf(buf, "%016llX", (unsigned long long)hash);
+	return buf;
+}
+
+//-----------------------------------------------------------------------------
+
+static bool IsAbsolute(const std::string &path)
+{
+	return !path.empty() && (path[0] == '/' || path[0] == '\\' || (path.size() > 1 && path[1] == ':'));
+}
+
+static bool ReadHash(const rapidjson::Value &v, uint64 &hash)
+{
+	if(!v.IsString())
+		return false;
+	const char *s = v.GetString();
+	char *end;
+	hash = strtoull(s, &end, 16);
+	return end != s && !*end;
+}
+
+static bool FrameBefore(const FCEUVerifyFrame &a, const FCEUVerifyFrame &b)
+{
+	return a.frame < b.frame;
+}
+
+bool FCEU_ReadVerifyManifest(const char *path, std::vector<FCEUVerifyEntry> &entries, std::string &error)
+{
+	std::ifstream stream(path, std::ios::binary);
+	if(!stream)
+	{
+		error = "can't open the manifest";
+		return false;
+	}
+	std::string text((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+
+	rapidjson::Document d;
+	d.Parse(text.c_str());
+	if(d.HasParseError() || !d.IsObject() || !d.HasMember("movies") || !d["movies"].IsArray())
+	{
+		error = "the manifest isn't an object with a \"movies\" array";
+		return false;
+	}
+
+	std::string dir = path;
+	size_t slash = dir.find_last_of("/\\");
+	dir = slash == std::string::npos ? "" : dir.substr(0, slash + 1);
+
+	entries.clear();
+	const rapidjson::Value &movies = d["movies"];
+	for(rapidjson::SizeType i = 0; i < movies.Size(); i++)
+	{
+		const rapidjson::Value &m = movies[i];
+		char where[64];
+		sprintf(where, "movie %u: ", (unsigned)i);
+		if(!m.IsObject() || !m.HasMember("rom") || !m["rom"].IsString() || !m.HasMember("movie") || !m["movie"].IsString())
+		{
+			error = std::string(where) + "needs \"rom\" and \"movie\"";
+			return false;
+		}
+
+		FCEUVerifyEntry e;
+		e.rom = m["rom"].GetString();
+		e.movie = m["movie"].GetString();
+		if(!IsAbsolute(e.rom))
+			e.rom = dir + e.rom;
+		if(!IsAbsolute(e.movie))
+			e.movie = dir + e.movie;
+
+		if(m.HasMember("final"))
+		{
+			if(!ReadHash(m["final"], e.final))
+			{
+				error = std::string(where) + "\"final\" isn't a hex hash";
+				return false;
+			}
+			e.hasFinal = true;
+		}
+
+		if(m.HasMember("frames"))
+		{
+			const rapidjson::Value &frames = m["frames"];
+			if(!frames.IsArray())
+			{
+				error = std::string(where) + "\"frames\" isn't an array";
+				return false;
+			}
+			for(rapidjson::SizeType k = 0; k < frames.Size(); k++)
+			{
+				const rapidjson::Value &f = frames[k];
+				FCEUVerifyFrame frame;
+				if(!f.IsObject() || !f.HasMember("frame") || !f["frame"].IsInt() || f["frame"].GetInt() < 1
+					|| !f.HasMember("hash") || !ReadHash(f["hash"], frame.hash))
+				{
+					error = std::string(where) + "every frame needs a \"frame\" from 1 and a hex \"hash\"";
+					return false;
+				}
+				frame.frame = f["frame"].GetInt();
+				e.frames.push_back(frame);
+			}
+			std::stable_sort(e.frames.begin(), e.frames.end(), FrameBefore);
+		}
+		entries.push_back(e);
+	}
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+//the worker's side
+
+static void Mismatch(VerifySlot &slot, int frame, uint64 expected, uint64 actual)
+{
+	slot.result = VR_MISMATCH;
+	slot.firstMismatch = frame;
+	slot.expected = expected;
+	slot.actual = actual;
+}
+
+static void Verify(const FCEUVerifyEntry &e, VerifySlot &slot)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	if(!FCEUI_LoadGame(e.rom.c_str(), 1, true))
+		slot.result = VR_NO_ROM;
+	else if(!FCEUI_LoadMovie(e.movie.c_str(), true, 0) || !FCEUMOV_IsPlaying())
+		slot.result = VR_NO_MOVIE;
+	else
+	{
+		FCEUI_SetEmulationPaused(0);
+		int length = currMovieData.records.size();
+		size_t next = 0;
+		slot.result = VR_PASS;
+
+		//stops at the first mismatch: the frames after it have nothing more to say
+		while(slot.result == VR_PASS && FCEUMOV_GetFrame() < length && FCEUI_EmulateHidden())
+		{
+			int frame = FCEUMOV_GetFrame();
+			if(next < e.frames.size() && e.frames[next].frame == frame)
+			{
+				uint64 hash = HashPicture();
+				slot.hashed++;
+				if(hash != e.frames[next].hash)
+					Mismatch(slot, frame, e.frames[next].hash, hash);
+				while(next < e.frames.size() && e.frames[next].frame == frame)
+					next++;
+			}
+		}
+
+		slot.frames = FCEUMOV_GetFrame();
+		if(slot.result == VR_PASS)
+		{
+			slot.finalHash = HashPicture();
+			slot.haveFinal = true;
+			if((int)slot.frames < length)
+				slot.result = VR_STOPPED;
+			else if(next < e.frames.size())
+				Mismatch(slot, e.frames[next].frame, e.frames[next].hash, 0);
+			else if(e.hasFinal && slot.finalHash != e.final)
+				Mismatch(slot, length, e.final, slot.finalHash);
+		}
+	}
+
+	FCEUI_StopMovie();
+	FCEUI_CloseGame();
+	slot.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static int RunWorker(const std::vector<FCEUVerifyEntry> &entries, VerifyShared *shared, int id)
+{
+	//nothing a worker does may reach the disk
+	EnableAutosave = 0;
+	disableBatteryLoading = 1;
+	disableBatterySaving = 1;
+	FCEUI_SetAutoResume(false, 0);
+	FCEUI_SetRewind(false, 1, 1);
+	FCEUI_SetMovieKeyframes(false, 60, 1, false);
+
+	for(;;)
+	{
+		uint32 i = shared->next.fetch_add(1);
+		if(i >= shared->count || i >= entries.size())
+			return 0;
+
+		VerifySlot &slot = shared->slots()[i];
+		slot.worker = id;
+		slot.state.store(VS_CLAIMED);
+		Verify(entries[i], slot);
+		slot.state.store(VS_DONE);
+	}
+}
+
+//-----------------------------------------------------------------------------
+//processes and the memory they share
+
+#ifdef WIN32
+
+typedef HANDLE Worker;
+
+static VerifyShared *MapShared(const char *name, size_t size, HANDLE &mapping, bool create)
+{
+	if(create)
+		mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, (DWORD)size, name);
+	else
+		mapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, name);
+	if(!mapping)
+		return NULL;
+	void *view = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+	if(!view)
+	{
+		CloseHandle(mapping);
+		return NULL;
+	}
+	return (VerifyShared *)view;
+}
+
+static void UnmapShared(VerifyShared *shared, size_t size, HANDLE mapping)
+{
+	UnmapViewOfFile(shared);
+	CloseHandle(mapping);
+}
+
+static bool StartWorker(const char *manifest, const char *name, int id, const std::vector<FCEUVerifyEntry> &, VerifyShared *, Worker &worker)
+{
+	char exe[MAX_PATH];
+	if(!GetModuleFileNameA(NULL, exe, MAX_PATH))
+		return false;
+
+	char idText[16];
+	sprintf(idText, "%d", id);
+	std::string cmd = std::string("\"") + exe + "\" -verifyworker \"" + manifest + "\" " + name + " " + idText;
+
+	STARTUPINFOA si;
+	PROCESS_INFORMATION pi;
+	ZeroMemory(&si, sizeof(si));
+	si.cb = sizeof(si);
+	if(!CreateProcessA(exe, &cmd[0], NULL, NULL, FALSE, CREATE_NO_WINDOW, NULL, NULL, &si, &pi))
+		return false;
+	CloseHandle(pi.hThread);
+	worker = pi.hProcess;
+	return true;
+}
+
+//waits for a worker to exit. the index of the one that did, or -1
+static int WaitWorker(std::vector<Worker> &live)
+{
+	DWORD r = WaitForMultipleObjects((DWORD)live.size(), &live[0], FALSE, INFINITE);
+	if(r >= WAIT_OBJECT_0 + live.size())
+		return -1;
+	int k = (int)(r - WAIT_OBJECT_0);
+	CloseHandle(live[k]);
+	return k;
+}
+
+int FCEUI_VerifyWorker(const char *manifest, const char *shared, int id)
+{
+	std::vector<FCEUVerifyEntry> entries;
+	std::string error;
+	if(!FCEU_ReadVerifyManifest(manifest, entries, error))
+		return 1;
+
+	HANDLE mapping;
+	size_t size = VerifyShared::size((uint32)entries.size());
+	VerifyShared *view = MapShared(shared, size, mapping, false);
+	if(!view)
+		return 1;
+	int r = RunWorker(entries, view, id);
+	UnmapShared(view, size, mapping);
+	return r;
+}
+
+#else
+
+typedef pid_t Worker;
+
+static VerifyShared *MapShared(const char *, size_t size, int &, bool)
+{
+	void *view = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	return view == MAP_FAILED ? NULL : (VerifyShared *)view;
+}
+
+static void UnmapShared(VerifyShared *shared, size_t size, int)
+{
+	munmap(shared, size);
+}
+
+//the child leaves through _exit(), so the parent's atexit handlers, stdio buffers and other threads
+//are never touched
+static bool StartWorker(const char *, const char *, int id, const std::vector<FCEUVerifyEntry> &entries, VerifyShared *shared, Worker &worker)
+{
+	pid_t pid = fork();
+	if(pid < 0)
+		return false;
+	if(pid == 0)
+		_exit(RunWorker(entries, shared, id));
+	worker = pid;
+	return true;
+}
+
+static int WaitWorker(std::vector<Worker> &live)
+{
+	for(;;)
+	{
+		pid_t pid = waitpid(-1, NULL, 0);
+		if(pid < 0 && errno == EINTR)
+			continue;
+		if(pid < 0)
+			return -1;
+		std::vector<Worker>::iterator it = std::find(live.begin(), live.end(), pid);
+		if(it != live.end())
+			return (int)(it - live.begin());
+	}
+}
+
+int FCEUI_VerifyWorker(const char *, const char *, int)
+{
+	return 1; //workers are forked here
+}
+
+#endif
+
+//-----------------------------------------------------------------------------
+//the runner's side
+
+static bool WriteReport(const char *path, const char *manifest, const std::vector<FCEUVerifyEntry> &entries,
+	VerifyShared *shared, int processes, double seconds, int failed)
+{
+	std::ofstream stream(path);
+	if(!stream)
+		return false;
+
+	rapidjson::OStreamWrapper osw(stream);
+	rapidjson::PrettyWriter<rapidjson::OStreamWrapper> w(osw);
+
+	double busy = 0;
+	for(size_t i = 0; i < entries.size(); i++)
+		busy += shared->slots()[i].seconds;
+
+	w.StartObject();
+	w.Key("manifest"); w.String(manifest);
+	w.Key("processes"); w.Int(processes);
+	w.Key("seconds"); w.Double(seconds);
+	w.Key("worker_seconds"); w.Double(busy);
+	w.Key("total"); w.Int((int)entries.size());
+	w.Key("passed"); w.Int((int)entries.size() - failed);
+	w.Key("failed"); w.Int(failed);
+	w.Key("movies");
+	w.StartArray();
+	for(size_t i = 0; i < entries.size(); i++)
+	{
+		const VerifySlot &slot = shared->slots()[i];
+		w.StartObject();
+		w.Key("rom"); w.String(entries[i].rom.c_str());
+		w.Key("movie"); w.String(entries[i].movie.c_str());
+		w.Key("result"); w.String(ResultName(slot.result));
+		w.Key("worker"); w.Int(slot.worker);
+		w.Key("seconds"); w.Double(slot.seconds);
+		w.Key("frames"); w.Uint(slot.frames);
+		w.Key("frames_hashed"); w.Uint(slot.hashed);
+		w.Key("first_mismatch");
+		if(slot.result == VR_MISMATCH)
+		{
+			w.Int(slot.firstMismatch);
+			w.Key("expected"); w.String(HashString(slot.expected).c_str());
+			//null if the movie ended before the frame
+			w.Key("actual");
+			if(slot.firstMismatch <= (int)slot.frames)
+				w.String(HashString(slot.actual).c_str());
+			else
+				w.Null();
+		}
+		else
+			w.Null();
+		if(slot.haveFinal)
+		{
+			w.Key("final"); w.String(HashString(slot.finalHash).c_str());
+		}
+		w.EndObject();
+	}
+	w.EndArray();
+	w.EndObject();
+	stream << "\n";
+	return (bool)stream;
+}
+
+int FCEUI_VerifyMovies(const char *manifest, const char *report, int processes)
+{
+	std::vector<FCEUVerifyEntry> entries;
+	std::string error;
+	if(!FCEU_ReadVerifyManifest(manifest, entries, error))
+	{
+		FCEU_printf("Movie verification: %s: %s\n", manifest, error.c_str());
+		return -1;
+	}
+
+	if(processes <= 0)
+		processes = (int)std::thread::hardware_concurrency();
+	processes = std::max(1, std::min(processes, VERIFY_MAX_PROCESSES));
+	processes = std::min(processes, std::max(1, (int)entries.size()));
+
+	char name[64];
+#ifdef WIN32
+	sprintf(name, "fceux-verify-%lu", (unsigned long)GetCurrentProcessId());
+	HANDLE mapping;
+#else
+	sprintf(name, "-");
+	int mapping = 0;
+#endif
+	size_t size = VerifyShared::size((uint32)entries.size());
+	VerifyShared *shared = MapShared(name, size, mapping, true);
+	if(!shared)
+	{
+		FCEU_printf("Movie verification: can't set up memory for the workers\n");
+		return -1;
+	}
+	new(shared) VerifyShared();
+	shared->next.store(0);
+	shared->count = (uint32)entries.size();
+	for(size_t i = 0; i < entries.size(); i++)
+	{
+		VerifySlot *slot = new(&shared->slots()[i]) VerifySlot();
+		slot->state.store(VS_PENDING);
+		slot->worker = -1;
+		slot->result = VR_NOT_RUN;
+		slot->firstMismatch = -1;
+		slot->frames = slot->hashed = 0;
+		slot->expected = slot->actual = slot->finalHash = 0;
+		slot->haveFinal = false;
+		slot->seconds = 0;
+	}
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	std::vector<Worker> live;
+	std::vector<int> ids;
+	int nextId = 0;
+	for(int i = 0; i < processes; i++)
+	{
+		Worker worker;
+		if(!StartWorker(manifest, name, nextId, entries, shared, worker))
+			break;
+		live.push_back(worker);
+		ids.push_back(nextId++);
+	}
+
+	while(!live.empty())
+	{
+		int k = WaitWorker(live);
+		if(k < 0)
+			break;
+		int id = ids[k];
+		live.erase(live.begin() + k);
+		ids.erase(ids.begin() + k);
+
+		//what it was replaying when it died is lost. if movies are left, another takes its place
+		for(size_t i = 0; i < entries.size(); i++)
+		{
+			VerifySlot &slot = shared->slots()[i];
+			if(slot.worker == id && slot.state.load() == VS_CLAIMED)
+			{
+				slot.result = VR_CRASHED;
+				slot.state.store(VS_DONE);
+			}
+		}
+		Worker worker;
+		if(shared->next.load() < shared->count && StartWorker(manifest, name, nextId, entries, shared, worker))
+		{
+			live.push_back(worker);
+			ids.push_back(nextId++);
+		}
+	}
+
+	//a worker that died between claiming a movie and marking it leaves it pending
+	uint32 claimed = std::min(shared->next.load(), shared->count);
+	for(uint32 i = 0; i < claimed; i++)
+	{
+		VerifySlot &slot = shared->slots()[i];
+		if(slot.state.load() != VS_DONE)
+			slot.result = VR_CRASHED;
+	}
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	int failed = 0;
+	for(size_t i = 0; i < entries.size(); i++)
+	{
+		const VerifySlot &slot = shared->slots()[i];
+		if(slot.result != VR_PASS)
+		{
+			failed++;
+			FCEU_printf("Movie verification: %s: %s", entries[i].movie.c_str(), ResultName(slot.result));
+			if(slot.result == VR_MISMATCH)
+				FCEU_printf(" at frame %d", slot.firstMismatch);
+			FCEU_printf("\n");
+		}
+	}
+	FCEU_printf("Movie verification: %d of %d passed in %.1f s on %d processes\n",
+		(int)entries.size() - failed, (int)entries.size(), seconds, processes);
+
+	bool written = WriteReport(report, manifest, entries, shared, processes, seconds, failed);
+	UnmapShared(shared, size, mapping);
+	if(!written)
+	{
+		FCEU_printf("Movie verification: can't write the report to %s\n", report);
+		return -1;
+	}
+	return failed;
+}
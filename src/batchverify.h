@@ -0,0 +1,46 @@
+#ifndef _BATCHVERIFY_H_
+#define _BATCHVERIFY_H_
+
+#include "types.h"
+
+#include <string>
+#include <vector>
+
+//Batch movie verification, for regression testing a build.
+//
+//Replays a library of movies, each against its ROM, and checks the pictures at chosen frames
+//against the hashes they're expected to have. The movies are shared out among worker processes
+//through a counter in shared memory: each takes the next one as soon as it's done with the last,
+//so a long movie doesn't hold up the rest, and a worker that dies is replaced. Workers emulate
+//without presenting or synthesizing sound (FCEUI_EmulateHidden()) and hash only the frames asked
+//for. On POSIX they're forked from the calling process; on Windows they're this program started
+//again with -verifyworker, which the driver hands to FCEUI_VerifyWorker().
+//
+//The manifest is JSON, paths relative to it:
+//  {"movies": [{"rom": "smb.nes", "movie": "smb.fm2", "final": "<hash>",
+//               "frames": [{"frame": 600, "hash": "<hash>"}]}]}
+//A hash is the FNV-1a of the 256x240 picture, 16 hex digits, taken when the frame counter reads
+//that frame; "final" is the one at the end of the movie. Both are optional, and the report gives
+//the final hash either way, so a first run can fill in the manifest.
+
+struct FCEUVerifyFrame
+{
+	int frame;
+	uint64 hash;
+};
+
+struct FCEUVerifyEntry
+{
+	std::string rom;
+	std::string movie;
+	bool hasFinal;
+	uint64 final;
+	std::vector<FCEUVerifyFrame> frames; //in frame order
+
+	FCEUVerifyEntry() : hasFinal(false), final(0) {}
+};
+
+//false, with the reason in error, if the manifest can't be read
+bool FCEU_ReadVerifyManifest(const char *path, std::vector<FCEUVerifyEntry> &entries, std::string &error);
+
+#endif
@@ -55,10 +55,12 @@ static void Sync(void) {
 
 static DECLFW(M103RamWrite0) {
 	WRAM[A & 0x1FFF] = V;
+	FCEUSS_MarkWritten(&WRAM[A & 0x1FFF]);
 }
 
 static DECLFW(M103RamWrite1) {
 	WRAM[0x2000 + ((A - 0xB800) & 0x1FFF)] = V;
+	FCEUSS_MarkWritten(&WRAM[0x2000 + ((A - 0xB800) & 0x1FFF)]);
 }
 
 static DECLFW(M103Write0) {
@@ -35,8 +35,10 @@ static int kanji_pos, kanji_page, r40C0;
 static int IRQa, IRQCount;
 
 static DECLFW(MBWRAM) {
-	if (!(DRegs[3] & 0x10))
+	if (!(DRegs[3] & 0x10)) {
 		Page[A >> 11][A] = V;
+		FCEUSS_MarkWritten(&Page[A >> 11][A]);
+	}
 }
 
 static DECLFR(MAWRAM) {
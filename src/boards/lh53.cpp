@@ -52,6 +52,7 @@ static void Sync(void) {
 
 static DECLFW(LH53RamWrite) {
 	WRAM[(A - 0xB800) & 0x1FFF] = V;
+	FCEUSS_MarkWritten(&WRAM[(A - 0xB800) & 0x1FFF]);
 }
 
 static DECLFW(LH53Write) {
@@ -5,6 +5,7 @@
 #include "../ppu.h"
 #include "../sound.h"
 #include "../state.h"
+#include "../statedigest.h"
 #include "../cart.h"
 #include "../cheat.h"
 #include "../unif.h"
@@ -38,8 +38,10 @@ static uint8 *CHRRAM = NULL;
 static int is155, is171;
 
 static DECLFW(MBWRAM) {
-	if (!(DRegs[3] & 0x10) || is155)
+	if (!(DRegs[3] & 0x10) || is155) {
 		Page[A >> 11][A] = V;  // WRAM is enabled.
+		FCEUSS_MarkWritten(&Page[A >> 11][A]);
+	}
 }
 
 static DECLFR(MAWRAM) {
@@ -259,6 +259,7 @@ static void GENNOMWRAP(uint8 V) {
 
 static DECLFW(MBWRAMMMC6) {
 	WRAM[A & 0x3ff] = V;
+	FCEUSS_MarkWritten(&WRAM[A & 0x3ff]);
 }
 
 static DECLFR(MAWRAMMMC6) {
@@ -525,6 +526,7 @@ static void M45PW(uint32 A, uint8 V) {
 static DECLFW(M45Write) {
 	if (EXPREGS[3] & 0x40) {
 		WRAM[A - 0x6000] = V;
+		FCEUSS_MarkWritten(&WRAM[A - 0x6000]);
 		return;
 	}
 	EXPREGS[EXPREGS[4]] = V;
@@ -664,6 +666,7 @@ static void M52CW(uint32 A, uint8 V) {
 static DECLFW(M52Write) {
 	if (EXPREGS[1]) {
 		WRAM[A - 0x6000] = V;
+		FCEUSS_MarkWritten(&WRAM[A - 0x6000]);
 		return;
 	}
 	EXPREGS[1] = V & 0x80;
@@ -160,8 +160,10 @@ static void mmc5_PPUWrite(uint32 A, uint8 V) {
 		} else
 			PALRAM[tmp & 0x1F] = V & 0x3F;
 	} else if (tmp < 0x2000) {
-		if (PPUCHRRAM & (1 << (tmp >> 10)))
+		if (PPUCHRRAM & (1 << (tmp >> 10))) {
 			VPage[tmp >> 10][tmp] = V;
+			FCEUSS_MarkWritten(&VPage[tmp >> 10][tmp]);
+		}
 	} else {
 		if (PPUNTARAM & (1 << ((tmp & 0xF00) >> 10)))
 			vnapage[((tmp & 0xF00) >> 10)][tmp & 0x3FF] = V;
@@ -583,8 +585,10 @@ static DECLFW(MMC5_WriteROMRAM) {
 	if ((A >= 0x8000) && (MMC5ROMWrProtect[(A - 0x8000) >> 13]))
 			return;
 	if (MMC5MemIn[(A - 0x6000) >> 13])
-		if (((WRAMMaskEnable[0] & 3) | ((WRAMMaskEnable[1] & 3) << 2)) == 6)
+		if (((WRAMMaskEnable[0] & 3) | ((WRAMMaskEnable[1] & 3) << 2)) == 6) {
 			Page[A >> 11][A] = V;
+			FCEUSS_MarkWritten(&Page[A >> 11][A]);
+		}
 }
 
 static DECLFW(MMC5_ExRAMWr) {
@@ -0,0 +1,241 @@
+/* FCE Ultra - NES/Famicom Emulator
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "branch.h"
+#include "fceu.h"
+#include "git.h"
+#include "cheat.h"
+#include "movie.h"
+#include "netplay.h"
+#include "driver.h"
+#include "video.h"
+#include "utils/endian.h"
+
+#ifndef WIN32
+#include <cerrno>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#define BRANCH_REPORT_HEADER 28 //id, frames, the two hashes and the number of reads
+
+extern int EnableAutosave;
+extern int disableBatterySaving;
+
+#ifndef WIN32
+
+static uint64 Hash(const uint8 *p, size_t size)
+{
+	uint64 hash = 14695981039346656037ULL;
+	for(size_t i = 0; i < size; i++)
+		hash = (hash ^ p[i]) * 1099511628211ULL;
+	return hash;
+}
+
+static void Put64(uint8 *p, uint64 v)
+{
+	FCEU_en32lsb(p, (uint32)v);
+	FCEU_en32lsb(p + 4, (uint32)(v >> 32));
+}
+
+static uint64 Get64(uint8 *p)
+{
+	return FCEU_de32lsb(p) | ((uint64)FCEU_de32lsb(p + 4) << 32);
+}
+
+//the child's side. it leaves through _exit(), so the parent's atexit handlers, stdio buffers and
+//the state writer's thread (which didn't come along) are never touched
+static void RunBranch(int fd, uint32 id, const std::vector<uint32> &inputs, const std::vector<uint16> &reads)
+{
+	//nothing a branch does may reach the disk or outlive it
+	EnableAutosave = 0;
+	disableBatterySaving = 1;
+	FCEUI_SetAutoResume(false, 0);
+	FCEUI_SetRewind(false, 1, 1);
+	FCEUI_SetEmulationPaused(0);
+
+	static uint32 pads;
+	FCEUI_SetInput(0, SI_GAMEPAD, &pads, 0);
+	FCEUI_SetInput(1, SI_GAMEPAD, &pads, 0);
+
+	uint8 *gfx = XBuf;
+	int32 *sound;
+	int32 ssize;
+	for(size_t i = 0; i < inputs.size(); i++)
+	{
+		pads = inputs[i];
+		FCEUI_Emulate(&gfx, &sound, &ssize, 0);
+	}
+
+	std::vector<uint8> report(BRANCH_REPORT_HEADER + reads.size());
+	FCEU_en32lsb(&report[0], id);
+	FCEU_en32lsb(&report[4], (uint32)inputs.size());
+	Put64(&report[8], Hash(RAM, 0x800));
+	Put64(&report[16], Hash(gfx, 256 * 240));
+	FCEU_en32lsb(&report[24], (uint32)reads.size());
+	for(size_t i = 0; i < reads.size(); i++)
+		report[BRANCH_REPORT_HEADER + i] = (uint8)FCEU_CheatGetByte(reads[i]);
+
+	size_t sent = 0;
+	while(sent < report.size())
+	{
+		ssize_t n = write(fd, &report[sent], report.size() - sent);
+		if(n <= 0)
+			_exit(1);
+		sent += n;
+	}
+	_exit(0);
+}
+
+#endif
+
+FCEUBranchPool::FCEUBranchPool(int maxLive)
+{
+	setMaxLive(maxLive);
+}
+
+FCEUBranchPool::~FCEUBranchPool()
+{
+#ifndef WIN32
+	for(size_t i = 0; i < live.size(); i++)
+	{
+		kill(live[i].pid, SIGKILL);
+		close(live[i].fd);
+		waitpid(live[i].pid, NULL, 0);
+	}
+#endif
+}
+
+void FCEUBranchPool::setMaxLive(int maxLive)
+{
+	this->maxLive = maxLive > 0 ? maxLive : 1;
+}
+
+bool FCEUBranchPool::spawn(uint32 id, const std::vector<uint32> &inputs, const std::vector<uint16> &reads)
+{
+#ifdef WIN32
+	return false;
+#else
+	if(!GameInfo || !FCEUMOV_Mode(MOVIEMODE_INACTIVE) || FCEUnetplay)
+		return false;
+
+	while((int)live.size() >= maxLive)
+		if(!reap(true))
+			return false;
+
+	int fds[2];
+	if(pipe(fds))
+		return false;
+
+	pid_t pid = fork();
+	if(pid < 0)
+	{
+		close(fds[0]);
+		close(fds[1]);
+		return false;
+	}
+	if(pid == 0)
+	{
+		close(fds[0]);
+		RunBranch(fds[1], id, inputs, reads);
+	}
+
+	close(fds[1]);
+	Child child;
+	child.id = id;
+	child.pid = pid;
+	child.fd = fds[0];
+	live.push_back(child);
+	return true;
+#endif
+}
+
+bool FCEUBranchPool::collect(FCEUBranchResult &result, bool wait)
+{
+	if(finished.empty() && !reap(wait))
+		return false;
+
+	result = finished.front();
+	finished.pop_front();
+	return true;
+}
+
+//reads the report of a branch that's done, or closed its pipe trying. false if none is
+bool FCEUBranchPool::reap(bool wait)
+{
+#ifdef WIN32
+	return false;
+#else
+	if(live.empty())
+		return false;
+
+	std::vector<pollfd> fds(live.size());
+	for(size_t i = 0; i < live.size(); i++)
+	{
+		fds[i].fd = live[i].fd;
+		fds[i].events = POLLIN;
+		fds[i].revents = 0;
+	}
+
+	int ready;
+	do
+		ready = poll(&fds[0], fds.size(), wait ? -1 : 0);
+	while(ready < 0 && errno == EINTR);
+	if(ready <= 0)
+		return false;
+
+	size_t k = 0;
+	while(!fds[k].revents)
+		k++;
+	Child child = live[k];
+	live.erase(live.begin() + k);
+
+	//the child writes its report in one go once it's done, so this reads until it exits
+	std::vector<uint8> report;
+	uint8 buf[4096];
+	for(;;)
+	{
+		ssize_t n = read(child.fd, buf, sizeof(buf));
+		if(n < 0 && errno == EINTR)
+			continue;
+		if(n <= 0)
+			break;
+		report.insert(report.end(), buf, buf + n);
+	}
+	close(child.fd);
+
+	int status = 0;
+	waitpid(child.pid, &status, 0);
+
+	FCEUBranchResult result;
+	result.id = child.id;
+	if(WIFEXITED(status) && WEXITSTATUS(status) == 0
+		&& report.size() >= BRANCH_REPORT_HEADER
+		&& report.size() == BRANCH_REPORT_HEADER + FCEU_de32lsb(&report[24]))
+	{
+		result.ok = true;
+		result.frames = FCEU_de32lsb(&report[4]);
+		result.ramHash = Get64(&report[8]);
+		result.frameHash = Get64(&report[16]);
+		result.reads.assign(report.begin() + BRANCH_REPORT_HEADER, report.end());
+	}
+	finished.push_back(result);
+	return true;
+#endif
+}
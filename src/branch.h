@@ -0,0 +1,68 @@
+#ifndef _BRANCH_H_
+#define _BRANCH_H_
+
+#include "types.h"
+
+#include <deque>
+#include <vector>
+
+//Input branching, for tools that try many input sequences from one point in a game.
+//
+//Each branch is a child process forked at the current frame. It starts with the whole machine as
+//it is, sharing this process's memory copy-on-write until it changes it, so no savestate is
+//written or loaded. The child plays its inputs, sends back what it was asked to measure over a
+//pipe and exits. POSIX only (spawn() fails on Windows), and meant for a headless process: fork()
+//takes only the calling thread along, so spawn from the emulation thread while no other thread
+//holds a lock the child could need.
+
+struct FCEUBranchResult
+{
+	uint32 id;
+	bool ok;                  //false if the child died before reporting
+	uint32 frames;            //frames emulated
+	uint64 ramHash;           //FNV-1a of the 2KB of work RAM after the last frame
+	uint64 frameHash;         //FNV-1a of the last frame's picture
+	std::vector<uint8> reads; //the requested CPU addresses after the last frame
+
+	FCEUBranchResult() : id(0), ok(false), frames(0), ramHash(0), frameHash(0) {}
+};
+
+class FCEUBranchPool
+{
+public:
+	//maxLive: branches running at once. spawning another first waits for one to finish
+	explicit FCEUBranchPool(int maxLive = 8);
+	~FCEUBranchPool(); //kills the branches still running, their results are lost
+
+	void setMaxLive(int maxLive);
+	int getLive() const { return (int)live.size(); }
+
+	//forks a branch that plays inputs, one per frame. each packs the four gamepads a byte apiece,
+	//pad 1 in the low byte, as drivers hand them to FCEUI_SetInput; both ports become gamepads.
+	//reads: CPU addresses to report, read the way the debugger does, without side effects.
+	//fails if no game is loaded, a movie or netplay is active, or the fork does
+	bool spawn(uint32 id, const std::vector<uint32> &inputs, const std::vector<uint16> &reads);
+
+	//takes the result of a finished branch, in the order they finish. if none has yet, waits for
+	//one when wait is set. false if there's none to take
+	bool collect(FCEUBranchResult &result, bool wait);
+
+private:
+	struct Child
+	{
+		uint32 id;
+		int pid;
+		int fd;   //the read end of its pipe
+	};
+
+	bool reap(bool wait);
+
+	int maxLive;
+	std::vector<Child> live;
+	std::deque<FCEUBranchResult> finished;
+
+	FCEUBranchPool(const FCEUBranchPool &);
+	FCEUBranchPool &operator=(const FCEUBranchPool &);
+};
+
+#endif
@@ -30,6 +30,7 @@
 #include "x6502.h"
 
 #include "file.h"
+#include "statedigest.h"
 #include "utils/memory.h"
 
 
@@ -121,6 +122,8 @@ void SetupCartPRGMapping(int chip, uint8 *p, uint32 size, int ram) {
 	PRGmask32[chip] = (size >> 15) - 1;
 
 	PRGram[chip] = ram ? 1 : 0;
+	if (ram)
+		FCEUSS_TrackWrites(p, size);
 }
 
 void SetupCartCHRMapping(int chip, uint8 *p, uint32 size, int ram) {
@@ -138,6 +141,8 @@ void SetupCartCHRMapping(int chip, uint8 *p, uint32 size, int ram) {
 	if (CHRmask8[chip] >= (unsigned int)(-1)) CHRmask8[chip] = 0;
 
 	CHRram[chip] = ram;
+	if (ram)
+		FCEUSS_TrackWrites(p, size);
 }
 
 DECLFR(CartBR) {
@@ -146,8 +151,10 @@ DECLFR(CartBR) {
 
 DECLFW(CartBW) {
 	//printf("Ok: %04x:%02x, %d\n",A,V,PRGIsRAM[A>>11]);
-	if (PRGIsRAM[A >> 11] && Page[A >> 11])
+	if (PRGIsRAM[A >> 11] && Page[A >> 11]) {
 		Page[A >> 11][A] = V;
+		FCEUSS_MarkWritten(&Page[A >> 11][A]);
+	}
 }
 
 DECLFR(CartBROB) {
@@ -536,8 +543,12 @@ void FCEU_GeniePower(void) {
 }
 
 
+// set by runs that replay for someone else's sake (movie verification, branch search): the
+// battery-backed RAM they end up with isn't the player's, and mustn't overwrite their save
+int disableBatterySaving = 0;
+
 void FCEU_SaveGameSave(CartInfo *LocalHWInfo) {
-	if (LocalHWInfo->battery && LocalHWInfo->SaveGame[0]) {
+	if (LocalHWInfo->battery && LocalHWInfo->SaveGame[0] && !disableBatterySaving) {
 		FILE *sp;
 
 		std::string soot = FCEU_MakeFName(FCEUMKF_SAV, 0, "sav");
@@ -577,8 +588,10 @@ void FCEU_LoadGameSave(CartInfo *LocalHWInfo) {
 void FCEU_ClearGameSave(CartInfo *LocalHWInfo) {
 	if (LocalHWInfo->battery && LocalHWInfo->SaveGame[0]) {
 		for (int x = 0; x < 4; x++)
-			if (LocalHWInfo->SaveGame[x])
+			if (LocalHWInfo->SaveGame[x]) {
 				memset(LocalHWInfo->SaveGame[x], 0, LocalHWInfo->SaveGameLen[x]);
+				FCEUSS_MarkWritten(LocalHWInfo->SaveGame[x], LocalHWInfo->SaveGameLen[x]);
+			}
 	}
 }
 
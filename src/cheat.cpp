@@ -25,6 +25,7 @@
 #include "fceu.h"
 #include "file.h"
 #include "cart.h"
+#include "statedigest.h"
 #include "driver.h"
 #include "utils/memory.h"
 
@@ -441,7 +442,13 @@ void FCEU_ApplyPeriodicCheats(void)
 	{
 		if(cur->status && !(cur->type))
 			if(CheatRPtrs[cur->addr>>10])
+			{
 				CheatRPtrs[cur->addr>>10][cur->addr]=cur->val;
+				if(cur->addr<0x800)
+					RAMDirty|=1<<(cur->addr>>8);
+				else
+					FCEUSS_MarkWritten(&CheatRPtrs[cur->addr>>10][cur->addr]);
+			}
 		if(cur->next)
 			cur=cur->next;
 		else
@@ -879,7 +886,13 @@ int FCEU_CheatGetByte(uint32 A)
 void FCEU_CheatSetByte(uint32 A, uint8 V)
 {
    if(CheatRPtrs[A>>10])
+   {
     CheatRPtrs[A>>10][A]=V;
+    if(A<0x800)
+     RAMDirty|=1<<(A>>8);
+    else
+     FCEUSS_MarkWritten(&CheatRPtrs[A>>10][A]);
+   }
    else if(A < 0x10000)
     BWrite[A](A, V);
 }
@@ -79,6 +79,50 @@ bool FCEUI_GetInputMicrophone();
 
 void FCEUI_UseInputPreset(int preset);
 
+//Late input polling: instead of fixing the controller state at the start of each frame, wait for
+//the game's first $4016/$4017 access in the frame and call FCEUD_UpdateInputLate() right before it.
+//Movies being recorded and netplay still see the state the game read. Off during movie playback,
+//TAS Editor and netplay, which need the input settled at the frame boundary, and while a light
+//gun is attached, since the picture is checked against its aim as the frame is drawn. Off by default.
+void FCEUI_SetLateInputPoll(bool enable);
+bool FCEUI_GetLateInputPoll(void);
+
+//called by the core (only with late input polling) when the game is about to read its controllers.
+//it happens in the middle of a frame, so the driver should only refresh the state of the devices
+//it handed to FCEUI_SetInput/FCEUI_SetInputFC: no hotkeys, no other FCEUI_* calls.
+void FCEUD_UpdateInputLate(void);
+
+//Latency measurement: follows controller changes from the host to the screen and reports how long
+//each stage took (see latency.h). period > 0 scripts the input instead: buttons on pad 1 are pressed
+//and released every period frames, for runs without a player. FCEUI_LatencyStop() writes the
+//report to reportPath, or prints it if that is NULL.
+void FCEUI_LatencyStart(int period = 0, uint8 buttons = 0);
+bool FCEUI_LatencyStop(const char *reportPath);
+bool FCEUI_LatencyActive(void);
+//the driver calls these while measuring: after it read the host's input devices,
+//and after it presented a frame
+void FCEUI_LatencyInputPolled(void);
+void FCEUI_LatencyPresented(void);
+//The same without a window: runs rom for as long as an input script lasts, pad 1 holding what it
+//says, and writes the report. The script has a line per change, "<frame> <buttons>", in FM2's
+//letters (RLDUTSBA, in any order), nothing for released; # starts a comment. Scripted input never
+//reaches a movie being recorded or netplay: neither runs with a script. Returns false if the ROM
+//or the script can't be read or the report written.
+bool FCEUI_MeasureLatencyScript(const char *rom, const char *script, const char *report);
+
+//Frame-phase timing (see perftrace.h): while on, the frame loop's phases are timed into per-thread
+//ring buffers. FCEUI_GetPerfCounters() sums up frames, instructions, CPU cycles and per-phase
+//time histograms since tracing was turned on or last reset. FCEUI_ExportPerfTrace() writes
+//what the ring buffers still hold as Chrome trace-event JSON.
+struct FCEUPerfCounters;
+void FCEUI_SetPerfTrace(bool enable);
+bool FCEUI_GetPerfTrace(void);
+void FCEUI_ResetPerfCounters(void);
+void FCEUI_GetPerfCounters(FCEUPerfCounters *out);
+bool FCEUI_ExportPerfTrace(const char *path);
+//names the calling thread in exported traces
+void FCEUI_SetPerfThreadName(const char *name);
+
 
 //New interface functions
 
@@ -105,6 +149,10 @@ bool FCEUI_Initialize();
 //Emulates a frame.
 void FCEUI_Emulate(uint8 **, int32 **, int32 *, int);
 
+//Emulates a frame without presenting it or synthesizing its sound, for max-speed turbo.
+//Returns false, without emulating, while emulation is paused.
+bool FCEUI_EmulateHidden(void);
+
 //Closes currently loaded game
 void FCEUI_CloseGame(void);
 
@@ -135,6 +183,53 @@ void FCEUI_FrameSkip(int x);
 //First and last scanlines to render, for ntsc and pal emulation.
 void FCEUI_SetRenderedLines(int ntscf, int ntscl, int palf, int pall);
 
+//Pipelined presentation: before each FCEUI_Emulate(), the driver may supply 256x256 buffers for
+//the frame's palette indices (with overlays) and deemphasis bits, which become XBuf and XDBuf:
+//the frame is rendered straight into them. FCEUI_Emulate() then returns that buffer, and the
+//driver may present it on another thread while the next frame is emulated in another one. It
+//mustn't write to them itself. Pass NULLs to go back to the core's own buffers.
+void FCEUI_SetPresentationBuffer(uint8 *pixels, uint8 *deemph);
+
+//Run-ahead: after each frame, emulates this many more with the same input, presents the last of
+//them and rolls the machine back. Takes that many frames off the game's own input lag, at the
+//cost of emulating them every frame. 0 (the default) turns it off; at most 4. Games with
+//expansion sound go without.
+void FCEUI_SetRunAhead(int frames);
+int FCEUI_GetRunAhead(void);
+
+//Rewind: keeps a snapshot every `frames` frames in memory, delta-compressed, in at most budgetMB
+//megabytes (the oldest go first). While rewinding is held, each emulated frame starts from the
+//previous snapshot instead, with its sound muted. Off during movies and netplay.
+void FCEUI_SetRewind(bool enable, int frames, int budgetMB);
+bool FCEUI_GetRewind(void);
+void FCEUI_SetRewinding(bool on);
+
+//Suspend/resume: closing a game (or quitting) leaves a resume state, loaded in place of power-on the
+//next time this build opens the same ROM. While playing it's also refreshed every intervalSeconds
+//(0: only on close), so a crash loses no more than that.
+void FCEUI_SetAutoResume(bool enable, int intervalSeconds);
+//true if the game being played was restored from its resume state
+bool FCEUI_GameResumed(void);
+
+//Records a digest of the machine's state with every frame of the text movies recorded from now on.
+//Playback checks the digests a movie has, and reports the first frame, and the part of the
+//machine, where the replay stops matching. Off by default; movies with digests grow by a line
+//a frame.
+void FCEUI_SetMovieStateDigests(bool record);
+
+//Movie keyframes: while a movie plays, a snapshot is kept every interval frames (more thinly once
+//they outgrow budgetMB), so FCEUI_MovieSeek() can start from the nearest one instead of from
+//power-on. With sidecar set they're also kept in a file beside the movie, for its next replay.
+void FCEUI_SetMovieKeyframes(bool enable, int interval, int budgetMB, bool sidecar);
+
+//Batch movie verification: replays the movies a JSON manifest lists against their ROMs, on processes
+//worker processes (0: one per core), checks the frame hashes it expects and writes a JSON report
+//(see batchverify.h). Returns how many movies didn't pass, or -1 if the manifest couldn't be read
+//or the report written.
+int FCEUI_VerifyMovies(const char *manifest, const char *report, int processes);
+//the worker's side, for a process the driver was started as with -verifyworker (Windows)
+int FCEUI_VerifyWorker(const char *manifest, const char *shared, int id);
+
 //Sets the base directory(save states, snapshots, etc. are saved in directories below this directory.
 void FCEUI_SetBaseDirectory(std::string const & dir);
 const char *FCEUI_GetBaseDirectory(void);
@@ -155,6 +250,10 @@ void FCEUI_SetPCMVolume(uint32 volume);
 
 void FCEUI_SetSoundQuality(int quality);
 
+//Fine-tunes how many samples are produced per emulated frame (1.0 = nominal), for dynamic
+//rate control. Only the high quality (soundq>=1) resampler honors it.
+void FCEUI_SetSoundResampleRatio(double ratio);
+
 void FCEUD_SoundToggle(void);
 void FCEUD_SoundVolumeAdjust(int);
 
@@ -175,6 +274,8 @@ void FCEUD_SetInput(bool fourscore, bool microphone, ESI port0, ESI port1, ESIFC
 
 void FCEUD_MovieRecordTo(void);
 void FCEUD_MovieReplayFrom(void);
+//asks for a frame of the movie playing and seeks to it (FCEUI_MovieSeek()) before the next frame
+void FCEUD_MovieSeekTo(void);
 void FCEUD_LuaRunFrom(void);
 
 int32 FCEUI_GetDesiredFPS(void);
@@ -331,6 +432,10 @@ bool FCEUD_PauseAfterPlayback();
 ///called when fceu changes something in the video system you might be interested in
 void FCEUD_VideoChanged();
 
+///high resolution timer of the driver, FCEUD_GetTimeFreq() ticks per second
+uint64 FCEUD_GetTime(void);
+uint64 FCEUD_GetTimeFreq(void);
+
 enum EFCEUI
 {
 	FCEUI_STOPAVI, FCEUI_QUICKSAVE, FCEUI_QUICKLOAD, FCEUI_SAVESTATE, FCEUI_LOADSTATE,
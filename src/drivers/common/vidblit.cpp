@@ -38,6 +38,19 @@ extern pal *palo;
 
 #include "../../ppu.h"  // for PPU[]
 
+//frame the blitters read from, see SetBlitSource()
+static u8 const *blitsrc = NULL;
+static u8 const *blitdeemph = NULL;
+
+static inline u8 const *BlitSrc() { return blitsrc ? blitsrc : XBuf; }
+static inline u8 const *BlitDeemph() { return blitdeemph ? blitdeemph : XDBuf; }
+
+void SetBlitSource(u8 const *pixels, u8 const *deemph)
+{
+	blitsrc = pixels;
+	blitdeemph = deemph;
+}
+
 nes_ntsc_t* nes_ntsc;
 uint8 burst_phase = 0;
 
@@ -466,7 +479,7 @@ void Blit8To8(uint8 const *src, uint8 *dest, int xr, int yr, int pitch, int xsca
 /* Todo:  Make sure 24bpp code works right with big-endian cpus */
 
 //takes a pointer to XBuf and applies fully modern deemph palettizing
-u32 ModernDeemphColorMap(u8 const * src, u8* srcbuf, int xscale, int yscale)
+u32 ModernDeemphColorMap(u8 const * src, u8 const * srcbuf, int xscale, int yscale)
 {
 	u8 pixel = *src;
 	
@@ -481,7 +494,7 @@ u32 ModernDeemphColorMap(u8 const * src, u8* srcbuf, int xscale, int yscale)
 	ofs = xofs+yofs*256;
 
 	//find out which deemph bitplane value we're on
-	uint8 deemph = XDBuf[ofs];
+	uint8 deemph = BlitDeemph()[ofs];
 
 	//if it was a deemph'd value, grab it from the deemph palette
 	if(deemph != 0)
@@ -581,7 +594,7 @@ void Blit8ToHigh(uint8 const *src, uint8 *dest, int xr, int yr, int pitch, int x
 		{
 			for(x=xr; x; x--)
 			{
-				*(uint32 *)dest = ModernDeemphColorMap(src,XBuf,1,1);
+				*(uint32 *)dest = ModernDeemphColorMap(src,BlitSrc(),1,1);
 				dest += 4;
 				src++;
 			}
@@ -707,16 +720,16 @@ void Blit8ToHigh(uint8 const *src, uint8 *dest, int xr, int yr, int pitch, int x
 			{
 				for (x=0; x<xr; x++)
 				{
-					ofs = src-XBuf;                  //find out which deemph bitplane value we're on
-					deemph = XDBuf[ofs];
+					ofs = src-BlitSrc();             //find out which deemph bitplane value we're on
+					deemph = BlitDeemph()[ofs];
 					int temp = *src;
 					index = (*src&63) | (deemph*64); //get combined index from basic value and preemph bitplane
 					index += 256;
 
 					src++;
 					
-					ofs = src-XBuf;
-					deemph = XDBuf[ofs];
+					ofs = src-BlitSrc();
+					deemph = BlitDeemph()[ofs];
 					newindex = (*src&63) | (deemph*64);
 					newindex += 256;
 
@@ -817,7 +830,7 @@ void Blit8ToHigh(uint8 const *src, uint8 *dest, int xr, int yr, int pitch, int x
 					//if(xr == 282) outxr = 282; //hack for windows
 					burst_phase ^= 1;
 
-					u8* srcD = XDBuf + (src-XBuf); // get deemphasis buffer
+					u8 const* srcD = BlitDeemph() + (src-BlitSrc()); // get deemphasis buffer
 					nes_ntsc_blit( nes_ntsc, (unsigned char*)src, (unsigned char*)srcD, xr, burst_phase, xr, yr, ntscblit, (2*outxr) * Bpp );
 
 					const uint8 *in = ntscblit + (Bpp * xscale);
@@ -919,7 +932,7 @@ void Blit8ToHigh(uint8 const *src, uint8 *dest, int xr, int yr, int pitch, int x
 					for(x=xr;x;x--)
 					{
 						//THE MAIN BLITTING CODEPATH (there may be others that are important)
-						*(uint32 *)dest = ModernDeemphColorMap(src,XBuf,1,1);
+						*(uint32 *)dest = ModernDeemphColorMap(src,BlitSrc(),1,1);
 						dest+=4;
 						src++;
 					}
@@ -932,7 +945,7 @@ void Blit8ToHigh(uint8 const *src, uint8 *dest, int xr, int yr, int pitch, int x
 				{
 					for(x=xr;x;x--)
 					{     
-						uint32 tmp = ModernDeemphColorMap(src,XBuf,1,1);
+						uint32 tmp = ModernDeemphColorMap(src,BlitSrc(),1,1);
 						*(uint8 *)dest=tmp;
 						*((uint8 *)dest+1)=tmp>>8;
 						*((uint8 *)dest+2)=tmp>>16;
@@ -948,7 +961,7 @@ void Blit8ToHigh(uint8 const *src, uint8 *dest, int xr, int yr, int pitch, int x
 				{
 					for(x=xr;x;x--)
 					{
-						*(uint16 *)dest = ModernDeemphColorMap(src,XBuf,1,1);
+						*(uint16 *)dest = ModernDeemphColorMap(src,BlitSrc(),1,1);
 						dest+=2;
 						src++;
 					}
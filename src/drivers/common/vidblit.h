@@ -29,4 +29,8 @@ void Blit32to16(uint32 *src, uint16 *dest, int xr, int yr, int dpitch,
         int shiftr[3], int shiftl[3]);
 
 
-u32 ModernDeemphColorMap(u8 const * src, u8* srcbuf, int xscale, int yscale);
\ No newline at end of file
+u32 ModernDeemphColorMap(u8 const * src, u8 const * srcbuf, int xscale, int yscale);
+
+//the 256x256 frame (palette indices and deemphasis bits) that the src pointers passed to the
+//blitters point into. NULLs mean XBuf/XDBuf; a presentation thread passes its own copy
+void SetBlitSource(u8 const *pixels, u8 const *deemph);
\ No newline at end of file
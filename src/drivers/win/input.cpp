@@ -444,7 +444,8 @@ void UpdateRawInputAndHotkeys()
 	HandleHotkeys();
 }
 
-void FCEUD_UpdateInput()
+//fills the buffers handed to the core with the state of the emulated devices
+static void UpdateEmulatedDevices()
 {
 	bool joy=false;
 	bool mouse=false;
@@ -453,8 +454,6 @@ void FCEUD_UpdateInput()
 	//aquanull: if we are ok with getting real input even when emulation is paused, why should we bother skipping it when playing a movie?
 	bool skipRealInput = (FCEUMOV_Mode() == MOVIEMODE_PLAY && currFrameCounter < (int)currMovieData.records.size());
 
-	UpdateRawInputAndHotkeys();
-
 	if (!skipRealInput) //FatRatKnight: Moved this if out of the function, a more concise fix may be desired.
 	{
 		for(int x=0;x<2;x++)
@@ -511,6 +510,27 @@ void FCEUD_UpdateInput()
 	}
 }
 
+void FCEUD_UpdateInput()
+{
+	UpdateRawInputAndHotkeys();
+	UpdateEmulatedDevices();
+	FCEUI_LatencyInputPolled();
+}
+
+//late input polling: the game is about to read its controllers, so sample them again.
+//hotkeys and key repeat stay on the once-per-frame FCEUD_UpdateInput().
+void FCEUD_UpdateInputLate()
+{
+	//auto-hold is being edited from the per-frame state; leave it alone until then
+	if(autoHoldOn || autoHoldReset)
+		return;
+
+	KeyboardUpdateHeld();
+	UpdateJoysticks();
+	UpdateEmulatedDevices();
+	FCEUI_LatencyInputPolled();
+}
+
 void FCEUD_SetInput(bool fourscore, bool microphone, ESI port0, ESI port1, ESIFC fcexp)
 {
 	eoptions &= ~EO_FOURSCORE;
@@ -1675,7 +1695,7 @@ int FCEUD_TestCommandState(int c)
 		//		else
 		//			keys_nr=GetKeyboard_nr();
 	}
-	else if(c != EMUCMD_SPEED_TURBO) // TODO: this should be made more general by detecting if the command has an "off" function
+	else if(c != EMUCMD_SPEED_TURBO && c != EMUCMD_MISC_REWIND) // TODO: this should be made more general by detecting if the command has an "off" function
 	{
 		keys=GetKeyboard_jd();
 		keys_nr=GetKeyboard_nr(); 
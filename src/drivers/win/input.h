@@ -69,6 +69,7 @@ void ParseGIInput(FCEUGI *GameInfo);
 void SetEmulationSpeed(int type);
 int FCEUD_TestCommandState(int c);
 void FCEUD_UpdateInput();
+void FCEUD_UpdateInputLate();
 
 extern CFGSTRUCT HotkeyConfig[];
 
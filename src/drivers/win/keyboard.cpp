@@ -119,6 +119,25 @@ void KeyboardUpdateState(void)
 	autoHoldReset = autoHoldClearKey && keys[autoHoldClearKey] != 0;
 }
 
+//refreshes which keys are held without advancing the repeat and just-down counters,
+//so the emulated controllers can be sampled again in the middle of a frame
+void KeyboardUpdateHeld(void)
+{
+	unsigned char tk[256];
+
+	if(IDirectInputDevice7_GetDeviceState(lpdid,256,tk) != DI_OK)
+		return;
+	tk[0] = 0;
+	if(GetAsyncKeyState(VK_PAUSE))
+		tk[0xC5] = 0x80;
+
+	for(int i = 0 ; i < 256 ; i++)
+		if(!tk[i])
+			keys_nr[i] = 0;
+		else if(!keys_nr[i])
+			keys_nr[i] = 1;
+}
+
 unsigned int *GetKeyboard(void)
 {
 	return(keys);
@@ -1,6 +1,7 @@
 void KeyboardClose(void);
 int KeyboardInitialize(void);
 void KeyboardUpdate(void);
+void KeyboardUpdateHeld(void);
 unsigned int *GetKeyboard(void);
 unsigned int *GetKeyboard_nr(void);
 unsigned int *GetKeyboard_jd(void);
@@ -47,6 +47,8 @@ extern "C" { FILE __iob_func[3] = { *stdin,*stdout,*stderr }; }
 #include "../../state.h"
 #include "../../debug.h"
 #include "../../movie.h"
+#include "../../perftrace.h"
+#include "../../audio.h"
 
 #include "archive.h"
 #include "input.h"
@@ -65,6 +67,9 @@ extern "C" { FILE __iob_func[3] = { *stdin,*stdout,*stderr }; }
 #include "sound.h"
 #include "wave.h"
 #include "video.h"
+#include "quality.h"
+#include "present.h"
+#include "Win32InputBox.h"
 #include "utils/xstring.h"
 
 #include "standalone_config.h"
@@ -125,6 +130,8 @@ int GetClientAbsRect(LPRECT lpRect);
 void UpdateFCEUWindow(void);
 void FCEUD_Update(uint8 *XBuf, int32 *Buffer, int Count);
 
+static uint64 frameStartTime = 0; //when the main loop started emulating the current frame
+
 // Internal variables
 int frameSkipAmt = 18;
 uint8 *xbsave = NULL;
@@ -203,6 +210,9 @@ int erendlinep = 239;
 //mbg 6/30/06 - indicates that the main loop should close the game as soon as it can
 bool closeGame = false;
 
+//running without a window, for movie verification
+static bool headless = false;
+
 // Counts the number of frames that have not been displayed.
 // Used for the bot, to skip frames (makes things faster).
 int BotFramesSkipped = 0;
@@ -550,6 +560,13 @@ void FCEUD_PrintError(const char *errormsg)
 {
 	AddLogText(errormsg, 1);
 
+	//nobody's there to close a message box
+	if (headless)
+	{
+		fprintf(stderr, "%s\n", errormsg);
+		return;
+	}
+
 	if (fullscreen && (eoptions & EO_HIDEMOUSE))
 		ShowCursorAbs(1);
 
@@ -632,6 +649,9 @@ static void DriverKill(void)
 	//sprintf(TempArray, "%s/%s", BaseDirectory.c_str(),cfgFile.c_str());
 	//SaveConfig(TempArray);
 
+	RestoreQualitySettings();
+	StopPresentationThread();
+
 	DestroyInput();
 
 	ResetVideo();
@@ -724,6 +744,119 @@ static BOOL CALLBACK EnumCallbackFCEUXInstantiated(HWND hWnd, LPARAM lParam)
 	return true;
 }
 
+//Max-speed turbo. Between two shown frames, as many hidden ones are emulated as fit in a display
+//refresh, and the speed reached is shown about once a second. The shown frame has to be emulated
+//and blitted in the same refresh, or the next vblank is missed and only every other one is used,
+//so the hidden ones leave it the time it took last, and a quarter of the refresh for the blit.
+static uint64 turboReportTime = 0;
+static int turboReportFrames = 0;
+static uint64 turboShownTicks = 0; //how long FCEUI_Emulate() took for the last shown frame
+
+//AVI capture and TAS Editor need to see every frame
+static bool MaxSpeedTurbo()
+{
+	return active_config->max_speed_turbo
+		&& !FCEUI_AviIsRecording()
+		&& !FCEUMOV_Mode(MOVIEMODE_TASEDITOR);
+}
+
+static void EmulateHiddenTurboFrames()
+{
+	uint64 freq = FCEUD_GetTimeFreq();
+	uint64 now = FCEUD_GetTime();
+
+	//turbo just started, or something stalled us
+	if (!turboReportTime || now - turboReportTime > 2 * freq)
+	{
+		turboReportTime = now;
+		turboReportFrames = 0;
+	}
+	else if (now - turboReportTime >= freq)
+	{
+		double fps = turboReportFrames * (double)freq / (now - turboReportTime);
+		FCEU_DispMessage("Turbo: %.1fx", 0, fps * 16777216.0 / FCEUI_GetDesiredFPS());
+		turboReportTime = now;
+		turboReportFrames = 0;
+	}
+
+	int refresh = FCEUD_GetDisplayRefreshRate();
+	uint64 period = freq / (refresh > 0 ? refresh : 60);
+	uint64 reserved = turboShownTicks + period / 4;
+	uint64 until = now + (reserved < period ? period - reserved : 0);
+
+	turboReportFrames++; //the shown one
+	while (!closeGame && FCEUD_GetTime() < until && FCEUI_EmulateHidden())
+		turboReportFrames++;
+}
+
+//The frame the Seek Movie command asked for, -1 if none. The seek is carried out between frames,
+//since the command may come from a hotkey polled while the debugger holds one.
+static int movieSeekTarget = -1;
+
+void FCEUD_MovieSeekTo(void)
+{
+	if (!FCEUMOV_Mode(MOVIEMODE_PLAY|MOVIEMODE_RECORD|MOVIEMODE_FINISHED))
+	{
+		FCEU_DispMessage("No movie to seek in.", 0);
+		return;
+	}
+
+	int frame = FCEUMOV_GetFrame();
+	if (CWin32InputBox::GetInteger("Seek Movie", "Frame to seek to:", frame, hAppWnd) == IDOK)
+		movieSeekTarget = frame;
+}
+
+static void SeekMovie()
+{
+	int frame = movieSeekTarget;
+	movieSeekTarget = -1;
+	if (FCEUI_MovieSeek(frame))
+		FCEU_DispMessage("Movie at frame %d.", 0, frame);
+	else
+		FCEU_DispMessage("Couldn't seek the movie to frame %d.", 0, frame);
+}
+
+//Movie verification without a window, for regression testing a build (see batchverify.h):
+//  -verify <manifest> <report> [processes]
+//or one of the workers the runner starts, with -verifyworker. Exits with 0 if every movie passed.
+//Also latency measurement from an input script (see FCEUI_MeasureLatencyScript()):
+//  -latency <rom> <script> <report>
+static int RunVerification(int argc, char *argv[])
+{
+	headless = true;
+	if (!strcmp(argv[1], "-latency"))
+	{
+		if (argc < 5)
+		{
+			fprintf(stderr, "usage: %s -latency <rom> <script> <report>\n", argv[0]);
+			return 2;
+		}
+		if (!FCEUI_Initialize())
+			return 1;
+		GetBaseDirectory();
+		SetDirs();
+		ParseGIInput(NULL);
+		return FCEUI_MeasureLatencyScript(argv[2], argv[3], argv[4]) ? 0 : 1;
+	}
+
+	bool worker = !strcmp(argv[1], "-verifyworker");
+	if (argc < (worker ? 5 : 4))
+	{
+		fprintf(stderr, "usage: %s -verify <manifest> <report> [processes]\n", argv[0]);
+		return 2;
+	}
+
+	if (!worker)
+		return FCEUI_VerifyMovies(argv[2], argv[3], argc > 4 ? atoi(argv[4]) : 0) == 0 ? 0 : 1;
+
+	if (!FCEUI_Initialize())
+		return 1;
+	GetBaseDirectory();
+	SetDirs();
+	ParseGIInput(NULL);
+	return FCEUI_VerifyWorker(argv[2], argv[3], atoi(argv[4]));
+}
+
 #include "x6502.h"
 int main(int argc,char *argv[])
 {
@@ -742,6 +875,9 @@ int main(int argc,char *argv[])
 #endif
 	}
 
+	if (argc >= 2 && (!strcmp(argv[1], "-verify") || !strcmp(argv[1], "-verifyworker") || !strcmp(argv[1], "-latency")))
+		return RunVerification(argc, argv);
+
 	SetThreadAffinityMask(GetCurrentThread(),1);
 
     // Load default and user standalone configuration files.
@@ -782,6 +918,25 @@ int main(int argc,char *argv[])
 			// Disable the sprite limit:
 			eoptions |= EO_NOSPRLIM;
 		}
+
+		// Frames of run-ahead, 0 for none:
+		FCEUI_SetRunAhead(active_config->run_ahead_frames);
+
+		// Poll input at the game's first controller read instead of at the start of the frame:
+		FCEUI_SetLateInputPoll(active_config->late_input_poll);
+
+		// Keep a delta-compressed history of snapshots to rewind through while the rewind hotkey is held:
+		FCEUI_SetRewind(active_config->rewind, active_config->rewind_interval, active_config->rewind_budget_mb);
+
+		// Suspend to a resume state on exit (and every so often), and restore it on the next launch:
+		FCEUI_SetAutoResume(active_config->resume_session, active_config->resume_save_interval_s);
+
+		// Record a state digest with every movie frame, so playback can point at the first desync:
+		FCEUI_SetMovieStateDigests(active_config->movie_state_digests);
+
+		// Keep snapshots through the movie being played, so seeking in it doesn't replay it from the start:
+		FCEUI_SetMovieKeyframes(active_config->movie_keyframes, active_config->movie_keyframe_interval,
+			active_config->movie_keyframe_budget_mb, active_config->movie_keyframe_sidecar);
 	}
 
     if (active_config->show_splash_screen)
@@ -877,6 +1032,10 @@ int main(int argc,char *argv[])
 	//if (rom_file)
 	//{
 		ALoad(rom_file_path.c_str());
+
+		//a returning player goes straight back to where they left off
+		if (FCEUI_GameResumed())
+			splash_screen.Close();
 	//} else
 	//{
 	//	if (AutoResumePlay && romNameWhenClosingEmulator && romNameWhenClosingEmulator[0])
@@ -929,17 +1088,46 @@ int main(int argc,char *argv[])
 	if (PauseAfterLoad) FCEUI_ToggleEmulationPause();
 	SetAutoFirePattern(AFon, AFoff);
 	UpdateCheckedMenuItems();
+
+	// Time controller changes from the host to the screen, reported on exit:
+	if (active_config->measure_latency)
+		FCEUI_LatencyStart();
+
+	// Time the phases of each frame, exported as a trace on exit:
+	if (active_config->perf_trace)
+	{
+		FCEUI_SetPerfThreadName("emulation");
+		FCEUI_SetPerfTrace(true);
+	}
+
+	// Keep the last minute of audio statistics, frame by frame, written out on exit:
+	if (active_config->audio_log)
+	{
+		FCEUI_ResetAudioStats();
+		FCEUI_SetAudioLogSize(60 * 60);
+	}
 doloopy:
 	UpdateFCEUWindow();
 	if(GameInfo)
 	{
+		if (active_config->pipelined_presentation)
+			StartPresentationThread();
+
 		while(GameInfo)
 		{
 	        uint8 *gfx=0; ///contains framebuffer
 			int32 *sound=0; ///contains sound data buffer
 			int32 ssize=0; ///contains sound samples count
 
-			if (turbo)
+			if (movieSeekTarget >= 0)
+				SeekMovie();
+
+			if (turbo && MaxSpeedTurbo())
+			{
+				EmulateHiddenTurboFrames();
+				skippy = 0;
+			}
+			else if (turbo)
 			{
 				if (!frameSkipCounter)
 				{
@@ -956,7 +1144,13 @@ doloopy:
 			}
 			else skippy = 0;
 
+			if (!turbo)
+				turboReportTime = 0;
+
+            frameStartTime = FCEUD_GetTime();
+            BeginPresentedFrame();
             FCEUI_Emulate(&gfx, &sound, &ssize, skippy); //emulate a single frame
+            turboShownTicks = FCEUD_GetTime() - frameStartTime;
             FCEUD_Update(gfx, sound, ssize); //update displays and debug tools
 
             UpdateConfigMenu();
@@ -969,6 +1163,7 @@ doloopy:
 			}
 
 		}
+		StopPresentationThread();
 		//xbsave = NULL;
 		RedrawWindow(hAppWnd,0,0,RDW_ERASE|RDW_INVALIDATE);
 	}
@@ -978,6 +1173,18 @@ doloopy:
 	if(!exiting)
 		goto doloopy;
 
+	if (FCEUI_LatencyActive())
+		FCEUI_LatencyStop((BaseDirectory + "\\latency.txt").c_str());
+
+	if (FCEUI_GetPerfTrace())
+	{
+		FCEUI_SetPerfTrace(false);
+		FCEUI_ExportPerfTrace((BaseDirectory + "\\perftrace.json").c_str());
+	}
+
+	if (active_config->audio_log)
+		FCEUI_DumpAudioLog((BaseDirectory + "\\audiolog.csv").c_str());
+
 	DriverKill();
 	timeEndPeriod(1);
 	FCEUI_Kill();
@@ -1039,6 +1246,10 @@ void FCEUD_Update(uint8 *XBuf, int32 *Buffer, int Count)
         win_SoundWriteData(Buffer, Count); //If turboing and mute turbo is true, bypass this
     }
 
+    //when vsync is locked to the emulated rate, the blit paces us and the audio follows the display
+    bool displayPaced = !turbo && !FCEUI_EmulationPaused() && DisplayPaced();
+    win_SoundRateControl(soundo && displayPaced);
+
     if (splash_screen.IsShowing())
     {
         BlitImage(splash_screen.GetBytes(), splash_screen.GetByteCount());
@@ -1047,14 +1258,26 @@ void FCEUD_Update(uint8 *XBuf, int32 *Buffer, int Count)
     {
         splash_screen.Unload();
 
-        //blit the framebuffer
+        //blit the framebuffer, or let the presentation thread do it
         if (XBuf)
-            FCEUD_BlitScreen(XBuf);
+        {
+            if (PresentationPipelined())
+                SubmitPresentedFrame();
+            else
+                FCEUD_BlitScreen(XBuf);
+            FCEUI_LatencyPresented();
+        }
     }
 
     //update debugging displays
     _updateWindow();
 
+    //let the quality governor judge how long emulating and presenting took, not counting vsync waits
+    uint64 vsyncWait = FCEUD_TakeVSyncWaitTime();
+    double frameTime = (double)(FCEUD_GetTime() - frameStartTime - vsyncWait) / FCEUD_GetTimeFreq();
+    if (!turbo && !FCEUI_EmulationPaused() && fps_scale == 256)
+        UpdateQualityGovernor(frameTime);
+
     extern bool JustFrameAdvanced;
 
     //MBG TODO - think about this logic
@@ -1066,16 +1289,19 @@ void FCEUD_Update(uint8 *XBuf, int32 *Buffer, int Count)
         if (!soundo) throttle = false;
     }
 
-    if (throttle)  //if throttling is enabled..
+    if (throttle && !displayPaced)  //if throttling is enabled and the display isn't pacing us..
         if (!turbo) //and turbo is disabled..
             if (!FCEUI_EmulationPaused()
                 || JustFrameAdvanced
                 )
                 //then throttle
-                while (SpeedThrottle())
                 {
-                    FCEUD_UpdateInput();
-                    _updateWindow();
+                    PerfScope perf(PERF_THROTTLE);
+                    while (SpeedThrottle())
+                    {
+                        FCEUD_UpdateInput();
+                        _updateWindow();
+                    }
                 }
 
 
@@ -1104,6 +1330,12 @@ void FCEUD_Update(uint8 *XBuf, int32 *Buffer, int Count)
     //	FCEUD_DebugBreakpoint();
     //}
 
+    //with frame delay, the next frame's input is polled as late as its vblank allows
+    {
+        PerfScope perf(PERF_THROTTLE);
+        FrameDelayWait(displayPaced && active_config->frame_delay, frameTime);
+    }
+
     //make sure to update the input once per frame
     FCEUD_UpdateInput();
 }
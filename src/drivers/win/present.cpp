@@ -0,0 +1,102 @@
+/* FCE Ultra - NES/Famicom Emulator
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+//Pipelined presentation: the emulation thread renders frame N+1 while this thread converts,
+//scales and presents frame N.
+
+#include "common.h"
+#include "main.h"
+#include "video.h"
+#include "present.h"
+#include "../../fceu.h"
+#include "../../video.h"
+#include "../../framepipe.h"
+#include "../common/vidblit.h"
+
+#include <atomic>
+#include <thread>
+
+static FramePipeline *pipeline = NULL;
+static std::thread presenter;
+static std::atomic<bool> presenting(false);
+static uint32 submitted = 0;
+
+static void PresentLoop()
+{
+	FCEUI_SetPerfThreadName("presentation");
+
+	while(presenting.load())
+	{
+		FrameSlot *slot = pipeline->acquire(100);
+		if(!slot) continue;
+
+		//the source stays set after the blit, so a WM_PAINT redraw of xbsave on the main
+		//thread reads the same slot with the matching deemphasis plane
+		LockVideo();
+		SetBlitSource(slot->pixels, slot->deemph);
+		FCEUD_BlitScreen(slot->pixels);
+		UnlockVideo();
+	}
+}
+
+void StartPresentationThread()
+{
+	if(pipeline) return;
+
+	pipeline = new FramePipeline();
+	submitted = 0;
+	presenting.store(true);
+	presenter = std::thread(PresentLoop);
+}
+
+void StopPresentationThread()
+{
+	if(!pipeline) return;
+
+	presenting.store(false);
+	pipeline->stop();
+	presenter.join();
+
+	FCEUI_SetPresentationBuffer(NULL, NULL);
+
+	LockVideo();
+	SetBlitSource(NULL, NULL);
+	if(xbsave) xbsave = XBuf;
+	UnlockVideo();
+
+	delete pipeline;
+	pipeline = NULL;
+}
+
+bool PresentationPipelined()
+{
+	return pipeline != NULL;
+}
+
+void BeginPresentedFrame()
+{
+	if(!pipeline) return;
+	FrameSlot *slot = pipeline->back();
+	FCEUI_SetPresentationBuffer(slot->pixels, slot->deemph);
+}
+
+void SubmitPresentedFrame()
+{
+	if(!pipeline) return;
+	pipeline->back()->frame = submitted++;
+	pipeline->submit();
+}
@@ -0,0 +1,16 @@
+#ifndef WIN_PRESENT_H
+#define WIN_PRESENT_H
+
+//starts/stops blitting on a thread of its own. while it runs, frames go through a ring of
+//presentation buffers instead of being blitted from XBuf by the emulation thread
+void StartPresentationThread();
+void StopPresentationThread();
+bool PresentationPipelined();
+
+//call before FCEUI_Emulate(): points the core at the slot the next frame goes to
+void BeginPresentedFrame();
+
+//call instead of FCEUD_BlitScreen() once the frame is done
+void SubmitPresentedFrame();
+
+#endif
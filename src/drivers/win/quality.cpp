@@ -0,0 +1,212 @@
+/* FCE Ultra - NES/Famicom Emulator
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "common.h"
+#include "main.h"
+#include "video.h"
+#include "sound.h"
+#include "quality.h"
+#include "../../fceu.h"
+#include "../../movie.h"
+#include "../../netplay.h"
+#include "../../governor.h"
+
+#include <vector>
+
+extern int soundquality;
+extern int newppu;
+
+//the steps the governor can take, cheapest savings first
+enum QualityStep
+{
+	QS_SCALER,     //hq2x or another special filter -> plain blit
+	QS_RUNAHEAD,   //run-ahead -> none, each hidden frame costs about as much as a real one
+	QS_SOUNDQ_HI,  //soundq 2 -> 1
+	QS_SOUNDQ_LO,  //soundq 1 -> 0
+	QS_OLDPPU,     //new PPU -> old PPU
+	QS_COUNT
+};
+
+//what a step replaced, so stepping back up can put it back
+struct QualityChange
+{
+	QualityStep step;
+	int oldValue;
+	int newValue;
+};
+
+static QualityGovernor governor;
+static std::vector<QualityChange> changes;
+static double governorBudget = 0;
+
+//switching PPUs changes what the game sees, so only do it when nothing depends on the timing
+static bool CanSwitchPPU()
+{
+	if(!newppu || FCEUnetplay) return false;
+	if(!GameInfo || GameInfo->type == GIT_NSF) return false;
+	return FCEUMOV_Mode(MOVIEMODE_INACTIVE | MOVIEMODE_FINISHED);
+}
+
+static bool Applicable(QualityStep step)
+{
+	for(size_t i=0;i<changes.size();i++)
+		if(changes[i].step == step) return false;
+
+	switch(step)
+	{
+	case QS_SCALER: return (fullscreen ? vmodes[0].special : winspecial) != 0;
+	case QS_RUNAHEAD: return FCEUI_GetRunAhead() > 0;
+	case QS_SOUNDQ_HI: return soundo && soundquality == 2;
+	case QS_SOUNDQ_LO: return soundo && soundquality == 1;
+	case QS_OLDPPU: return CanSwitchPPU();
+	default: return false;
+	}
+}
+
+static int CountApplicable()
+{
+	int count = 0;
+	for(int i=0;i<QS_COUNT;i++)
+		if(Applicable((QualityStep)i)) count++;
+	return count;
+}
+
+static void SetScaler(int special)
+{
+	if(fullscreen) vmodes[0].special = special;
+	else winspecial = special;
+	SetVideoMode(fullscreen);
+}
+
+static int GetScaler()
+{
+	return fullscreen ? vmodes[0].special : winspecial;
+}
+
+static void StepDown()
+{
+	for(int i=0;i<QS_COUNT;i++)
+	{
+		QualityStep step = (QualityStep)i;
+		if(!Applicable(step)) continue;
+
+		QualityChange change;
+		change.step = step;
+		switch(step)
+		{
+		case QS_SCALER:
+			change.oldValue = GetScaler();
+			change.newValue = 0;
+			SetScaler(0);
+			FCEU_DispMessage("Slow frames: scaler filter turned off", 0);
+			break;
+		case QS_RUNAHEAD:
+			change.oldValue = FCEUI_GetRunAhead();
+			change.newValue = 0;
+			FCEUI_SetRunAhead(0);
+			FCEU_DispMessage("Slow frames: run-ahead turned off", 0);
+			break;
+		case QS_SOUNDQ_HI:
+		case QS_SOUNDQ_LO:
+			change.oldValue = soundquality;
+			change.newValue = soundquality - 1;
+			soundquality = change.newValue;
+			FCEUI_SetSoundQuality(soundquality);
+			FCEU_DispMessage("Slow frames: sound quality lowered", 0);
+			break;
+		case QS_OLDPPU:
+			change.oldValue = 1;
+			change.newValue = 0;
+			FCEU_TogglePPU();
+			break;
+		default:
+			continue;
+		}
+		changes.push_back(change);
+		return;
+	}
+}
+
+//puts back what the change replaced, unless the user has changed the setting since
+static void Undo(const QualityChange &change, bool report)
+{
+	switch(change.step)
+	{
+	case QS_SCALER:
+		if(GetScaler() != change.newValue) break;
+		SetScaler(change.oldValue);
+		if(report) FCEU_DispMessage("Scaler filter restored", 0);
+		break;
+	case QS_RUNAHEAD:
+		if(FCEUI_GetRunAhead() != change.newValue) break;
+		FCEUI_SetRunAhead(change.oldValue);
+		if(report) FCEU_DispMessage("Run-ahead restored", 0);
+		break;
+	case QS_SOUNDQ_HI:
+	case QS_SOUNDQ_LO:
+		if(soundquality != change.newValue) break;
+		soundquality = change.oldValue;
+		FCEUI_SetSoundQuality(soundquality);
+		if(report) FCEU_DispMessage("Sound quality restored", 0);
+		break;
+	case QS_OLDPPU:
+		if(newppu != change.newValue || !FCEUMOV_Mode(MOVIEMODE_INACTIVE | MOVIEMODE_FINISHED) || FCEUnetplay) break;
+		FCEU_TogglePPU();
+		break;
+	default:
+		break;
+	}
+}
+
+static void StepUp()
+{
+	if(changes.empty()) return;
+	QualityChange change = changes.back();
+	changes.pop_back();
+	Undo(change, true);
+}
+
+void UpdateQualityGovernor(double frameTime)
+{
+	if(!active_config->adaptive_quality) return;
+
+	double budget = (double)(1<<24) / FCEUI_GetDesiredFPS();
+	if(budget != governorBudget)
+	{
+		RestoreQualitySettings();
+		governorBudget = budget;
+		governor.configure(budget, 0);
+	}
+
+	governor.setLevels((int)changes.size() + CountApplicable());
+	switch(governor.update(frameTime))
+	{
+	case QualityGovernor::STEP_DOWN: StepDown(); break;
+	case QualityGovernor::STEP_UP: StepUp(); break;
+	default: break;
+	}
+}
+
+void RestoreQualitySettings()
+{
+	while(!changes.empty())
+	{
+		Undo(changes.back(), false);
+		changes.pop_back();
+	}
+	governor.reset();
+}
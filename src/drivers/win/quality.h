@@ -0,0 +1,11 @@
+#ifndef WIN_QUALITY_H
+#define WIN_QUALITY_H
+
+//feeds the time one frame took to emulate and blit (without throttle waits) to the
+//adaptive quality governor, which may lower or restore the scaler, sound quality or PPU
+void UpdateQualityGovernor(double frameTime);
+
+//undoes everything the governor changed, e.g. before settings get saved
+void RestoreQualitySettings();
+
+#endif
@@ -25,6 +25,9 @@
 #include <list>
 #include "common.h"
 #include "main.h"
+#include "throttle.h"
+#include "../../audio.h"
+#include "../../ratecontrol.h"
 
 extern bool turbo;		//If turbo is running
 
@@ -43,198 +46,30 @@ bool muteTurbo = true;
 //prototypes
 void UpdateSoundChannelQualityMode(HWND hwndDlg);	//Updates the sound channel volume sliders, disables and renames them for low quality
 
-//manages a set of small buffers which together work as one large buffer capable of resizing itsself and 
-//shrinking when a larger buffer is no longer necessary
-class BufferSet {
-public:
-
-	static const int BufferSize = 1024;
-	static const int BufferSizeBits = 10;
-	static const int BufferSizeBitmask = 1023;
-
-	class Buffer {
-	public:
-		int decay, size, length;
-		Buffer(int size) { length = 0; this->size = size; data = OAKRA_Module::malloc(size); }
-		int getRemaining() { return size-length; }
-		void *data;
-		~Buffer() { delete data; }
-	};
-
-	std::vector<Buffer*> liveBuffers;
-	std::vector<Buffer*> freeBuffers;
-	int length;
-	int offset; //offset of beginning of addressing into current buffer
-	int bufferCount;
-
-	BufferSet() {
-		offset = length = bufferCount = 0;
-	}
-
-	//causes the oldest free buffer to decay one unit. kills it if it gets too old
-	void decay(int threshold) {
-		if(freeBuffers.empty()) return;
-		if(freeBuffers[0]->decay++>=threshold) {
-			delete freeBuffers[0];
-			freeBuffers.erase(freeBuffers.begin());
-		}
-	}
-
-	Buffer *getBuffer() {
-		//try to get a buffer from the free pool first
-		//if theres nothing in the free pool, get a new buffer
-		if(!freeBuffers.size()) return getNewBuffer();
-		//otherwise, return the last thing in the free pool (most recently freed)
-		Buffer *ret = *--freeBuffers.end();
-		freeBuffers.erase(--freeBuffers.end());
-		return ret;
-	}
-
-	//adds the buffer to the free list
-	void freeBuffer(Buffer *buf) {
-		freeBuffers.push_back(buf);
-		buf->decay = 0;
-		buf->length = 0;
-	}
-
-	Buffer *getNewBuffer() {
-		bufferCount++;
-		return new Buffer(BufferSize);
-	}
-
-	short getShortAtIndex(int addr) {
-		addr <<= 1; //shorts are 2bytes
-		int buffer = (addr+offset)>>BufferSizeBits;
-		int ofs = (addr+offset) & BufferSizeBitmask;
-		return *(short*)((char*)liveBuffers[buffer]->data+ofs);
-	}
-
-	//dequeues the specified number of bytes
-	void dequeue(int length) {
-		offset += length;
-		while(offset >= BufferSize) {
-			Buffer *front = liveBuffers[0];
-			freeBuffer(front);
-			liveBuffers.erase(liveBuffers.begin());
-			offset -= BufferSize;
-		}
-		this->length -= length;
-	}
-
-	//not being used now:
-
-	//tries to lock the specified number of bytes for reading.
-	//not all the bytes you asked for will be locked (no more than one buffer-full)
-	//try again if you didnt get enough.
-	//returns the number of bytes locked.
-	//int lock(int length, void **ptr) {
-	//	int remain = BufferSize-offset;
-	//	*ptr = (char*)liveBuffers[0]->data + offset;
-	//	if(length<remain)
-	//		return length;
-	//	else
-	//		return remain;
-	//}
-
-	void enqueue(int length, void *data) {
-		int todo = length;
-		int done = 0;
-
-		//if there are no buffers in the queue, then we definitely need one before we start
-		if(liveBuffers.empty()) liveBuffers.push_back(getBuffer());
-
-		while(todo) {
-			//check the frontmost buffer
-			Buffer *end = *--liveBuffers.end();
-			int available = std::min(todo,end->getRemaining());
-			memcpy((char*)end->data + end->length,(char*)data + done,available);
-			end->length += available;
-			todo -= available;
-			done += available;
-
-			//we're going to need another buffer
-			if(todo != 0)
-				liveBuffers.push_back(getBuffer());
-		}
-
-		this->length += length;
-	}
-};
-
+//pulls 16bit samples for the DirectSound voice out of the core audio stream
 class Player : public OAKRA_Module {
 public:
 
-	int cursor;
-	BufferSet buffers;
-	int scale;
+	AudioStream *stream;
 
-	//not interpolating! someday it will! 
 	int generate(int samples, void *buf) {
-
-		int64 incr = 256;
-		int64 bufferSamples = buffers.length>>1;
-
-		//if we're we're too far behind, playback faster
-		if(bufferSamples > soundrate*3/60) {
-			int64 behind = bufferSamples - soundrate/60;
-			incr = behind*256*60/soundrate/2;
-			//we multiply our playback rate by 1/2 the number of frames we're behind
-		}
-		if(incr<256) 
-		{
-			 //sanity check: should never be less than 256
-			FCEU_printf("OHNO -- %d -- shouldnt be less than 256!\n", incr);
-		}
-
-		incr = (incr*scale)>>8; //apply scaling factor
-
-		//figure out how many dest samples we can generate at this rate without running out of source samples
-		int destSamplesCanGenerate = (bufferSamples<<8) / incr;
-
-		int todo = std::min(destSamplesCanGenerate,samples);
 		short *sbuf = (short*)buf;
-		for(int i=0;i<todo;i++) {
-			sbuf[i] = buffers.getShortAtIndex(cursor>>8);
-			cursor += incr;
-		}
-		buffers.dequeue((cursor>>8)<<1);
-		cursor &= 255;
+		stream->generate(sbuf,samples);
 
 		//perhaps mute
 		if(mute) memset(sbuf,0,samples<<1);
-		else memset(sbuf+todo,0,(samples-todo)<<1);
 
 		return samples;
 	}
 
-	void receive(int bytes, void *buf) {
-		dsout->lock();
-		buffers.enqueue(bytes,buf);
-		buffers.decay(60);
-		dsout->unlock();
-	}
-
 	void throttle() {
 		//wait for the buffer to be satisfactorily low before continuing
-		for(;;) {
-			dsout->lock();
-			int remain = buffers.length>>1;
-			dsout->unlock();
-			if(remain<soundrate/60) break;
-			//if(remain<soundrate*scale/256/60) break; ??
+		while(stream->buffered() >= soundrate/60)
 			Sleep(1);
-		}
 	}
 
-	void setScale(int scale) {
-		dsout->lock();
-		this->scale = scale;
-		dsout->unlock();
-	}
-
-	Player() {
-		scale = 256;
-		cursor = 0;
+	Player(AudioStream *stream) {
+		this->stream = stream;
 	}
 };
 
@@ -242,6 +77,7 @@ public:
 class Player8 : public OAKRA_Module {
 public:
 	Player *player;
+	std::vector<short> halfbuf;
 	Player8(Player *player) { this->player = player; }
 	int generate(int samples, void *buf) {
 		int half = samples>>1;
@@ -254,8 +90,8 @@ public:
 			dbuf[i] = (sbuf[i]>>8)^0x80;
 		//now retrieve second half
 		int remain = samples-half;
-		short *halfbuf = (short*)alloca(remain<<1);
-		player->generate(remain,halfbuf);
+		if((int)halfbuf.size() < remain) halfbuf.resize(remain);
+		player->generate(remain,&halfbuf[0]);
 		dbuf += half;
 		for(int i=0;i<remain;i++)
 			dbuf[i] = (halfbuf[i]>>8)^0x80;
@@ -266,6 +102,60 @@ public:
 static Player *player;
 static Player8 *player8;
 
+//plays the core audio stream through a DirectSound voice
+class DirectSoundAudioBackend : public AudioBackend {
+public:
+	int bits;
+
+	DirectSoundAudioBackend(int bits) { this->bits = bits; }
+
+	virtual bool open(AudioStream *stream, int rate) {
+		stream->setRate(rate);
+
+		dsout = new OAKRA_Module_OutputDS(); 
+		if(soundoptions&SO_GFOCUS)
+			dsout->start(0);
+		else
+			dsout->start(hAppWnd);
+		
+		dsout->beginThread();
+		OAKRA_Format fmt;
+		fmt.format = bits==8?OAKRA_U8:OAKRA_S16;
+		fmt.channels = 1;
+		fmt.rate = rate;
+		fmt.size = OAKRA_Module::calcSize(fmt);
+		OAKRA_Voice *voice = dsout->getVoice(fmt);
+		if(!voice)
+		{
+			FCEUD_PrintError("Couldn't initialize sound buffers. Sound disabled");
+			close();
+			return false;
+		}
+
+		player = new Player(stream);
+		player8 = new Player8(player);
+
+		dsout->lock();
+		if(bits == 8) voice->setSource(player8);
+		else voice->setSource(player);
+		dsout->unlock();
+		return true;
+	}
+
+	virtual void close() {
+		if(dsout) delete dsout;
+		if(player) delete player;
+		if(player8) delete player8;
+		dsout = 0;
+		player = 0;
+		player8 = 0;
+	}
+
+	virtual ~DirectSoundAudioBackend() {
+		close();
+	}
+};
+
 static bool trashPending = false;
 
 void TrashSound() {
@@ -273,12 +163,7 @@ void TrashSound() {
 }
 
 void DoTrashSound() {
-	if(dsout) delete dsout;
-	if(player) delete player;
-	if(player8) delete player8;
-	dsout = 0;
-	player = 0;
-	player8 = 0;
+	FCEUI_SetAudioBackend(0,0);
 	trashPending = false;
 }
 
@@ -305,41 +190,6 @@ void win_Throttle() {
 		player->throttle();
 }
 
-static bool killsound;
-void win_SoundInit(int bits) {
-	killsound = false;
-	dsout = new OAKRA_Module_OutputDS(); 
-	if(soundoptions&SO_GFOCUS)
-		dsout->start(0);
-	else
-		dsout->start(hAppWnd);
-	
-	dsout->beginThread();
-	OAKRA_Format fmt;
-	fmt.format = bits==8?OAKRA_U8:OAKRA_S16;
-	fmt.channels = 1;
-	fmt.rate = soundrate;
-	fmt.size = OAKRA_Module::calcSize(fmt);
-	OAKRA_Voice *voice = dsout->getVoice(fmt);
-	if(!voice)
-	{
-		killsound = true;
-		FCEUD_PrintError("Couldn't initialize sound buffers. Sound disabled");
-	}
-
-	player = new Player();
-	player8 = new Player8(player);
-
-	if(voice)
-	{
-		dsout->lock();
-		if(bits == 8) voice->setSource(player8);
-		else voice->setSource(player);
-		dsout->unlock();
-	}
-}
-
-
 int InitSound() {
 	bits = 8;
 
@@ -356,9 +206,8 @@ int InitSound() {
 		//	FCEUD_PrintError("DirectSound: 16-bit sound is not supported.  Forcing 8-bit sound.")
 	}
 
-	win_SoundInit(bits);
-	if(killsound)
-		TrashSound();
+	trashPending = false;
+	FCEUI_SetAudioBackend(new DirectSoundAudioBackend(bits), soundrate);
 
 	FCEUI_Sound(soundrate);
 	return 1;
@@ -367,20 +216,35 @@ int InitSound() {
 
 void win_SoundSetScale(int scale) {
 	if(CheckTrashSound()) return;
-	if(player)
-		player->scale = scale;
+	FCEUI_GetAudioStream()->setScale(scale);
 }
 
 void win_SoundWriteData(int32 *buffer, int count) {
 	//mbg 8/30/07 - this used to be done here, but now its gtting called from somewhere else...
 	//FCEUI_AviSoundUpdate((void*)MBuffer, Count);
 	if(CheckTrashSound()) return;
-	void *tempbuf = alloca(2*count);
-	short *sbuf = (short *)tempbuf;
-	for(int i=0;i<count;i++)
-		sbuf[i] = buffer[i];
-	if(player)
-		player->receive(count*2,tempbuf);
+	FCEUI_WriteAudio(buffer,count);
+}
+
+static AudioRateControl ratecontrol;
+
+//when frames are paced by the display instead of by SpeedThrottle(), keeps the sound queue
+//at about two frames by stretching the resampling a fraction of a percent either way
+void win_SoundRateControl(bool enabled) {
+	if(!enabled || !player || fps_scale != 256)
+	{
+		if(ratecontrol.getRatio() != 1.0)
+		{
+			ratecontrol.reset();
+			FCEUI_SetSoundResampleRatio(1.0);
+		}
+		return;
+	}
+
+	int target = soundrate*2/60;
+	if(ratecontrol.getTarget() != target)
+		ratecontrol.configure(target);
+	FCEUI_SetSoundResampleRatio(ratecontrol.update(FCEUI_GetAudioStream()->buffered()));
 }
 
 
@@ -6,6 +6,7 @@ void TrashSound();
 void TrashSoundNow();
 void win_SoundSetScale(int scale);
 void win_SoundWriteData(int32 *buffer, int count);
+void win_SoundRateControl(bool enabled);
 void win_Throttle();
 extern bool muteTurbo;
 extern int soundo;
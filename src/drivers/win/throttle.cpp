@@ -20,8 +20,13 @@
 
 #include "../../types.h"
 #include "../../fceu.h"
+#include "../../ratecontrol.h"
+#include "../../framedelay.h"
+#include "../../framethrottle.h"
 #include "windows.h"
 #include "driver.h"
+#include "video.h"
+#include "present.h"
 
 static uint64 tmethod,tfreq;
 static uint64 desiredfps;
@@ -29,6 +34,11 @@ int32 fps_scale = 256;
 int32 fps_scale_unpaused = 256;
 int32 fps_scale_frameadvance = 0;
 
+static FramePacer pacer;
+static FrameThrottle throttle(FCEU_GetSystemThrottleClock());
+static FrameDelay frameDelay;
+static double frameOversleep = 0;
+
 static int32 fps_scale_table[] = { 3, 3, 4, 8, 16, 32, 64, 128, 192, 256, 384, 512, 768, 1024, 2048, 4096, 8192, 16384, 16384};
 #define fps_table_size		(sizeof(fps_scale_table) / sizeof(fps_scale_table[0]))
 
@@ -69,44 +79,71 @@ void InitSpeedThrottle(void)
 }
 
 
+// Waits for the next frame with the core's FrameThrottle: a coarse Sleep, then a short spin.
+// Returns 1 after blocking for 100ms at most, so the caller can keep the gui responsive.
 int SpeedThrottle(void)
 {
- static uint64 ttime,ltime;
-
- waiter:
+ throttle.configure((double)desiredfps/65536.0);
+ return throttle.wait(0.1) ? 1 : 0;
+}
 
- ttime=GetCurTime();
+// True when the blit already waited for the vertical blank of a monitor running at
+// (nearly) the emulated frame rate. The display paces the frames then, SpeedThrottle()
+// would only fight it, and the small remaining drift is absorbed by the audio rate control,
+// as long as it's within the most that can correct.
+bool DisplayPaced(void)
+{
+ // With pipelined presentation the vblank is waited for on the presentation thread, and nothing
+ // holds the emulation thread to the display: SpeedThrottle() paces the frames, and there's no
+ // frame delay or audio rate control.
+ if(PresentationPipelined())
+  return false;
+
+ if(!FCEUD_WaitsForVBlank())
+  return false;
+
+ // The rate control adjusts the high quality resampler; the low quality one keeps its ratio.
+ if(FSettings.soundq<1)
+  return false;
+
+ // Until the refresh rate has been measured, SpeedThrottle() paces the frames.
+ double hz=FCEUD_GetMeasuredRefreshRate();
+ if(!hz)
+  return false;
+
+ pacer.configure((double)desiredfps/65536.0,hz);
+ return pacer.locked();
+}
 
-                            
- if( (ttime-ltime) < (tfreq/desiredfps) )
+// Frame delay: while the display paces the frames, sleep after each vblank for as long as the
+// next frame can spare, so its input is polled as close as possible to when it is shown.
+// workTime is what the frame just presented took, not counting the wait for the vblank.
+// The time to the next vblank is the display's refresh period, not the emulated frame's,
+// which differ by the fraction of a percent DisplayPaced() tolerates.
+void FrameDelayWait(bool active, double workTime)
+{
+ if(!active || !tmethod)
  {
-  uint64 sleepy;
-  sleepy=(tfreq/desiredfps)-(ttime-ltime);  
-  sleepy*=1000;
-  if(tfreq>=65536)
-	  sleepy/=tfreq>>16;
-  else
-      sleepy=0;
-  if(sleepy>100)
-  {
-   // block for a max of 100ms to
-   // keep the gui responsive
-   Sleep(100);
-   return 1;
-  }
-  Sleep(sleepy);
-  goto waiter;
+  frameDelay.reset();
+  frameOversleep=0;
+  return;
  }
- if( (ttime-ltime) >= (tfreq*4/desiredfps))
-  ltime=ttime;
- else
- {
-  ltime+=tfreq/desiredfps;
 
-  if( (ttime-ltime) >= (tfreq/desiredfps) ) // Oops, we're behind!
-  return(1);
- }
- return(0);
+ double hz=FCEUD_GetMeasuredRefreshRate();
+ frameDelay.configure(hz>0 ? 1.0/hz : 65536.0/desiredfps);
+ frameDelay.update(frameOversleep,workTime);
+ frameOversleep=0;
+
+ double delay=frameDelay.getDelay();
+ if(delay<=0)
+  return;
+
+ uint64 until=GetCurTime()+(uint64)(delay*(tfreq>>16));
+ Sleep((DWORD)(delay*1000));
+
+ uint64 now=GetCurTime();
+ if(now>until)
+  frameOversleep=(double)(now-until)/(tfreq>>16);
 }
 
 // Quick code for internal FPS display.
@@ -1,3 +1,5 @@
 void InitSpeedThrottle(void);
 int SpeedThrottle(void);
 void RefreshThrottleFPS();
+bool DisplayPaced(void);
+void FrameDelayWait(bool active, double workTime);
@@ -23,9 +23,13 @@
 #include "gui.h"
 #include "../../fceu.h"
 #include "../../video.h"
+#include "../../perftrace.h"
 #include "input.h"
+#include "present.h"
+#include "../../ratecontrol.h"
 #include <algorithm>
 #include <cmath>
+#include <mutex>
 
 extern bool fullscreenByDoubleclick;
 
@@ -299,8 +303,22 @@ void recalculateBestFitRect(int width, int height)
 	}
 }
 
+//DirectDraw surfaces are shared by the main thread and the presentation thread
+static std::recursive_mutex videoLock;
+
+void LockVideo()
+{
+	videoLock.lock();
+}
+
+void UnlockVideo()
+{
+	videoLock.unlock();
+}
+
 int SetVideoMode(int fs)
 {
+	std::lock_guard<std::recursive_mutex> guard(videoLock);
 	int specmul = 1;    // Special scaler size multiplier
 
 	if(fs)
@@ -549,6 +567,17 @@ bool FCEUD_ShouldDrawInputAids()
 static void BlitScreenWindow(uint8 *XBuf);
 static void BlitScreenFull(uint8 *XBuf);
 
+static uint64 vsyncWaitTime = 0;
+static RefreshTimer refreshTimer;
+
+//time spent blocked on the vertical blank since the last call, in FCEUD_GetTime() ticks
+uint64 FCEUD_TakeVSyncWaitTime()
+{
+	uint64 t = vsyncWaitTime;
+	vsyncWaitTime = 0;
+	return t;
+}
+
 static void FCEUD_VerticalSync()
 {
 	if(!NoWaiting)
@@ -558,6 +587,8 @@ static void FCEUD_VerticalSync()
 		if(fullscreen) ws=fssync;
 		else ws = winsync;
 
+		uint64 waitStart = FCEUD_GetTime();
+
 		if(ws==1)
 			IDirectDraw7_WaitForVerticalBlank(lpDD7,DDWAITVB_BLOCKBEGIN,0);
 		else if(ws == 2)   
@@ -567,12 +598,44 @@ static void FCEUD_VerticalSync()
 			while((DD_OK == IDirectDraw7_GetVerticalBlankStatus(lpDD7,&invb)) && !invb)
 				Sleep(0);
 		}
+		if(!PresentationPipelined())
+		{
+			uint64 now = FCEUD_GetTime();
+			vsyncWaitTime += now - waitStart;
+			if(ws==1)
+				refreshTimer.vblank((double)now / FCEUD_GetTimeFreq(), FCEUD_GetDisplayRefreshRate());
+		}
 	}
 }
 
+//true if presenting a frame blocks until the vertical blank, so the display paces emulation
+bool FCEUD_WaitsForVBlank()
+{
+	//a presentation thread does the waiting, not the emulation
+	if(NoWaiting || !lpDD7 || PresentationPipelined()) return false;
+	return (fullscreen ? fssync : winsync) == 1;
+}
+
+//refresh rate of the monitor in Hz, or 0 if the driver doesn't know it
+int FCEUD_GetDisplayRefreshRate()
+{
+	DWORD freq = 0;
+	if(!lpDD7 || IDirectDraw7_GetMonitorFrequency(lpDD7,&freq) != DD_OK)
+		return 0;
+	return (int)freq;
+}
+
+//refresh rate measured between the vertical blanks waited for, or 0 until there's enough of it
+double FCEUD_GetMeasuredRefreshRate()
+{
+	return refreshTimer.getRate();
+}
+
 //static uint8 *XBSave;
 void FCEUD_BlitScreen(uint8 *XBuf)
 {
+	PerfScope perf(PERF_BLIT);
+	std::lock_guard<std::recursive_mutex> guard(videoLock);
 	xbsave = XBuf;
 
 	if(fullscreen)
@@ -593,6 +656,7 @@ static void FixPaletteHi(void)
 
 void BlitImage(uint8_t const * sourcePixelBytes, size_t sourcePixelByteCount)
 {
+    std::lock_guard<std::recursive_mutex> guard(videoLock);
     int pitch;
     unsigned char *ScreenLoc;
     static RECT srect, wrect, blitRect;
@@ -1148,6 +1212,7 @@ static void BlitScreenFull(uint8 *XBuf)
 
 void ResetVideo(void)
 {
+	std::lock_guard<std::recursive_mutex> guard(videoLock);
 	ShowCursorAbs(1);
 	KillBlitToHigh();
 	if(lpDD7)
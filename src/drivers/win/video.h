@@ -71,4 +71,10 @@ void ResetVideo();
 void SetFSVideoMode();
 void PushCurrentVideoSettings();
 void ResetCustomMode();
+void LockVideo();
+void UnlockVideo();
+bool FCEUD_WaitsForVBlank();
+uint64 FCEUD_TakeVSyncWaitTime();
+int FCEUD_GetDisplayRefreshRate();
+double FCEUD_GetMeasuredRefreshRate();
 #endif
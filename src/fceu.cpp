@@ -23,6 +23,7 @@
 #include "fceu.h"
 #include "ppu.h"
 #include "sound.h"
+#include "audio.h"
 #include "netplay.h"
 #include "file.h"
 #include "utils/endian.h"
@@ -37,9 +38,13 @@
 #include "cheat.h"
 #include "palette.h"
 #include "state.h"
+#include "statedigest.h"
 #include "movie.h"
 #include "video.h"
 #include "input.h"
+#include "latency.h"
+#include "perftrace.h"
+#include "rewind.h"
 #include "file.h"
 #include "vsuni.h"
 #include "ines.h"
@@ -102,6 +107,9 @@ bool AutoSS = false;        //Flagged true when the first auto-savestate is made
 bool movieSubtitles = true; //Toggle for displaying movie subtitles
 bool DebuggerWasUpdated = false; //To prevent the debugger from updating things without being updated.
 bool AutoResumePlay = false;
+static int resumeInterval = 0;   //seconds between resume states while playing, 0 if only on close
+static int resumeCounter = 0;
+static bool gameResumed = false;
 char romNameWhenClosingEmulator[2048] = {0};
 
 
@@ -165,7 +173,7 @@ static void FCEU_CloseGame(void)
 		if (AutoResumePlay)
 		{
 			// save "-resume" savestate
-			FCEUSS_Save(FCEU_MakeFName(FCEUMKF_RESUMESTATE, 0, 0).c_str(), false);
+			FCEUSS_SaveResume(FCEU_MakeFName(FCEUMKF_RESUMESTATE, 0, 0).c_str());
 		}
 
 #ifdef WIN32
@@ -332,6 +340,7 @@ void SetWriteHandler(int32 start, int32 end, writefunc func) {
 }
 
 uint8 *RAM;
+uint32 RAMDirty = ~0u;
 
 //---------
 //windows might need to allocate these differently, so we have some special code
@@ -350,10 +359,12 @@ uint8 PAL = 0;
 
 static DECLFW(BRAML) {
 	RAM[A] = V;
+	RAMDirty |= 1 << (A >> 8);
 }
 
 static DECLFW(BRAMH) {
 	RAM[A & 0x7FF] = V;
+	RAMDirty |= 1 << ((A & 0x7FF) >> 8);
 }
 
 static DECLFR(ARAML) {
@@ -508,11 +519,16 @@ FCEUGI *FCEUI_LoadGameVirtual(const char *name, int OverwriteVidMode, bool silen
 		if (GameInfo->type != GIT_NSF && !disableAutoLSCheats)
 			FCEU_LoadGameCheats(0);
 
+		gameResumed = false;
+		resumeCounter = 0;
 		if (AutoResumePlay)
 		{
 			// load "-resume" savestate
-			if (FCEUSS_Load(FCEU_MakeFName(FCEUMKF_RESUMESTATE, 0, 0).c_str(), false))
+			if (FCEUSS_LoadResume(FCEU_MakeFName(FCEUMKF_RESUMESTATE, 0, 0).c_str()))
+			{
+				gameResumed = true;
 				FCEU_DispMessage("Old play session resumed.", 0);
+			}
 		}
 
 		ResetScreenshotsCounter();
@@ -571,6 +587,7 @@ bool FCEUI_Initialize() {
 }
 
 void FCEUI_Kill(void) {
+	FCEUSS_FlushWrites();
 	FCEU_KillVirtualVideo();
 	FCEU_KillGenie();
 	FreeBuffers();
@@ -617,6 +634,73 @@ void AutoFire(void) {
 }
 
 void UpdateAutosave(void);
+static void UpdateResumeState(void);
+
+//Run-ahead. A game reacts to a button a frame or two after reading it, so after every frame the
+//next ones are emulated with the same input, the last of them is shown, and the machine goes
+//back to the snapshot taken before them.
+#define RUNAHEAD_MAX 4
+
+static int runAheadFrames = 0;
+static FCEUFlatSnapshot runAheadState;
+
+void FCEUI_SetRunAhead(int frames) {
+	if (frames < 0) frames = 0;
+	if (frames > RUNAHEAD_MAX) frames = RUNAHEAD_MAX;
+	runAheadFrames = frames;
+}
+
+int FCEUI_GetRunAhead(void) {
+	return runAheadFrames;
+}
+
+//the hidden frames reuse the input of the real one, so whatever records or replays input
+//per frame has to be left alone; and a frame being stepped through should show itself.
+//Expansion sound chips (VRC6, N163, FDS, MMC5...) keep their waveform positions to themselves
+//and mix into WaveHi as they go, so the hidden frames would be heard and leave them out of
+//step: those games go without.
+static bool RunAheadActive(int skip) {
+	return runAheadFrames > 0
+		&& !skip
+		&& GameInfo->type != GIT_NSF
+		&& !GameExpSound.Fill && !GameExpSound.HiFill && !GameExpSound.NeoFill
+		&& FCEUMOV_Mode(MOVIEMODE_INACTIVE)
+		&& !FCEUnetplay
+		&& !(EmulationPaused & EMULATIONPAUSED_FA);
+}
+
+static void RunAhead(void) {
+	if (!FCEUSS_SaveFlat(runAheadState)) {
+		FCEU_PutImage();
+		return;
+	}
+
+	char realLagFlag = lagFlag;
+
+	//the back buffer is the real frame, the one a pause shows and savestates keep
+	FCEU_KeepBackBuffer();
+
+	FCEUSND_BeginHiddenFrames();
+	for (int i = 0; i < runAheadFrames; i++) {
+		if (geniestage != 1) FCEU_ApplyPeriodicCheats();
+		FCEUPPU_Loop(0);
+		SkipEmulateSound();
+
+		//only the one that gets shown needs its overlays
+		if (i == runAheadFrames - 1) {
+			FCEU_LatencyFrameShown();
+			FCEU_PutImage();
+		}
+
+		timestampbase += timestamp;
+		timestamp = 0;
+		soundtimestamp = 0;
+	}
+
+	FCEUSS_LoadFlat(runAheadState);
+	FCEUSND_EndHiddenFrames();
+	lagFlag = realLagFlag;
+}
 
 ///Emulates a single frame.
 
@@ -627,6 +711,8 @@ void FCEUI_Emulate(uint8 **pXBuf, int32 **SoundBuf, int32 *SoundBufSize, int ski
 
 	JustFrameAdvanced = false;
 
+	FCEUSS_ReportWrites();
+
 	if (frameAdvanceRequested)
 	{
 		if (frameAdvance_Delay_count == 0 || frameAdvance_Delay_count >= frameAdvance_Delay)
@@ -670,18 +756,41 @@ void FCEUI_Emulate(uint8 **pXBuf, int32 **SoundBuf, int32 *SoundBufSize, int ski
 		}
 	}
 
+	//while rewinding, the frame starts from the previous snapshot
+	bool rewound = FCEU_RewindStep();
+
 	AutoFire();
 	UpdateAutosave();
+	UpdateResumeState();
 
+	FCEUMOV_FrameStart();
 	FCEU_UpdateInput();
 	lagFlag = 1;
 
 	if (geniestage != 1) FCEU_ApplyPeriodicCheats();
+
+	bool runAhead = RunAheadActive(skip);
+
+	//If skip = 2 we are skipping sound processing, the APU only keeps its state up to date
+	FCEUSND_SetFastSkip(skip == 2);
 	r = FCEUPPU_Loop(skip);
 
-	if (skip != 2) ssize = FlushEmulateSound();  //If skip = 2 we are skipping sound processing
+	//with late input polling, a frame that never read its controllers still records its input
+	FCEU_LatchPendingInput();
 
-	FCEU_PutImage();
+	if (skip != 2)
+	{
+		uint64 synthstart = FCEUD_GetTime();
+		ssize = FlushEmulateSound();
+		FCEUI_GetAudioStream()->setSynthesisTime((double)(FCEUD_GetTime() - synthstart) / FCEUD_GetTimeFreq());
+	}
+	else SkipEmulateSound();
+
+	//with run-ahead, the frame that gets shown is the last hidden one
+	if (!runAhead) {
+		FCEU_LatencyFrameShown();
+		FCEU_PutImage();
+	}
 
 #ifdef WIN32
 
@@ -698,8 +807,11 @@ void FCEUI_Emulate(uint8 **pXBuf, int32 **SoundBuf, int32 *SoundBufSize, int ski
 	timestamp = 0;
 	soundtimestamp = 0;
 
+	if (runAhead)
+		RunAhead();
+
 	*pXBuf = skip ? 0 : XBuf;
-	if (skip == 2) { //If skip = 2, then bypass sound
+	if (skip == 2 || rewound) { //If skip = 2, then bypass sound
 		*SoundBuf = 0;
 		*SoundBufSize = 0;
 	} else {
@@ -726,6 +838,57 @@ void FCEUI_Emulate(uint8 **pXBuf, int32 **SoundBuf, int32 *SoundBufSize, int ski
 
 	if (movieSubtitles)
 		ProcessSubtitles();
+
+	if (!rewound)
+		FCEU_RewindCapture();
+
+	FCEU_PerfFrame();
+}
+
+///Emulates a frame that will never be shown, for max-speed turbo.
+
+///Input, movies and cheats advance as they do in FCEUI_Emulate(), but the APU only keeps its state,
+///and overlays, subtitles, autosave and the back buffer are left alone. The PPU still renders,
+///since sprite 0 hits and mapper IRQs depend on it. Returns false, without emulating, while paused.
+bool FCEUI_EmulateHidden(void) {
+	if (EmulationPaused)
+		return false;
+
+	AutoFire();
+
+	FCEUMOV_FrameStart();
+	FCEU_UpdateInput();
+	lagFlag = 1;
+
+	if (geniestage != 1) FCEU_ApplyPeriodicCheats();
+
+	FCEUSND_SetFastSkip(true);
+	FCEUPPU_Loop(0);
+	FCEU_LatchPendingInput();
+	SkipEmulateSound();
+
+	timestampbase += timestamp;
+	timestamp = 0;
+	soundtimestamp = 0;
+
+	if (lagFlag) {
+		lagCounter++;
+		justLagged = true;
+	} else justLagged = false;
+
+	FCEU_PerfFrame();
+
+	extern int KillFCEUXonFrame;
+	if (KillFCEUXonFrame && (FCEUMOV_GetFrame() >= KillFCEUXonFrame)) {
+#ifdef WIN32
+		DoFCEUExit();
+		return false;
+#else
+		exit(0);
+#endif
+	}
+
+	return true;
 }
 
 void FCEUI_CloseGame(void) {
@@ -851,6 +1014,7 @@ void PowerNES(void) {
 	FCEU_GeniePower();
 
 	FCEU_MemoryRand(RAM, 0x800);
+	RAMDirty = ~0u;
 
 	SetReadHandler(0x0000, 0xFFFF, ANull);
 	SetWriteHandler(0x0000, 0xFFFF, BNull);
@@ -1083,22 +1247,41 @@ void FCEUI_FrameAdvance(void) {
 static int AutosaveCounter = 0;
 
 void UpdateAutosave(void) {
+	PerfScope perf(PERF_AUTOSAVE);
+
 	if (!EnableAutosave || turbo)
 		return;
 
-	char * f;
 	if (++AutosaveCounter >= AutosaveFrequency) {
 		AutosaveCounter = 0;
 		AutosaveIndex = (AutosaveIndex + 1) % AutosaveQty;
-		f = strdup(FCEU_MakeFName(FCEUMKF_AUTOSTATE, AutosaveIndex, 0).c_str());
-		FCEUSS_Save(f, false);
+		FCEUSS_Save(FCEU_MakeFName(FCEUMKF_AUTOSTATE, AutosaveIndex, 0).c_str(), false);
 		AutoSS = true;  //Flag that an auto-savestate was made
-		free(f);
-        f = NULL;
 		AutosaveStatus[AutosaveIndex] = 1;
 	}
 }
 
+void FCEUI_SetAutoResume(bool enable, int intervalSeconds) {
+	AutoResumePlay = enable;
+	resumeInterval = intervalSeconds > 0 ? intervalSeconds : 0;
+	resumeCounter = 0;
+}
+
+bool FCEUI_GameResumed(void) {
+	return gameResumed;
+}
+
+//keeps the resume state fresh, so a crash or a killed process loses at most one interval
+static void UpdateResumeState(void) {
+	if (!AutoResumePlay || !resumeInterval || turbo || !FCEUMOV_Mode(MOVIEMODE_INACTIVE))
+		return;
+
+	if (++resumeCounter >= resumeInterval * (int)(FCEUI_GetDesiredFPS() >> 24)) {
+		resumeCounter = 0;
+		FCEUSS_SaveResume(FCEU_MakeFName(FCEUMKF_RESUMESTATE, 0, 0).c_str());
+	}
+}
+
 void FCEUI_RewindToLastAutosave(void) {
 	if (!EnableAutosave || !AutoSS)
 		return;
@@ -1304,8 +1487,11 @@ uint8 FCEU_ReadRomByte(uint32 i) {
 void FCEU_WriteRomByte(uint32 i, uint8 value) {
 	if (i < 16)
 		printf("Sorry, you can't edit the ROM header.\n");
-	if (i < 16 + PRGsize[0])
+	if (i < 16 + PRGsize[0]) {
 		PRGptr[0][i - 16] = value;
-	else if (i < 16 + PRGsize[0] + CHRsize[0])
+		FCEUSS_MarkWritten(&PRGptr[0][i - 16]);
+	} else if (i < 16 + PRGsize[0] + CHRsize[0]) {
 		CHRptr[0][i - 16 - PRGsize[0]] = value;
+		FCEUSS_MarkWritten(&CHRptr[0][i - 16 - PRGsize[0]]);
+	}
 }
@@ -70,6 +70,8 @@ extern uint8 qtaintramreg;
 #define GAME_MEM_BLOCK_SIZE 131072
 
 extern  uint8  *RAM;            //shared memory modifications
+extern  uint32 RAMDirty;        //a bit for each 256-byte page of RAM written since the last state digest;
+                                //~0u also rehashes the tracked cartridge memory (see statedigest.h)
 extern int EmulationPaused;
 
 uint8 FCEU_ReadRomByte(uint32 i);
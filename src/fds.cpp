@@ -27,6 +27,7 @@
 #include "utils/md5.h"
 #include "utils/memory.h"
 #include "state.h"
+#include "statedigest.h"
 #include "file.h"
 #include "cart.h"
 #include "netplay.h"
@@ -42,6 +43,7 @@
 //	prevent writes to wrong places OR add code to prevent disk ejects
 //	when the virtual motor is on (mmm...virtual motor).
 extern int disableBatteryLoading;
+extern int disableBatterySaving;
 
 bool isFDS = false; //flag for determining if a FDS game is loaded, movie.cpp needs this
 
@@ -611,6 +613,7 @@ static DECLFW(FDSWrite) {
 				else if (DiskPtr >= 2) {
 					DiskWritten = 1;
 					diskdata[InDisk][DiskPtr - 2] = V;
+					FCEUSS_MarkWritten(&diskdata[InDisk][DiskPtr - 2]);
 				}
 			}
 		}
@@ -891,6 +894,7 @@ int FDSLoad(const char *name, FCEUFILE *fp) {
 		char temp[5];
 		sprintf(temp, "DDT%d", x);
 		AddExState(diskdata[x], 65500, 0, temp);
+		FCEUSS_TrackWrites(diskdata[x], 65500);
 	}
 
 	AddExState(FDSRegs, sizeof(FDSRegs), 0, "FREG");
@@ -937,7 +941,7 @@ void FDSClose(void) {
 	int x;
 	isFDS = false;
 
-	if (!DiskWritten) return;
+	if (!DiskWritten || disableBatterySaving) return;
 
 	const std::string &fn = FCEU_MakeFName(FCEUMKF_FDS, 0, 0);
 	if (!(fp = FCEUD_UTF8fopen(fn.c_str(), "wb"))) {
@@ -18,6 +18,8 @@ static int32 coeffs[NCOEFFS];
 
 static uint32 mrindex;
 static uint32 mrratio;
+static uint32 mrbaseratio;	/* mrratio before SetFilterResampleRatio() */
+static double mradjust=1.0;
 
 void SexyFilter2(int32 *in, int32 count)
 {
@@ -165,6 +167,15 @@ int32 NeoFilterSound(int32 *in, int32 *out, uint32 inlen, int32 *leftover)
 	return(count);
 }
 
+/* Scales the number of CPU cycles per output sample.  ratio>1 produces slightly fewer
+   samples per frame, ratio<1 slightly more.  Used to keep the driver's audio queue at a
+   steady fill level when emulation is paced by something other than the sound card. */
+void SetFilterResampleRatio(double ratio)
+{
+ mradjust=ratio;
+ mrratio=(uint32)(mrbaseratio*mradjust);
+}
+
 void MakeFilters(int32 rate)
 {
  const int32 *tabs[6]={C44100NTSC,C44100PAL,C48000NTSC,C48000PAL,C96000NTSC,
@@ -182,7 +193,8 @@ void MakeFilters(int32 rate)
   nco=NCOEFFS;
 
  mrindex=(nco+1)<<16;
- mrratio=(PAL?(int64)(PAL_CPU*65536):(int64)(NTSC_CPU*65536))/rate;
+ mrbaseratio=(PAL?(int64)(PAL_CPU*65536):(int64)(NTSC_CPU*65536))/rate;
+ mrratio=(uint32)(mrbaseratio*mradjust);
 
  if(FSettings.soundq==2)
   tmp=sq2tabs[(PAL?1:0)|(rate==48000?2:0)|(rate==96000?4:0)];
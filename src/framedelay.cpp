@@ -0,0 +1,97 @@
+/* FCE Ultra - NES/Famicom Emulator
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "framedelay.h"
+
+#include <algorithm>
+
+#define FD_MIN_SAMPLES  30      //half a second of frames before any delay
+#define FD_PERCENTILE   0.95
+#define FD_MISS_STEP    0.0005  //margin added per missed vblank
+#define FD_MISS_MAX     0.004
+#define FD_MISS_HOLD    60      //frames without delay after a miss
+#define FD_CALM_FRAMES  600     //frames without a miss before a step of margin is given back
+
+FrameDelay::FrameDelay()
+	: period(1.0/60)
+	, margin(0.0015)
+{
+	reset();
+}
+
+void FrameDelay::configure(double period, double margin)
+{
+	if(period == this->period && margin == this->margin)
+		return;
+	this->period = period;
+	this->margin = margin;
+	reset();
+}
+
+void FrameDelay::reset()
+{
+	extra = 0;
+	count = next = 0;
+	cost = 0;
+	delay = 0;
+	cooldown = 0;
+	calm = 0;
+}
+
+void FrameDelay::update(double oversleep, double work)
+{
+	double sample = oversleep + work;
+
+	samples[next] = sample;
+	next = (next + 1) % WINDOW;
+	if(count < WINDOW) count++;
+
+	//the frame had period - delay to finish in. going over means it waited for the vblank after
+	bool missed = delay > 0 && sample > period - delay;
+	if(missed)
+	{
+		extra = std::min(extra + FD_MISS_STEP, FD_MISS_MAX);
+		cooldown = FD_MISS_HOLD;
+		calm = 0;
+	}
+	else if(++calm >= FD_CALM_FRAMES)
+	{
+		extra = std::max(extra - FD_MISS_STEP, 0.0);
+		calm = 0;
+	}
+
+	if(count < FD_MIN_SAMPLES)
+	{
+		delay = 0;
+		return;
+	}
+
+	double sorted[WINDOW];
+	std::copy(samples, samples + count, sorted);
+	int k = (int)(FD_PERCENTILE * (count - 1));
+	std::nth_element(sorted, sorted + k, sorted + count);
+	cost = sorted[k];
+
+	if(cooldown)
+	{
+		cooldown--;
+		delay = 0;
+		return;
+	}
+
+	delay = std::max(period - cost - margin - extra, 0.0);
+}
@@ -0,0 +1,45 @@
+#ifndef _FRAMEDELAY_H_
+#define _FRAMEDELAY_H_
+
+//Frame delay.
+//
+//With vsync, a frame is normally emulated right after the previous vblank and then waits for
+//the next one, so its input is a whole refresh old by the time it is shown. FrameDelay works
+//out how long the driver can sleep after the vblank before polling input and emulating, and
+//still be done in time: the refresh period minus a high percentile of what recent frames
+//needed, minus a safety margin. A frame that misses its vblank anyway widens the margin and
+//turns the delay off for a moment. No clock is read here, so it can be driven by a simulated one.
+class FrameDelay
+{
+public:
+	FrameDelay();
+
+	//period: seconds between vblanks. margin: kept free on top of what frames were seen to need
+	void configure(double period, double margin = 0.0015);
+	void reset();
+
+	//call once per frame with how much the delay overslept and how long polling, emulating
+	//and presenting the frame took, not counting the wait for the vblank
+	void update(double oversleep, double work);
+
+	//how long to sleep after the vblank before starting the next frame, in seconds
+	double getDelay() const { return delay; }
+
+	//the percentile of recent frame costs the delay is based on
+	double getCost() const { return cost; }
+
+private:
+	enum { WINDOW = 128 };
+
+	double period;
+	double margin;
+	double extra;     //margin added after misses, given back slowly
+	double samples[WINDOW];
+	int count, next;
+	double cost;
+	double delay;
+	int cooldown;     //frames left without delay after a miss
+	int calm;         //frames since the last miss
+};
+
+#endif
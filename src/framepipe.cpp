@@ -0,0 +1,81 @@
+/* FCE Ultra - NES/Famicom Emulator
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "framepipe.h"
+
+#include <chrono>
+#include <cstring>
+
+FramePipeline::FramePipeline()
+	: writing(0)
+	, pending(1)
+	, presenting(2)
+	, fresh(false)
+	, stopped(false)
+	, dropped(0)
+{
+	for(int i=0;i<3;i++)
+	{
+		memset(slots[i].pixels, 0x80, sizeof(slots[i].pixels));
+		memset(slots[i].deemph, 0, sizeof(slots[i].deemph));
+		slots[i].frame = 0;
+	}
+}
+
+void FramePipeline::submit()
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		if(fresh) dropped++;
+		int t = pending;
+		pending = writing;
+		writing = t;
+		fresh = true;
+	}
+	cond.notify_one();
+}
+
+FrameSlot *FramePipeline::acquire(int timeoutMs)
+{
+	std::unique_lock<std::mutex> guard(lock);
+	if(!cond.wait_for(guard, std::chrono::milliseconds(timeoutMs), [this] { return fresh || stopped; }))
+		return NULL;
+	if(stopped)
+		return NULL;
+
+	int t = presenting;
+	presenting = pending;
+	pending = t;
+	fresh = false;
+	return &slots[presenting];
+}
+
+void FramePipeline::stop()
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopped = true;
+	}
+	cond.notify_all();
+}
+
+void FramePipeline::restart()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	stopped = false;
+	fresh = false;
+}
@@ -0,0 +1,61 @@
+#ifndef _FRAMEPIPE_H_
+#define _FRAMEPIPE_H_
+
+#include "types.h"
+
+#include <condition_variable>
+#include <mutex>
+
+//One frame on its way to the screen: the palette indices with the overlays drawn on top
+//and the matching deemphasis plane, laid out like XBuf/XDBuf.
+struct FrameSlot
+{
+	uint8 pixels[256*256];
+	uint8 deemph[256*256];
+	uint32 frame;
+};
+
+//Triple buffer between the emulation thread and a presentation thread.
+//The emulator fills one slot while the presenter converts and scales another; the third holds
+//the newest finished frame. The emulator never waits: if the presenter falls behind, the
+//frame it hasn't picked up yet is replaced by the next one.
+class FramePipeline
+{
+public:
+	FramePipeline();
+
+	//--- producer (emulation thread)
+
+	//the slot to render the next frame into. stays the same until submit()
+	FrameSlot *back() { return &slots[writing]; }
+
+	//hands the back slot to the presenter
+	void submit();
+
+	//--- consumer (presentation thread)
+
+	//waits up to timeoutMs for a frame that hasn't been presented yet.
+	//the slot stays valid until the next acquire(). returns NULL on timeout or after stop()
+	FrameSlot *acquire(int timeoutMs);
+
+	//wakes up acquire() for good
+	void stop();
+	void restart();
+
+	//frames replaced before the presenter got to them
+	uint32 getDropped() const { return dropped; }
+
+private:
+	FrameSlot slots[3];
+	int writing, pending, presenting;
+	bool fresh;    //pending holds a frame that wasn't presented yet
+	bool stopped;
+	uint32 dropped;
+	std::mutex lock;
+	std::condition_variable cond;
+
+	FramePipeline(const FramePipeline &);
+	FramePipeline &operator=(const FramePipeline &);
+};
+
+#endif
@@ -0,0 +1,160 @@
+/* FCE Ultra - NES/Famicom Emulator
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "framethrottle.h"
+
+#include <algorithm>
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#include <errno.h>
+#endif
+
+#define FT_MAX_BEHIND   4       //periods behind schedule before starting a new one
+#define FT_SPIN_MIN     0.0005
+#define FT_SPIN_MAX     0.004
+#define FT_SPIN_MARGIN  0.0002  //spun on top of the worst recent oversleep
+#define FT_DECAY        0.995   //per sleep, lets one bad oversleep be forgotten after a few seconds
+
+#ifdef WIN32
+
+class SystemThrottleClock : public ThrottleClock
+{
+public:
+	SystemThrottleClock()
+	{
+		LARGE_INTEGER f;
+		QueryPerformanceFrequency(&f);
+		freq = (double)f.QuadPart;
+	}
+
+	virtual double now()
+	{
+		LARGE_INTEGER t;
+		QueryPerformanceCounter(&t);
+		return (double)t.QuadPart / freq;
+	}
+
+	//Sleep() takes whole milliseconds (the driver raises the timer resolution to 1ms with
+	//timeBeginPeriod()). cutting the fraction off would turn anything under 1ms into Sleep(0),
+	//so it sleeps the nearest number of them and spins for whatever that left short
+	virtual void sleep(double seconds)
+	{
+		double until = now() + seconds;
+		DWORD ms = (DWORD)(seconds * 1000 + 0.5);
+		if(ms)
+			Sleep(ms);
+		while(now() < until)
+			;
+	}
+
+private:
+	double freq;
+};
+
+#else
+
+class SystemThrottleClock : public ThrottleClock
+{
+public:
+	virtual double now()
+	{
+		struct timespec t;
+		clock_gettime(CLOCK_MONOTONIC, &t);
+		return t.tv_sec + t.tv_nsec * 1e-9;
+	}
+
+	virtual void sleep(double seconds)
+	{
+		struct timespec t;
+		t.tv_sec = (time_t)seconds;
+		t.tv_nsec = (long)((seconds - t.tv_sec) * 1e9);
+#ifdef __APPLE__
+		while(nanosleep(&t, &t) == -1 && errno == EINTR)
+			;
+#else
+		//returns the error instead of setting errno
+		while(clock_nanosleep(CLOCK_MONOTONIC, 0, &t, &t) == EINTR)
+			;
+#endif
+	}
+};
+
+#endif
+
+ThrottleClock & FCEU_GetSystemThrottleClock()
+{
+	static SystemThrottleClock clock;
+	return clock;
+}
+
+FrameThrottle::FrameThrottle(ThrottleClock & clock)
+	: clock(clock)
+	, period(1.0/60)
+	, oversleep(0.002)
+{
+	spin = std::min(std::max(oversleep + FT_SPIN_MARGIN, FT_SPIN_MIN), FT_SPIN_MAX);
+	reset();
+}
+
+void FrameThrottle::configure(double fps)
+{
+	if(fps > 0)
+		period = 1.0 / fps;
+}
+
+void FrameThrottle::reset()
+{
+	deadline = 0;
+	scheduled = false;
+}
+
+bool FrameThrottle::wait(double maxBlock)
+{
+	double now = clock.now();
+
+	//first frame, or so far behind (a pause, turbo, a stall) that catching up makes no sense
+	if(!scheduled || now - deadline > FT_MAX_BEHIND * period)
+	{
+		deadline = now;
+		scheduled = true;
+	}
+
+	double limit = now + maxBlock;
+	while(deadline - now > spin)
+	{
+		if(now >= limit)
+			return true;
+
+		double request = std::min(deadline - now - spin, limit - now);
+		clock.sleep(request);
+		double after = clock.now();
+
+		oversleep = std::max(after - now - request, oversleep * FT_DECAY);
+		spin = std::min(std::max(oversleep + FT_SPIN_MARGIN, FT_SPIN_MIN), FT_SPIN_MAX);
+		now = after;
+	}
+
+	while(now < deadline)
+		now = clock.now();
+
+	//the next frame is due one period after this one was, not after it actually started
+	deadline += period;
+	return false;
+}
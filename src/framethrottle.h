@@ -0,0 +1,54 @@
+#ifndef _FRAMETHROTTLE_H_
+#define _FRAMETHROTTLE_H_
+
+//Frame throttle.
+//
+//Paces emulation at the emulated frame rate when nothing else does (no vsync lock, no turbo).
+//Frames are due on an absolute schedule, one period after the other, so fractional rates like
+//NTSC's 60.0988 fps or PAL's 50.007 fps don't drift. Most of the wait is a coarse OS sleep; only
+//the last stretch, about as long as the OS has been seen to oversleep, is spent spinning.
+//The clock is passed in, so the throttle can be driven by a simulated one.
+
+class ThrottleClock
+{
+public:
+	virtual ~ThrottleClock() {}
+
+	//monotonic time in seconds
+	virtual double now() = 0;
+
+	//sleeps for about this many seconds; may oversleep
+	virtual void sleep(double seconds) = 0;
+};
+
+//QueryPerformanceCounter and Sleep on Windows, clock_gettime and clock_nanosleep elsewhere
+ThrottleClock & FCEU_GetSystemThrottleClock();
+
+class FrameThrottle
+{
+public:
+	FrameThrottle(ThrottleClock & clock);
+
+	//fps: emulated frames per second, including fps_scale. keeps the schedule if it changes
+	void configure(double fps);
+
+	//forgets the schedule, the next wait() starts a new one
+	void reset();
+
+	//waits until the next frame is due, for at most maxBlock seconds. returns true if it gave
+	//up before that, so the caller can keep the GUI responsive and call again
+	bool wait(double maxBlock = 0.1);
+
+	//how long before a deadline sleeping stops and spinning starts
+	double getSpinTime() const { return spin; }
+
+private:
+	ThrottleClock & clock;
+	double period;
+	double deadline;  //when the next frame is due
+	bool scheduled;
+	double oversleep; //decaying peak of how far sleeps have overshot
+	double spin;
+};
+
+#endif
@@ -0,0 +1,182 @@
+/* FCE Ultra - NES/Famicom Emulator
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+//Standalone test of FrameThrottle against a simulated clock. Not part of the emulator build:
+//  g++ -std=c++11 -I. framethrottle_test.cpp framethrottle.cpp -o framethrottle_test
+
+#include "framethrottle.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+static int failures = 0;
+
+#define CHECK(cond) do { if(!(cond)) { printf("%s:%d: failed: %s\n", __FILE__, __LINE__, #cond); failures++; } } while(0)
+
+//time only moves when it's slept or read. a sleep lasts what's asked, rounded up to the timer
+//resolution, plus a fixed oversleep; every read takes a microsecond, so spinning ends
+class SimClock : public ThrottleClock
+{
+public:
+	SimClock(double resolution = 0.001, double oversleep = 0.0005)
+		: t(100.0)
+		, resolution(resolution)
+		, oversleep(oversleep)
+		, sleeps(0)
+	{}
+
+	virtual double now()
+	{
+		t += 0.000001;
+		return t;
+	}
+
+	virtual void sleep(double seconds)
+	{
+		sleeps++;
+		if(resolution > 0)
+			seconds = ceil(seconds / resolution) * resolution;
+		t += seconds + oversleep;
+	}
+
+	double t;
+	double resolution;
+	double oversleep;
+	int sleeps;
+};
+
+//frames come one period apart on average, none early, and the schedule doesn't drift
+static void TestSchedule()
+{
+	SimClock clock;
+	FrameThrottle throttle(clock);
+	double fps = 60.0988;
+	throttle.configure(fps);
+
+	CHECK(!throttle.wait());
+	double start = clock.t;
+	double last = start;
+	double worstLate = 0;
+	for(int i = 1; i <= 6000; i++)
+	{
+		while(throttle.wait())
+			;
+		double due = start + i / fps;
+		CHECK(clock.t >= due);
+		worstLate = std::max(worstLate, clock.t - due);
+		last = clock.t;
+	}
+	CHECK(worstLate < 0.0002);
+	CHECK(fabs((last - start) - 6000 / fps) < 0.0002);
+	CHECK(clock.sleeps > 0);
+}
+
+//the spin grows to cover the oversleep it has seen, so once it has been seen, a clock that
+//oversleeps a lot keeps time to within its resolution
+static void TestOversleep()
+{
+	SimClock clock(0.001, 0.0025);
+	FrameThrottle throttle(clock);
+	throttle.configure(50.007);
+
+	throttle.wait();
+	double start = clock.t;
+	double worstLate = 0;
+	for(int i = 1; i <= 600; i++)
+	{
+		throttle.wait();
+		if(i > 10)
+			worstLate = std::max(worstLate, clock.t - (start + i / 50.007));
+	}
+	CHECK(throttle.getSpinTime() >= 0.0025);
+	CHECK(worstLate < 0.001);
+}
+
+//a long wait gives up after maxBlock, and picks up where it left off when called again
+static void TestMaxBlock()
+{
+	SimClock clock;
+	FrameThrottle throttle(clock);
+	throttle.configure(2);
+
+	throttle.wait();
+	double start = clock.t;
+	CHECK(throttle.wait(0.1));
+	CHECK(clock.t - start < 0.11);
+
+	int calls = 1;
+	while(throttle.wait(0.1))
+		calls++;
+	CHECK(calls >= 4 && calls <= 6);
+	CHECK(clock.t >= start + 0.5);
+	CHECK(clock.t - (start + 0.5) < 0.0002);
+}
+
+//after a stall, the next frame isn't rushed out to catch up but starts a new schedule
+static void TestStall()
+{
+	SimClock clock;
+	FrameThrottle throttle(clock);
+	throttle.configure(60);
+
+	for(int i = 0; i < 10; i++)
+		throttle.wait();
+	clock.t += 1.0;
+
+	double before = clock.t;
+	throttle.wait();
+	CHECK(clock.t - before < 0.0001);
+	throttle.wait();
+	CHECK(clock.t - before >= 1.0 / 60);
+}
+
+//a changed rate applies from the next frame, without restarting the schedule
+static void TestConfigure()
+{
+	SimClock clock;
+	FrameThrottle throttle(clock);
+	throttle.configure(60);
+
+	throttle.wait();
+	throttle.wait();
+	double start = clock.t;
+	throttle.configure(30);
+	throttle.wait();
+	double first = clock.t - start;
+	throttle.wait();
+	double second = clock.t - start;
+	CHECK(fabs(first - 1.0 / 60) < 0.0002);
+	CHECK(fabs(second - (1.0 / 60 + 1.0 / 30)) < 0.0002);
+}
+
+int main()
+{
+	TestSchedule();
+	TestOversleep();
+	TestMaxBlock();
+	TestStall();
+	TestConfigure();
+
+	if(failures)
+	{
+		printf("%d checks failed\n", failures);
+		return 1;
+	}
+	printf("all passed\n");
+	return 0;
+}
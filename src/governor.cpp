@@ -0,0 +1,98 @@
+/* FCE Ultra - NES/Famicom Emulator
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "governor.h"
+
+//share of the budget above which frames count as overloaded, and below which as calm
+#define GOV_HIGH_LOAD      0.90
+#define GOV_LOW_LOAD       0.55
+
+#define GOV_DOWN_FRAMES    30    //half a second of overload steps down
+#define GOV_UP_FRAMES      600   //ten calm seconds step back up
+#define GOV_UP_FRAMES_MAX  9600
+#define GOV_COOLDOWN       120   //let caches and the averages settle after a change
+
+QualityGovernor::QualityGovernor()
+	: budget(1.0/60)
+	, levels(0)
+{
+	reset();
+}
+
+void QualityGovernor::configure(double budget, int levels)
+{
+	this->budget = budget;
+	this->levels = levels;
+	reset();
+}
+
+void QualityGovernor::reset()
+{
+	level = 0;
+	load = 0;
+	overCount = underCount = 0;
+	cooldown = GOV_COOLDOWN;
+	upDelay = GOV_UP_FRAMES;
+	sinceUp = GOV_UP_FRAMES_MAX;
+}
+
+int QualityGovernor::update(double frameTime)
+{
+	if(budget <= 0)
+		return NONE;
+
+	//a single slow frame (a savestate, a window being dragged) shouldn't trigger anything,
+	//so judge the average
+	load += (frameTime / budget - load) / 8;
+
+	if(sinceUp < GOV_UP_FRAMES_MAX)
+		sinceUp++;
+
+	if(cooldown)
+	{
+		cooldown--;
+		return NONE;
+	}
+
+	overCount = load > GOV_HIGH_LOAD ? overCount + 1 : 0;
+	underCount = load < GOV_LOW_LOAD ? underCount + 1 : 0;
+
+	if(overCount >= GOV_DOWN_FRAMES && level < levels)
+	{
+		//if the last step up was undone this quickly, wait longer before trying again
+		if(sinceUp < upDelay)
+		{
+			upDelay *= 2;
+			if(upDelay > GOV_UP_FRAMES_MAX) upDelay = GOV_UP_FRAMES_MAX;
+		}
+		level++;
+		overCount = underCount = 0;
+		cooldown = GOV_COOLDOWN;
+		return STEP_DOWN;
+	}
+
+	if(underCount >= upDelay && level > 0)
+	{
+		level--;
+		overCount = underCount = 0;
+		cooldown = GOV_COOLDOWN;
+		sinceUp = 0;
+		return STEP_UP;
+	}
+
+	return NONE;
+}
@@ -0,0 +1,48 @@
+#ifndef _GOVERNOR_H_
+#define _GOVERNOR_H_
+
+//Adaptive quality governor.
+//
+//The driver reports how long each frame took to emulate and present, excluding the time
+//spent waiting for the throttle, and the governor compares that with the frame budget.
+//When frames keep running over it asks for one step of cheaper quality; after a long calm
+//stretch it asks to give one step back. What a step is (scaler, sound quality, PPU) is up
+//to the driver. No clock is read here, so it can be driven by a simulated one.
+class QualityGovernor
+{
+public:
+	enum { NONE = 0, STEP_DOWN = -1, STEP_UP = 1 };
+
+	QualityGovernor();
+
+	//budget: seconds per frame. levels: how many steps the driver can take down from full quality
+	void configure(double budget, int levels);
+	void reset();
+
+	//call once per presented frame. returns STEP_DOWN or STEP_UP when the driver should change
+	//quality by one step (the level has already been updated), otherwise NONE
+	int update(double frameTime);
+
+	//0 = full quality, getLevels() = cheapest
+	int getLevel() const { return level; }
+	int getLevels() const { return levels; }
+
+	//changes how far down the driver can currently go, without forgetting the history
+	void setLevels(int levels) { this->levels = levels; }
+
+	//averaged share of the budget used per frame
+	double getLoad() const { return load; }
+
+private:
+	double budget;
+	int levels;
+	int level;
+	double load;
+	int overCount;   //consecutive frames with load above the step down threshold
+	int underCount;  //consecutive frames with load below the step up threshold
+	int cooldown;    //frames to wait after a change before judging again
+	int upDelay;     //calm frames required before stepping up, grows if stepping up didn't last
+	int sinceUp;     //frames since the last step up
+};
+
+#endif
@@ -32,6 +32,8 @@
 #include "vsuni.h"
 #include "fds.h"
 #include "driver.h"
+#include "latency.h"
+#include "perftrace.h"
 
 #ifdef WIN32
 #include "drivers/win/main.h"
@@ -105,8 +107,17 @@ FCPORT portFC;
 FILE* DumpInputFile;
 FILE* PlayInputFile;
 
+//late input polling: the frame's input is fixed at the game's first controller access
+static bool lateInputPoll = false;
+static bool inputPending = false;
+
 static DECLFR(JPRead)
 {
+	if(inputPending && !fceuindbg)
+		FCEU_LatchPendingInput();
+	if(!fceuindbg)
+		FCEU_LatencyInputRead();
+
 	lagFlag = 0;
 	uint8 ret=0;
 	static bool microphone = false;
@@ -150,6 +161,9 @@ static DECLFR(JPRead)
 
 static DECLFW(B4016)
 {
+	if(inputPending && !fceuindbg)
+		FCEU_LatchPendingInput();
+
 	if(portFC.driver)
 		portFC.driver->Write(V&7);
 
@@ -363,8 +377,11 @@ void FCEU_DrawInput(uint8 *buf)
 }
 
 
-void FCEU_UpdateInput(void)
+//polls the input drivers and fixes this frame's input, for the movie and netplay as well
+static void LatchInput(void)
 {
+	inputPending = false;
+
 	//tell all drivers to poll input and set up their logical states
 	if(!FCEUMOV_Mode(MOVIEMODE_PLAY))
 	{
@@ -372,11 +389,9 @@ void FCEU_UpdateInput(void)
 			joyports[port].driver->Update(port,joyports[port].ptr,joyports[port].attrib);
 		}
 		portFC.driver->Update(portFC.ptr,portFC.attrib);
+		FCEU_LatencyInputLatched(joy);
 	}
 
-	if(GameInfo->type==GIT_VSUNI)
-		if(coinon) coinon--;
-
 	if(FCEUnetplay)
 		NetplayUpdate(joy);
 
@@ -388,8 +403,61 @@ void FCEU_UpdateInput(void)
 	}
 }
 
+//a light gun's aim is checked against the picture on every scanline from the state fixed for the
+//frame, so it has to be fixed before the frame is drawn, or the lines above the first read would
+//see the last frame's aim, and a movie would replay them differently
+static bool LightGunAttached(void)
+{
+	return joyports[0].type==SI_ZAPPER || joyports[1].type==SI_ZAPPER || portFC.type==SIFC_SHADOW;
+}
+
+void FCEU_UpdateInput(void)
+{
+	PerfScope perf(PERF_INPUT);
+
+	if(GameInfo->type==GIT_VSUNI)
+		if(coinon) coinon--;
+
+	//movie playback, TAS Editor and netplay may power, reset or load state along with the input,
+	//which can't happen in the middle of a frame. the NSF player reads joy on its own.
+	if(lateInputPoll && !FCEUnetplay && GameInfo->type!=GIT_NSF && !LightGunAttached() && FCEUMOV_Mode(MOVIEMODE_INACTIVE|MOVIEMODE_RECORD|MOVIEMODE_FINISHED))
+	{
+		inputPending = true;
+		return;
+	}
+
+	LatchInput();
+}
+
+//with late input polling, asks the driver for fresh input and fixes it for the rest of the frame.
+//called on the game's first controller access, and at the end of a frame that had none.
+void FCEU_LatchPendingInput(void)
+{
+	if(!inputPending)
+		return;
+
+	PerfScope perf(PERF_INPUT);
+	FCEUD_UpdateInputLate();
+	LatchInput();
+}
+
+void FCEUI_SetLateInputPoll(bool enable)
+{
+	lateInputPoll = enable;
+}
+
+bool FCEUI_GetLateInputPoll(void)
+{
+	return lateInputPoll;
+}
+
 static DECLFR(VSUNIRead0)
 {
+	if(inputPending && !fceuindbg)
+		FCEU_LatchPendingInput();
+	if(!fceuindbg)
+		FCEU_LatencyInputRead();
+
 	lagFlag = 0;
 	uint8 ret=0;
 
@@ -403,6 +471,11 @@ static DECLFR(VSUNIRead0)
 
 static DECLFR(VSUNIRead1)
 {
+	if(inputPending && !fceuindbg)
+		FCEU_LatchPendingInput();
+	if(!fceuindbg)
+		FCEU_LatencyInputRead();
+
 	lagFlag = 0;
 	uint8 ret=0;
 
@@ -730,6 +803,8 @@ static void FCEUI_DoExit(void);
 void ToggleFullscreen();
 static void TaseditorRewindOn(void);
 static void TaseditorRewindOff(void);
+static void RewindOn(void);
+static void RewindOff(void);
 static void TaseditorCommand(void);
 extern void FCEUI_ToggleShowFPS();
 
@@ -751,6 +826,8 @@ struct EMUCMDTABLE FCEUI_CommandTable[]=
 	{ EMUCMD_CLOSEROM,						EMUCMDTYPE_TOOL,	CloseRom,						0, 0, "Close ROM", 0},
 	{ EMUCMD_MISC_UNDOREDOSAVESTATE,		EMUCMDTYPE_MISC,	UndoRedoSavestate,				0, 0, "Undo/Redo Savestate", 0},
 	{ EMUCMD_MISC_TOGGLEFULLSCREEN,			EMUCMDTYPE_MISC,	ToggleFullscreen,				0, 0, "Toggle Fullscreen",	0},
+	{ EMUCMD_MISC_REWIND,					EMUCMDTYPE_MISC,	RewindOn,						RewindOff, 0, "Rewind", 0},
+	{ EMUCMD_MOVIE_SEEK,					EMUCMDTYPE_MOVIE,	FCEUD_MovieSeekTo,				0, 0, "Seek Movie to Frame", 0},
 };
 
 #define NUM_EMU_CMDS		(sizeof(FCEUI_CommandTable)/sizeof(FCEUI_CommandTable[0]))
@@ -804,6 +881,16 @@ static void ViewSlots(void)
 	FCEUI_SelectState(CurrentState, 1);
 }
 
+static void RewindOn(void)
+{
+	FCEUI_SetRewinding(true);
+}
+
+static void RewindOff(void)
+{
+	FCEUI_SetRewinding(false);
+}
+
 static void CommandSelectSaveSlot(void)
 {
 	if (FCEUMOV_Mode(MOVIEMODE_TASEDITOR))
@@ -97,6 +97,7 @@ extern struct FCPORT
 
 void FCEU_DrawInput(uint8 *buf);
 void FCEU_UpdateInput(void);
+void FCEU_LatchPendingInput(void);
 void InitializeInput(void);
 void FCEU_UpdateBot(void);
 extern void (*PStrobe[2])(void);
@@ -248,6 +249,9 @@ enum EMUCMD
 	EMUCMD_MOVIE_RECORD_MODE_OVERWRITE,
 	EMUCMD_MOVIE_RECORD_MODE_INSERT,
 
+	EMUCMD_MISC_REWIND,
+	EMUCMD_MOVIE_SEEK,
+
 	EMUCMD_MAX
 };
 
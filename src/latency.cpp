@@ -0,0 +1,399 @@
+/* FCE Ultra - NES/Famicom Emulator
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "latency.h"
+#include "fceu.h"
+#include "video.h"
+#include "x6502.h"
+#include "movie.h"
+#include "netplay.h"
+#include "driver.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#define LT_TIMEOUT  120  //frames to wait for a read, and then for the picture to respond
+
+LatencyProbe::LatencyProbe()
+{
+	reset();
+}
+
+void LatencyProbe::reset()
+{
+	stage = IDLE;
+	samples.clear();
+	haveHash = false;
+	lastHash = 0;
+	ignored = unread = unanswered = 0;
+}
+
+void LatencyProbe::inputChanged(double t, uint32 frame)
+{
+	if(stage != IDLE)
+	{
+		ignored++;
+		return;
+	}
+
+	cur.event = t;
+	cur.eventFrame = frame;
+	stage = WAIT_READ;
+}
+
+void LatencyProbe::inputRead(double t, uint32 frame, uint32 cycle)
+{
+	if(stage != WAIT_READ)
+		return;
+
+	cur.read = t;
+	cur.readFrame = frame;
+	cur.readCycle = cycle;
+	stage = WAIT_RENDER;
+}
+
+void LatencyProbe::frameShown(double t, uint32 frame, uint64 hash)
+{
+	bool changed = haveHash && hash != lastHash;
+	lastHash = hash;
+	haveHash = true;
+
+	//the driver didn't present the response (or doesn't present at all)
+	if(stage == WAIT_PRESENT)
+	{
+		cur.present = -1;
+		finish();
+	}
+
+	if(stage == WAIT_READ && frame - cur.eventFrame > LT_TIMEOUT)
+	{
+		unread++;
+		stage = IDLE;
+	}
+	else if(stage == WAIT_RENDER)
+	{
+		if(changed)
+		{
+			cur.render = t;
+			cur.renderFrame = frame;
+			stage = WAIT_PRESENT;
+		}
+		else if(frame - cur.readFrame > LT_TIMEOUT)
+		{
+			unanswered++;
+			stage = IDLE;
+		}
+	}
+}
+
+void LatencyProbe::presented(double t)
+{
+	if(stage != WAIT_PRESENT)
+		return;
+
+	cur.present = t;
+	finish();
+}
+
+void LatencyProbe::finish()
+{
+	samples.push_back(cur);
+	stage = IDLE;
+}
+
+static void AppendStats(std::string &out, const char *name, std::vector<double> &v, double scale, const char *unit)
+{
+	char line[160];
+	if(v.empty())
+	{
+		sprintf(line, "%-16s      no samples\n", name);
+		out += line;
+		return;
+	}
+
+	std::sort(v.begin(), v.end());
+	double mean = 0;
+	for(size_t i = 0; i < v.size(); i++)
+		mean += v[i];
+	mean /= v.size();
+
+	sprintf(line, "%-16s %6d %9.2f %9.2f %9.2f %9.2f %9.2f %s\n", name, (int)v.size(),
+		v.front() * scale, v[v.size() / 2] * scale, v[(v.size() - 1) * 95 / 100] * scale,
+		v.back() * scale, mean * scale, unit);
+	out += line;
+}
+
+std::string LatencyProbe::report() const
+{
+	std::vector<double> eventRead, readRender, renderPresent, total, readFrames, renderFrames, readCycles;
+	for(size_t i = 0; i < samples.size(); i++)
+	{
+		const Sample &s = samples[i];
+		eventRead.push_back(s.read - s.event);
+		readRender.push_back(s.render - s.read);
+		if(s.present >= 0)
+		{
+			renderPresent.push_back(s.present - s.render);
+			total.push_back(s.present - s.event);
+		}
+		readFrames.push_back(s.readFrame - s.eventFrame);
+		renderFrames.push_back(s.renderFrame - s.readFrame);
+		readCycles.push_back(s.readCycle);
+	}
+
+	std::string out;
+	char line[160];
+	sprintf(line, "%-16s %6s %9s %9s %9s %9s %9s\n", "stage", "count", "min", "median", "p95", "max", "mean");
+	out += line;
+	AppendStats(out, "event->read", eventRead, 1000, "ms");
+	AppendStats(out, "read->render", readRender, 1000, "ms");
+	AppendStats(out, "render->present", renderPresent, 1000, "ms");
+	AppendStats(out, "event->present", total, 1000, "ms");
+	AppendStats(out, "read frame", readFrames, 1, "frames after the change");
+	AppendStats(out, "read cycle", readCycles, 1, "cpu cycles into the frame");
+	AppendStats(out, "render frame", renderFrames, 1, "frames after the read");
+	sprintf(line, "ignored %d (in flight), unread %d, unanswered %d\n", ignored, unread, unanswered);
+	out += line;
+	return out;
+}
+
+//-----------------------------------------------------------------------------
+
+//a step of an input script: the buttons pad 1 holds from frame on
+struct ScriptStep
+{
+	uint32 frame;
+	uint8 buttons;
+};
+
+static LatencyProbe probe;
+static bool active = false;
+static int scriptPeriod;     //frames between scripted changes, 0 for host input
+static uint8 scriptButtons;
+static std::vector<ScriptStep> script; //from a file, in frame order, instead of the period
+static size_t scriptNext;
+static uint8 scriptHeld;
+static uint32 frameCount;
+static uint8 lastJoy[4];
+static double lastPoll;
+static bool polled;
+
+static double Now()
+{
+	return (double)FCEUD_GetTime() / FCEUD_GetTimeFreq();
+}
+
+void FCEUI_LatencyStart(int period, uint8 buttons)
+{
+	probe.reset();
+	active = true;
+	scriptPeriod = period > 0 ? period : 0;
+	scriptButtons = buttons;
+	script.clear();
+	frameCount = 0;
+	memset(lastJoy, 0, sizeof(lastJoy));
+	polled = false;
+}
+
+bool FCEUI_LatencyStop(const char *reportPath)
+{
+	if(!active)
+		return false;
+	active = false;
+
+	std::string text = probe.report();
+	if(!reportPath)
+	{
+		FCEU_printf("%s", text.c_str());
+		return true;
+	}
+
+	FILE *fp = FCEUD_UTF8fopen(reportPath, "w");
+	if(!fp)
+		return false;
+	fputs(text.c_str(), fp);
+	fclose(fp);
+	return true;
+}
+
+bool FCEUI_LatencyActive(void)
+{
+	return active;
+}
+
+void FCEUI_LatencyInputPolled(void)
+{
+	if(!active)
+		return;
+	lastPoll = Now();
+	polled = true;
+}
+
+void FCEUI_LatencyPresented(void)
+{
+	if(active)
+		probe.presented(Now());
+}
+
+void FCEU_LatencyInputLatched(uint8 *joy)
+{
+	if(!active)
+		return;
+
+	//scripted presses go to the game only: a movie being recorded or netplay would take them for the
+	//player's, so there's no script while either runs
+	bool scripted = (scriptPeriod || !script.empty()) && FCEUMOV_Mode(MOVIEMODE_INACTIVE) && !FCEUnetplay;
+
+	double t;
+	if(scripted && !script.empty())
+	{
+		while(scriptNext < script.size() && script[scriptNext].frame <= frameCount)
+			scriptHeld = script[scriptNext++].buttons;
+		joy[0] = scriptHeld;
+		t = Now();
+	}
+	else if(scripted)
+	{
+		//hold the buttons for one period, release them for the next
+		if((frameCount / scriptPeriod) & 1)
+			joy[0] |= scriptButtons;
+		else
+			joy[0] &= ~scriptButtons;
+		t = Now();
+	}
+	else
+		t = polled ? lastPoll : Now();
+
+	if(memcmp(joy, lastJoy, sizeof(lastJoy)))
+	{
+		memcpy(lastJoy, joy, sizeof(lastJoy));
+		probe.inputChanged(t, frameCount);
+	}
+}
+
+void FCEU_LatencyInputRead(void)
+{
+	if(active)
+		probe.inputRead(Now(), frameCount, timestamp);
+}
+
+void FCEU_LatencyFrameShown(void)
+{
+	if(!active)
+		return;
+
+	//FNV-1a over the visible picture
+	uint64 hash = 14695981039346656037ULL;
+	for(int i = 0; i < 256 * 240; i++)
+		hash = (hash ^ XBuf[i]) * 1099511628211ULL;
+
+	probe.frameShown(Now(), frameCount, hash);
+	frameCount++;
+}
+
+//-----------------------------------------------------------------------------
+
+static bool ReadScript(const char *path, std::vector<ScriptStep> &steps)
+{
+	FILE *fp = FCEUD_UTF8fopen(path, "r");
+	if(!fp)
+		return false;
+
+	static const char names[] = "ABSTUDLR"; //bit 0 first; FM2 writes them the other way round
+	bool ok = true;
+	char line[256];
+	while(ok && fgets(line, sizeof(line), fp))
+	{
+		char *p = line;
+		while(*p == ' ' || *p == '\t')
+			p++;
+		if(*p == '#' || *p == '\r' || *p == '\n' || !*p)
+			continue;
+
+		char *end;
+		long frame = strtol(p, &end, 10);
+		if(end == p || frame < 0 || (!steps.empty() && (uint32)frame < steps.back().frame))
+		{
+			ok = false;
+			break;
+		}
+
+		ScriptStep step;
+		step.frame = (uint32)frame;
+		step.buttons = 0;
+		for(p = end; *p && *p != '#' && *p != '\r' && *p != '\n'; p++)
+		{
+			const char *b = strchr(names, *p);
+			if(b)
+				step.buttons |= 1 << (b - names);
+			else if(*p != ' ' && *p != '\t' && *p != '.')
+				ok = false;
+		}
+		steps.push_back(step);
+	}
+
+	fclose(fp);
+	return ok;
+}
+
+extern int EnableAutosave;
+extern int disableBatteryLoading;
+extern int disableBatterySaving;
+
+bool FCEUI_MeasureLatencyScript(const char *rom, const char *scriptPath, const char *report)
+{
+	std::vector<ScriptStep> steps;
+	if(!ReadScript(scriptPath, steps) || steps.empty())
+	{
+		FCEU_printf("Latency measurement: can't read the input script %s\n", scriptPath);
+		return false;
+	}
+
+	//nothing the run does may reach the disk
+	EnableAutosave = 0;
+	disableBatteryLoading = 1;
+	disableBatterySaving = 1;
+	FCEUI_SetAutoResume(false, 0);
+	FCEUI_SetRewind(false, 1, 1);
+
+	if(!FCEUI_LoadGame(rom, 1, true))
+	{
+		FCEU_printf("Latency measurement: can't load %s\n", rom);
+		return false;
+	}
+
+	FCEUI_LatencyStart();
+	script.swap(steps);
+	scriptNext = 0;
+	scriptHeld = 0;
+
+	//long enough for the last change to be read and answered. the frames are emulated as fast as
+	//they go and never presented, so the frame and cycle counts are what the report is for
+	uint32 frames = script.back().frame + 2 * LT_TIMEOUT + 1;
+	FCEUI_SetEmulationPaused(0);
+	while(frameCount < frames && FCEUI_EmulateHidden())
+		FCEU_LatencyFrameShown();
+
+	bool ok = FCEUI_LatencyStop(report);
+	script.clear();
+	FCEUI_CloseGame();
+	if(!ok)
+		FCEU_printf("Latency measurement: can't write %s\n", report);
+	return ok;
+}
@@ -0,0 +1,71 @@
+#ifndef _LATENCY_H_
+#define _LATENCY_H_
+
+#include "types.h"
+
+#include <string>
+#include <vector>
+
+//Input-to-photon latency measurement.
+//
+//Follows one controller change at a time through four points: when the driver read it from the
+//host, when the game first read it through $4016/$4017, the first shown frame whose picture
+//differs from the one before (taken as the game's response), and when the driver presented that
+//frame. Collects the times between them and reports their distribution. No clock is read here,
+//so it can be driven by a simulated one.
+class LatencyProbe
+{
+public:
+	LatencyProbe();
+	void reset();
+
+	//t: host time in seconds. frame: index of the frame being emulated
+
+	//the controllers changed. starts a sample unless one is still in flight
+	void inputChanged(double t, uint32 frame);
+
+	//the game read its controllers. cycle: CPU cycles into the frame
+	void inputRead(double t, uint32 frame, uint32 cycle);
+
+	//a frame is about to be shown. hash: of its picture
+	void frameShown(double t, uint32 frame, uint64 hash);
+
+	//the driver presented the last shown frame
+	void presented(double t);
+
+	int getSamples() const { return (int)samples.size(); }
+
+	//a table of the measured latencies, one line per stage
+	std::string report() const;
+
+private:
+	enum { IDLE, WAIT_READ, WAIT_RENDER, WAIT_PRESENT };
+
+	struct Sample
+	{
+		double event, read, render, present; //present < 0 if the driver never reported it
+		uint32 eventFrame, readFrame, readCycle, renderFrame;
+	};
+
+	void finish();
+
+	int stage;
+	Sample cur;
+	std::vector<Sample> samples;
+	uint64 lastHash;
+	bool haveHash;
+	int ignored;    //changes while a sample was in flight
+	int unread;     //changes the game never read
+	int unanswered; //reads the picture never responded to
+};
+
+//core hooks, they do nothing unless a measurement is running
+
+//the input drivers just updated joy. injects the scripted input if there is one
+void FCEU_LatencyInputLatched(uint8 *joy);
+//the game reads $4016/$4017
+void FCEU_LatencyInputRead(void);
+//XBuf holds the picture of a frame about to be shown
+void FCEU_LatencyFrameShown(void);
+
+#endif
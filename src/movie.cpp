@@ -11,6 +11,9 @@
 #include "file.h"
 #include "video.h"
 #include "movie.h"
+#include "movieindex.h"
+#include "statewriter.h"
+#include "moviewriter.h"
 #include "cart.h"
 #include "fds.h"
 #include "vsuni.h"
@@ -41,6 +44,8 @@ extern int RAMInitSeed;
 #include <fstream>
 #include <climits>
 #include <cstdarg>
+#include <algorithm>
+#include <iterator>
 
 using namespace std;
 
@@ -80,9 +85,8 @@ bool suppressMovieStop=false;
 //----movie engine main state
 EMOVIEMODE movieMode = MOVIEMODE_INACTIVE;
 
-//this should not be set unless we are in MOVIEMODE_RECORD!
-//FILE* fpRecordingMovie = 0;
-EMUFILE* osRecordingMovie = NULL;
+//this should not be open unless we are in MOVIEMODE_RECORD!
+static MovieWriter recordingWriter;
 
 int currFrameCounter;
 uint32 cur_input_display = 0;
@@ -94,6 +98,17 @@ int rerecord_display = 0;
 bool fullSaveStateLoads = false;	//Option for loading a savestates full contents in read+write mode instead of up to the frame count in the savestate (useful as a recovery option)
 int movieRecordMode = 0;			//Option for various movie recording modes such as TRUNCATE (normal), OVERWRITE etc.
 
+static bool recordStateDigests = false;
+static FCEUStateDigest frameDigest;	//this frame's, taken by FCEUMOV_FrameStart()
+static bool haveFrameDigest = false;
+static bool digestsDiverged = false;	//the last frame checked didn't match, so it's been reported
+
+static MovieKeyframeIndex keyframes;	//snapshots of the movie being played, to seek from
+static bool keyframesEnabled = false;
+static bool keyframeSidecar = false;	//keep them in a file beside the movie between sessions
+static bool keyframesChanged = false;	//since they were read from the sidecar
+static StateWriter sidecarWriter;
+
 SFORMAT FCEUMOV_STATEINFO[]={
 	{ &currFrameCounter, 4|FCEUSTATE_RLSB, "FCNT"},
 	{ 0 }
@@ -110,25 +125,17 @@ void MovieData::clearRecordRange(int start, int len)
 {
 	for(int i=0;i<len;i++)
 	{
-		records[i+start].clear();
+		records.set(i+start, MovieRecord());
 	}
+	inputChangedFrom(start);
 }
 
 void MovieData::eraseRecords(int at, int frames)
 {
-	if (at < (int)records.size())
+	if (at < records.size())
 	{
-		if (frames == 1)
-		{
-			// erase 1 frame
-			records.erase(records.begin() + at);
-		} else
-		{
-			// erase many frames
-			if (at + frames > (int)records.size())
-				frames = (int)records.size() - at;
-			records.erase(records.begin() + at, records.begin() + (at + frames));
-		}
+		inputChangedFrom(at);
+		records.erase(at, frames);
 	}
 }
 
@@ -139,7 +146,8 @@ void MovieData::insertEmpty(int at, int frames)
 		records.resize(records.size() + frames);
 	} else
 	{
-		records.insert(records.begin() + at, frames, MovieRecord());
+		records.insert(at, frames);
+		inputChangedFrom(at);
 	}
 }
 
@@ -147,10 +155,25 @@ void MovieData::cloneRegion(int at, int frames)
 {
 	if (at < 0) return;
 
-	records.insert(records.begin() + at, frames, MovieRecord());
+	records.insert(at, frames);
+	inputChangedFrom(at);
 
 	for(int i = 0; i < frames; i++)
-		records[i + at].Clone(records[i + at + frames]);
+		records.set(i + at, records.get(i + at + frames));
+}
+
+void MovieData::inputChangedFrom(int frame)
+{
+	if (frame >= 0 && frame < (int)digests.size())
+		digests.resize(frame);
+
+	if (this == &currMovieData && keyframes.getCount())
+	{
+		int count = keyframes.getCount();
+		keyframes.dropAfter(frame);
+		if (keyframes.getCount() != count)
+			keyframesChanged = true;
+	}
 }
 // ----------------------------------------------------------------------------
 MovieRecord::MovieRecord()
@@ -230,90 +253,109 @@ void MovieRecord::dumpJoy(EMUFILE* os, uint8 joystate)
 	}
 }
 
-void MovieRecord::parseJoy(EMUFILE* is, uint8& joystate)
+//extracts a decimal uint the way uint32DecFromIstream() does: whatever comes before the first digit
+//is skipped
+template<typename T> static T DecFromText(const char*& p, const char* end)
+{
+	while(p < end && (unsigned)(*p - '0') > 9)
+		p++;
+	T ret = 0;
+	while(p < end && (unsigned)(*p - '0') <= 9)
+		ret = ret * 10 + (*p++ - '0');
+	return ret;
+}
+
+void MovieRecord::parseJoy(const char*& p, const char* end, uint8& joystate)
 {
-	char buf[8];
-	is->fread(buf,8);
 	joystate = 0;
+	if(end - p >= 8)
+	{
+		for(int i=0;i<8;i++)
+			joystate = (joystate << 1) | ((p[i]=='.'||p[i]==' ')?0:1);
+		p += 8;
+		return;
+	}
 	for(int i=0;i<8;i++)
 	{
 		joystate <<= 1;
-		joystate |= ((buf[i]=='.'||buf[i]==' ')?0:1);
+		if(p < end)
+		{
+			joystate |= (*p=='.'||*p==' ')?0:1;
+			p++;
+		}
 	}
 }
 
-void MovieRecord::parse(MovieData* md, EMUFILE* is)
+void MovieRecord::parse(MovieData* md, const char*& p, const char* end)
 {
 	//by the time we get in here, the initial pipe has already been extracted
 
 	//extract the commands
-	commands = uint32DecFromIstream(is);
-	//*is >> commands;
-	is->fgetc(); //eat the pipe
+	commands = DecFromText<uint32>(p, end);
+	if(p < end) p++; //eat the pipe
 
 	//a special case: if fourscore is enabled, parse four gamepads
 	if(md->fourscore)
 	{
-		parseJoy(is,joysticks[0]); is->fgetc(); //eat the pipe
-		parseJoy(is,joysticks[1]); is->fgetc(); //eat the pipe
-		parseJoy(is,joysticks[2]); is->fgetc(); //eat the pipe
-		parseJoy(is,joysticks[3]); is->fgetc(); //eat the pipe
+		for(int i=0;i<4;i++)
+		{
+			parseJoy(p, end, joysticks[i]);
+			if(p < end) p++; //eat the pipe
+		}
 	}
 	else
 	{
 		for(int port=0;port<2;port++)
 		{
 			if(md->ports[port] == SI_GAMEPAD)
-				parseJoy(is, joysticks[port]);
+				parseJoy(p, end, joysticks[port]);
 			else if(md->ports[port] == SI_ZAPPER)
 			{
-				zappers[port].x = uint32DecFromIstream(is);
-				zappers[port].y = uint32DecFromIstream(is);
-				zappers[port].b = uint32DecFromIstream(is);
-				zappers[port].bogo = uint32DecFromIstream(is);
-				zappers[port].zaphit = uint64DecFromIstream(is);
+				zappers[port].x = DecFromText<uint32>(p, end);
+				zappers[port].y = DecFromText<uint32>(p, end);
+				zappers[port].b = DecFromText<uint32>(p, end);
+				zappers[port].bogo = DecFromText<uint32>(p, end);
+				zappers[port].zaphit = DecFromText<uint64>(p, end);
 			}
 
-			is->fgetc(); //eat the pipe
+			if(p < end) p++; //eat the pipe
 		}
 	}
 
 	//(no fcexp data is logged right now)
-	is->fgetc(); //eat the pipe
+	if(p < end) p++; //eat the pipe
 
 	//should be left at a newline
 }
 
 
-bool MovieRecord::parseBinary(MovieData* md, EMUFILE* is)
+//the caller makes sure a whole record is there
+void MovieRecord::parseBinary(MovieData* md, const uint8*& in)
 {
-	commands = (uint8)is->fgetc();
-
-	//check for eof
-	if(is->eof()) return false;
+	commands = *in++;
 
 	if(md->fourscore)
 	{
-		is->fread((char*)&joysticks,4);
+		for(int i=0;i<4;i++)
+			joysticks[i] = *in++;
 	}
 	else
 	{
 		for(int port=0;port<2;port++)
 		{
 			if(md->ports[port] == SI_GAMEPAD)
-				joysticks[port] = (uint8)is->fgetc();
+				joysticks[port] = *in++;
 			else if(md->ports[port] == SI_ZAPPER)
 			{
-				zappers[port].x = (uint8)is->fgetc();
-				zappers[port].y = (uint8)is->fgetc();
-				zappers[port].b = (uint8)is->fgetc();
-				zappers[port].bogo = (uint8)is->fgetc();
-				read64le(&zappers[port].zaphit,is);
+				zappers[port].x = *in++;
+				zappers[port].y = *in++;
+				zappers[port].b = *in++;
+				zappers[port].bogo = *in++;
+				zappers[port].zaphit = FCEU_de64lsb((uint8*)in);
+				in += 8;
 			}
 		}
 	}
-
-	return true;
 }
 
 
@@ -385,6 +427,257 @@ void MovieRecord::dump(MovieData* md, EMUFILE* os, int index)
 	os->fputc('\n');
 }
 
+// ----------------------------------------------------------------------------
+
+MovieRecordList::MovieRecordList()
+	: count(0)
+	, last(0)
+{
+}
+
+void MovieRecordList::clear()
+{
+	chunks.clear();
+	starts.clear();
+	count = 0;
+	last = 0;
+}
+
+void MovieRecordList::resize(int frames)
+{
+	if (frames <= 0)
+		clear();
+	else if (frames < count)
+		erase(frames, count - frames);
+	else
+		append(frames - count);
+}
+
+size_t MovieRecordList::find(int frame) const
+{
+	if (last < chunks.size() && frame >= starts[last] && frame - starts[last] < (int)chunks[last].pads.size())
+		return last;
+	last = (upper_bound(starts.begin(), starts.end(), frame) - starts.begin()) - 1;
+	return last;
+}
+
+size_t MovieRecordList::findExtra(const Chunk& chunk, int offset)
+{
+	size_t lo = 0, hi = chunk.extras.size();
+	while (lo < hi)
+	{
+		size_t mid = (lo + hi) / 2;
+		if (chunk.extras[mid].offset < offset)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+MovieRecord MovieRecordList::get(int frame) const
+{
+	MovieRecord rec;
+	get(frame, rec);
+	return rec;
+}
+
+void MovieRecordList::get(int frame, MovieRecord& rec) const
+{
+	size_t c = find(frame);
+	const Chunk& chunk = chunks[c];
+	int offset = frame - starts[c];
+
+	memcpy(rec.joysticks.data, &chunk.pads[offset], sizeof(uint32));
+	size_t e = findExtra(chunk, offset);
+	if (e < chunk.extras.size() && chunk.extras[e].offset == offset)
+	{
+		const Extra& extra = chunk.extras[e];
+		rec.commands = extra.commands;
+		for (int port = 0; port < 2; port++)
+		{
+			rec.zappers[port].x = extra.zapper[port][0];
+			rec.zappers[port].y = extra.zapper[port][1];
+			rec.zappers[port].b = extra.zapper[port][2];
+			rec.zappers[port].bogo = extra.zapper[port][3];
+			rec.zappers[port].zaphit = extra.zaphit[port];
+		}
+	} else
+	{
+		rec.commands = 0;
+		memset(rec.zappers, 0, sizeof(rec.zappers));
+	}
+}
+
+void MovieRecordList::set(int frame, const MovieRecord& rec)
+{
+	size_t c = find(frame);
+	Chunk& chunk = chunks[c];
+	int offset = frame - starts[c];
+
+	memcpy(&chunk.pads[offset], rec.joysticks.data, sizeof(uint32));
+
+	Extra extra;
+	extra.offset = offset;
+	extra.commands = rec.commands;
+	bool needed = rec.commands != 0;
+	for (int port = 0; port < 2; port++)
+	{
+		extra.zapper[port][0] = rec.zappers[port].x;
+		extra.zapper[port][1] = rec.zappers[port].y;
+		extra.zapper[port][2] = rec.zappers[port].b;
+		extra.zapper[port][3] = rec.zappers[port].bogo;
+		extra.zaphit[port] = rec.zappers[port].zaphit;
+		if (rec.zappers[port].x || rec.zappers[port].y || rec.zappers[port].b || rec.zappers[port].bogo || rec.zappers[port].zaphit)
+			needed = true;
+	}
+
+	size_t e = findExtra(chunk, offset);
+	bool present = e < chunk.extras.size() && chunk.extras[e].offset == offset;
+	if (present && needed)
+		chunk.extras[e] = extra;
+	else if (present)
+		chunk.extras.erase(chunk.extras.begin() + e);
+	else if (needed)
+		chunk.extras.insert(chunk.extras.begin() + e, extra);
+}
+
+void MovieRecordList::push_back(const MovieRecord& rec)
+{
+	append(1);
+	set(count - 1, rec);
+}
+
+//blank frames at the end, filling the last chunk first
+void MovieRecordList::append(int frames)
+{
+	while (frames > 0)
+	{
+		if (chunks.empty() || chunks.back().pads.size() >= CHUNK_FRAMES)
+		{
+			chunks.push_back(Chunk());
+			starts.push_back(count);
+		}
+		std::vector<uint32>& pads = chunks.back().pads;
+		int n = std::min(frames, CHUNK_FRAMES - (int)pads.size());
+		pads.resize(pads.size() + n, 0);
+		count += n;
+		frames -= n;
+	}
+}
+
+void MovieRecordList::insert(int at, int frames)
+{
+	if (frames <= 0)
+		return;
+	if (at >= count)
+	{
+		append(frames);
+		return;
+	}
+
+	size_t c = find(at);
+	Chunk& chunk = chunks[c];
+	int offset = at - starts[c];
+	chunk.pads.insert(chunk.pads.begin() + offset, frames, 0);
+	for (size_t e = findExtra(chunk, offset); e < chunk.extras.size(); e++)
+		chunk.extras[e].offset += frames;
+	count += frames;
+
+	split(c);
+	reindex(c);
+}
+
+void MovieRecordList::insert(int at, const MovieRecord& rec)
+{
+	insert(at, 1);
+	set(at, rec);
+}
+
+void MovieRecordList::erase(int at, int frames)
+{
+	if (at < 0 || at >= count)
+		return;
+	if (frames > count - at)
+		frames = count - at;
+
+	size_t first = find(at);
+	size_t c = first;
+	int offset = at - starts[c];
+	while (frames > 0)
+	{
+		Chunk& chunk = chunks[c];
+		int n = std::min(frames, (int)chunk.pads.size() - offset);
+		chunk.pads.erase(chunk.pads.begin() + offset, chunk.pads.begin() + offset + n);
+		size_t from = findExtra(chunk, offset);
+		size_t to = findExtra(chunk, offset + n);
+		chunk.extras.erase(chunk.extras.begin() + from, chunk.extras.begin() + to);
+		for (size_t e = from; e < chunk.extras.size(); e++)
+			chunk.extras[e].offset -= n;
+		count -= n;
+		frames -= n;
+
+		//what follows is at the start of the next chunk, which becomes this one if this one is gone
+		if (chunk.pads.empty())
+			chunks.erase(chunks.begin() + c);
+		else
+			c++;
+		offset = 0;
+	}
+
+	//the pieces left on either side of the erased frames go back together if they fit in one
+	if (c > 0 && c < chunks.size() && chunks[c - 1].pads.size() + chunks[c].pads.size() <= CHUNK_FRAMES)
+	{
+		Chunk& into = chunks[c - 1];
+		int base = (int)into.pads.size();
+		into.pads.insert(into.pads.end(), chunks[c].pads.begin(), chunks[c].pads.end());
+		for (size_t e = 0; e < chunks[c].extras.size(); e++)
+		{
+			into.extras.push_back(chunks[c].extras[e]);
+			into.extras.back().offset += base;
+		}
+		chunks.erase(chunks.begin() + c);
+	}
+
+	reindex(first > 0 ? first - 1 : 0);
+}
+
+//cuts an overgrown chunk into half-full ones, so the next few inserts don't cut it again
+void MovieRecordList::split(size_t c)
+{
+	if (chunks[c].pads.size() <= CHUNK_FRAMES)
+		return;
+
+	Chunk whole;
+	std::swap(whole, chunks[c]);
+	chunks.erase(chunks.begin() + c);
+
+	std::vector<Chunk> pieces;
+	const int half = CHUNK_FRAMES / 2;
+	size_t e = 0;
+	for (int at = 0; at < (int)whole.pads.size(); at += half)
+	{
+		int n = std::min(half, (int)whole.pads.size() - at);
+		pieces.push_back(Chunk());
+		Chunk& piece = pieces.back();
+		piece.pads.assign(whole.pads.begin() + at, whole.pads.begin() + at + n);
+		for (; e < whole.extras.size() && whole.extras[e].offset < at + n; e++)
+		{
+			piece.extras.push_back(whole.extras[e]);
+			piece.extras.back().offset -= at;
+		}
+	}
+	chunks.insert(chunks.begin() + c, make_move_iterator(pieces.begin()), make_move_iterator(pieces.end()));
+}
+
+void MovieRecordList::reindex(size_t from)
+{
+	starts.resize(chunks.size());
+	for (size_t c = from; c < chunks.size(); c++)
+		starts[c] = c ? starts[c - 1] + (int)chunks[c - 1].pads.size() : 0;
+	last = 0;
+}
+
 MovieData::MovieData()
 	: version(MOVIE_VERSION)
 	, emuVersion(FCEU_VERSION_NUMERIC)
@@ -404,6 +697,31 @@ MovieData::MovieData()
 void MovieData::truncateAt(int frame)
 {
 	records.resize(frame);
+	inputChangedFrom(frame);
+}
+
+//"digest" and the parts in hex, on a line of its own after the frame's record. other builds take
+//it for a header key they don't know, and skip it
+void MovieData::dumpDigest(EMUFILE* os, const FCEUStateDigest& digest)
+{
+	os->fprintf("digest");
+	for(int i=0;i<DIGEST_PARTS;i++)
+		os->fprintf(" %08X", digest.part[i]);
+	os->fputc('\n');
+}
+
+static bool ParseDigest(const std::string& val, FCEUStateDigest& digest)
+{
+	const char *p = val.c_str();
+	for(int i=0;i<DIGEST_PARTS;i++)
+	{
+		char *end;
+		digest.part[i] = (uint32)strtoul(p, &end, 16);
+		if(end == p)
+			return false;
+		p = end;
+	}
+	return true;
 }
 
 void MovieData::installValue(std::string& key, std::string& val)
@@ -471,11 +789,20 @@ void MovieData::installValue(std::string& key, std::string& val)
 	{
 		installInt(val, loadFrameCount);
 	}
+	else if (key == "digest")
+	{
+		//belongs to the record just read
+		FCEUStateDigest digest;
+		if(!records.empty() && ParseDigest(val, digest))
+		{
+			digests.resize(records.size());
+			digests.back() = digest;
+		}
+	}
 }
 
-int MovieData::dump(EMUFILE *os, bool binary, bool seekToCurrFramePos)
+void MovieData::dumpHeader(EMUFILE *os, bool binary)
 {
-	int start = os->ftell();
 	os->fprintf("version %d\n", version);
 	os->fprintf("emuVersion %d\n", emuVersion);
 	os->fprintf("rerecordCount %d\n", rerecordCount);
@@ -510,25 +837,33 @@ int MovieData::dump(EMUFILE *os, bool binary, bool seekToCurrFramePos)
 
 	if (this->loadFrameCount >= 0)
 		os->fprintf("length %d\n" , this->loadFrameCount);
+}
+
+int MovieData::dump(EMUFILE *os, bool binary, bool seekToCurrFramePos)
+{
+	int start = os->ftell();
+	dumpHeader(os, binary);
 
 	int currFramePos = -1;
 	if(binary)
 	{
 		//put one | to start the binary dump
 		os->fputc('|');
-		for (int i = 0; i < (int)records.size(); i++)
+		for (int i = 0; i < records.size(); i++)
 		{
 			if (seekToCurrFramePos && currFrameCounter == i)
 				currFramePos = os->ftell();
-			records[i].dumpBinary(this, os, i);
+			records.get(i).dumpBinary(this, os, i);
 		}
 	} else
 	{
-		for (int i = 0; i < (int)records.size(); i++)
+		for (int i = 0; i < records.size(); i++)
 		{
 			if (seekToCurrFramePos && currFrameCounter == i)
 				currFramePos = os->ftell();
-			records[i].dump(this, os, i);
+			records.get(i).dump(this, os, i);
+			if (i < (int)digests.size() && digests[i].isSet())
+				dumpDigest(os, digests[i]);
 		}
 	}
 
@@ -588,7 +923,7 @@ bool FCEUMOV_Mode(int modemask)
 	return FCEUMOV_Mode((EMOVIEMODE)modemask);
 }
 
-static void LoadFM2_binarychunk(MovieData& movieData, EMUFILE* fp, int size)
+static int BinaryRecordSize(MovieData& movieData)
 {
 	int recordsize = 1; //1 for the command
 	if(movieData.fourscore)
@@ -604,29 +939,98 @@ static void LoadFM2_binarychunk(MovieData& movieData, EMUFILE* fp, int size)
 			}
 		}
 	}
+	return recordsize;
+}
 
-	//find out how much remains in the file
-	int curr = fp->ftell();
-	fp->fseek(0,SEEK_END);
-	int end = fp->ftell();
-	int flen = end-curr;
-	fp->fseek(curr,SEEK_SET);
-
-	//the amount todo is the min of the limiting size we received and the remaining contents of the file
-	int todo = std::min(size, flen);
+static void LoadFM2_binarychunk(MovieData& movieData, const char*& p, const char* end)
+{
+	int recordsize = BinaryRecordSize(movieData);
 
-	int numRecords = todo/recordsize;
+	int numRecords = (int)((end - p) / recordsize);
 	if (movieData.loadFrameCount!=-1 && movieData.loadFrameCount<numRecords)
 		numRecords=movieData.loadFrameCount;
 
+	const uint8* in = (const uint8*)p;
+	MovieRecord rec;
 	movieData.records.resize(numRecords);
 	for(int i=0;i<numRecords;i++)
 	{
-		movieData.records[i].parseBinary(&movieData,fp);
+		rec.parseBinary(&movieData,in);
+		movieData.records.set(i,rec);
+	}
+	p = (const char*)in;
+}
+
+//the header and text records, from the start of a line. leaves p where reading stopped
+static bool ParseFM2(MovieData& movieData, const char*& p, const char* end, bool stopAfterHeader)
+{
+	std::string key,value;
+	for(;;)
+	{
+		while(p < end && (*p==' '||*p=='\t'))
+			p++;
+		if(p >= end)
+			return true;
+
+		char c = *p;
+		if(c=='\n'||c=='\r')
+		{
+			p++;
+			// exit prematurely if loaded the specified amound of records
+			if(movieData.loadFrameCount == (int)movieData.records.size())
+				return true;
+			continue;
+		}
+
+		if(c=='|')
+		{
+			p++;
+			if(stopAfterHeader)
+				return true;
+			if(movieData.binaryFlag)
+			{
+				LoadFM2_binarychunk(movieData, p, end);
+				return true;
+			}
+			MovieRecord rec;
+			rec.parse(&movieData, p, end);
+			movieData.records.push_back(rec);
+			continue;
+		}
+
+		//a key, then whitespace, then a value up to the end of the line
+		const char* nl = (const char*)memchr(p, '\n', end - p);
+		const char* lineEnd = nl ? nl : end;
+		const char* cr = (const char*)memchr(p, '\r', lineEnd - p);
+		if(cr) lineEnd = cr;
+
+		const char* k = p;
+		while(p < lineEnd && *p!=' ' && *p!='\t')
+			p++;
+		key.assign(k, p);
+		while(p < lineEnd && (*p==' '||*p=='\t'))
+			p++;
+		value.assign(p, lineEnd);
+
+		if(lineEnd == end)
+		{
+			//a last line cut off by the end of the data counts if it got as far as its value
+			p = end;
+			if(!value.empty())
+				movieData.installValue(key,value);
+			return true;
+		}
+
+		p = lineEnd + 1;
+		if(movieData.loadFrameCount == (int)movieData.records.size())
+			return true;
+		movieData.installValue(key,value);
 	}
 }
 
-//yuck... another custom text parser.
+//the part of fp that may be read, up to size bytes, is read in one go and parsed in memory, and
+//fp is left where the parser stopped. (it used to be read a character at a time, a virtual call
+//each, which kept hour-long movies loading for seconds)
 bool LoadFM2(MovieData& movieData, EMUFILE* fp, int size, bool stopAfterHeader)
 {
 	// if there's no "binary" tag in the movie header, consider it as a movie in text format
@@ -634,111 +1038,43 @@ bool LoadFM2(MovieData& movieData, EMUFILE* fp, int size, bool stopAfterHeader)
 	// Non-TASEditor projects consume until EOF
 	movieData.loadFrameCount = -1;
 
-	std::ios::pos_type curr = fp->ftell();
+	int start = fp->ftell();
+	fp->fseek(0,SEEK_END);
+	int avail = fp->ftell() - start;
+	fp->fseek(start,SEEK_SET);
+	if(size > avail)
+		size = avail;
+	if(size < 9)
+		return false;
 
-	if (!stopAfterHeader)
+	std::vector<char> text(size);
+	if((int)fp->fread(&text[0], size) != size)
 	{
-		// first, look for an fcm signature
-		char fcmbuf[3];
-		fp->fread(fcmbuf,3);
-		fp->fseek(curr,SEEK_SET);
-		if(!strncmp(fcmbuf,"FCM",3)) {
-			FCEU_PrintError("FCM File format is no longer supported. Please use Tools > Convert FCM");
-			return false;
-		}
+		fp->fseek(start,SEEK_SET);
+		return false;
 	}
+	const char* begin = &text[0];
+	const char* end = begin + size;
 
-	//movie must start with "version 3"
-	char buf[9];
-	curr = fp->ftell();
-	fp->fread(buf,9);
-	fp->fseek(curr,SEEK_SET);
-	if(fp->fail()) return false;
-	if(memcmp(buf,"version 3",9))
+	// first, look for an fcm signature
+	if (!stopAfterHeader && !strncmp(begin,"FCM",3))
+	{
+		fp->fseek(start,SEEK_SET);
+		FCEU_PrintError("FCM File format is no longer supported. Please use Tools > Convert FCM");
 		return false;
+	}
 
-	std::string key,value;
-	enum {
-		NEWLINE, KEY, SEPARATOR, VALUE, RECORD, COMMENT, SUBTITLE
-	} state = NEWLINE;
-	bool bail = false;
-	bool iswhitespace, isrecchar, isnewline;
-	int c;
-	for(;;)
+	//movie must start with "version 3"
+	if(memcmp(begin,"version 3",9))
 	{
-		if(size--<=0) goto bail;
-		c = fp->fgetc();
-		if(c == -1)
-			goto bail;
-		iswhitespace = (c==' '||c=='\t');
-		isrecchar = (c=='|');
-		isnewline = (c==10||c==13);
-		if(isrecchar && movieData.binaryFlag && !stopAfterHeader)
-		{
-			LoadFM2_binarychunk(movieData, fp, size);
-			return true;
-		} else if (isnewline && movieData.loadFrameCount == movieData.records.size())
-			// exit prematurely if loaded the specified amound of records
-			return true;
-		switch(state)
-		{
-		case NEWLINE:
-			if(isnewline) goto done;
-			if(iswhitespace) goto done;
-			if(isrecchar)
-				goto dorecord;
-			//must be a key
-			key = "";
-			value = "";
-			goto dokey;
-			break;
-		case RECORD:
-			{
-				dorecord:
-				if (stopAfterHeader) return true;
-				int currcount = movieData.records.size();
-				movieData.records.resize(currcount+1);
-				int preparse = fp->ftell();
-				movieData.records[currcount].parse(&movieData, fp);
-				int postparse = fp->ftell();
-				size -= (postparse-preparse);
-				state = NEWLINE;
-				break;
-			}
-
-		case KEY:
-			dokey: //dookie
-			state = KEY;
-			if(iswhitespace) goto doseparator;
-			if(isnewline) goto commit;
-			key += c;
-			break;
-		case SEPARATOR:
-			doseparator:
-			state = SEPARATOR;
-			if(isnewline) goto commit;
-			if(!iswhitespace) goto dovalue;
-			break;
-		case VALUE:
-			dovalue:
-			state = VALUE;
-			if(isnewline) goto commit;
-			value += c;
-		}
-		goto done;
-
-		bail:
-		bail = true;
-		if(state == VALUE) goto commit;
-		goto done;
-		commit:
-		movieData.installValue(key,value);
-		state = NEWLINE;
-		done: ;
-		if(bail) break;
+		fp->fseek(start,SEEK_SET);
+		return false;
 	}
 
-	return true;
+	const char* p = begin;
+	bool ok = ParseFM2(movieData, p, end, stopAfterHeader);
+	fp->fseek(start + (int)(p - begin), SEEK_SET);
+	return ok;
 }
 
 static const char *GetMovieModeStr()
@@ -778,52 +1114,124 @@ static const char *GetMovieRecordModeStr()
 	}
 }
 
-static EMUFILE *openRecordingMovie(const char* fname)
+//the writer works behind the emulation thread, so what it couldn't write is reported late
+static void ReportMovieWriteFailures()
 {
-	if (osRecordingMovie)
-		delete osRecordingMovie;
-
-	osRecordingMovie = FCEUD_UTF8_fstream(fname, "wb");
-	if (!osRecordingMovie || osRecordingMovie->fail()) {
-		FCEU_PrintError("Error opening movie output file: %s", fname);
-		return NULL;
-	}
-	strcpy(curMovieFilename, fname);
-
-	return osRecordingMovie;
+	std::vector<std::string> failed = recordingWriter.takeFailures();
+	for (size_t i = 0; i < failed.size(); i++)
+		FCEU_PrintError("Error writing movie file: %s", failed[i].c_str());
 }
 
 static void closeRecordingMovie()
 {
-	if (osRecordingMovie)
-	{
-		delete osRecordingMovie;
-		osRecordingMovie = 0;
-	}
+	recordingWriter.close();
+	ReportMovieWriteFailures();
 }
 
 // Callers shall set the approriate movieMode before calling this
 static void RedumpWholeMovieFile(bool justToggledRecording = false)
 {
 	bool recording = (movieMode == MOVIEMODE_RECORD);
-	assert((NULL != osRecordingMovie) == (recording != justToggledRecording) && "osRecordingMovie should be consistent with movie mode!");
+	assert(recordingWriter.isOpen() == (recording != justToggledRecording) && "the movie writer should be consistent with movie mode!");
 
-	if (NULL == openRecordingMovie(curMovieFilename))
-		return;
-
-	currMovieData.dump(osRecordingMovie, false/*currMovieData.binaryFlag*/, recording);
+	//the writer rewrites only the header and the frames that changed, if the file is the one it has open
+	recordingWriter.rewrite(curMovieFilename, currMovieData);
 	if (recording)
-		osRecordingMovie->fflush();
+		ReportMovieWriteFailures();
 	else
 		closeRecordingMovie();
 }
 
+static uint64 HashMore(uint64 hash, const void* data, size_t size)
+{
+	const uint8* p = (const uint8*)data;
+	for (size_t i = 0; i < size; i++)
+		hash = (hash ^ p[i]) * 1099511628211ULL;
+	return hash;
+}
+
+//what a sidecar was written for: the ROM, the build, and the movie's start and input
+static uint64 KeyframeSidecarKey()
+{
+	uint64 hash = 14695981039346656037ULL;
+	uint32 version = FCEU_VERSION_NUMERIC;
+	hash = HashMore(hash, GameInfo->MD5.data, sizeof(GameInfo->MD5.data));
+	hash = HashMore(hash, &version, sizeof(version));
+	hash = HashMore(hash, currMovieData.guid.data, sizeof(currMovieData.guid.data));
+	hash = HashMore(hash, &currMovieData.palFlag, sizeof(currMovieData.palFlag));
+	hash = HashMore(hash, &currMovieData.fourscore, sizeof(currMovieData.fourscore));
+	hash = HashMore(hash, currMovieData.ports, sizeof(currMovieData.ports));
+	if (!currMovieData.savestate.empty())
+		hash = HashMore(hash, &currMovieData.savestate[0], currMovieData.savestate.size());
+	if (!currMovieData.saveram.empty())
+		hash = HashMore(hash, &currMovieData.saveram[0], currMovieData.saveram.size());
+
+	MovieRecord rec;
+	for (int i = 0; i < currMovieData.records.size(); i++)
+	{
+		currMovieData.records.get(i, rec);
+		hash = HashMore(hash, &rec.joysticks, sizeof(rec.joysticks));
+		hash = HashMore(hash, &rec.commands, sizeof(rec.commands));
+		for (int port = 0; port < 2; port++)
+		{
+			hash = HashMore(hash, &rec.zappers[port].x, 4);	//x, y, b and bogo
+			hash = HashMore(hash, &rec.zappers[port].zaphit, sizeof(rec.zappers[port].zaphit));
+		}
+	}
+	return hash;
+}
+
+static bool KeyframeSidecarUsable()
+{
+	return keyframesEnabled && keyframeSidecar && GameInfo && curMovieFilename[0] && !FCEU_isFileInArchive(curMovieFilename);
+}
+
+static std::string KeyframeSidecarName()
+{
+	return std::string(curMovieFilename) + ".fki";
+}
+
+//called once a movie starts playing
+static void OpenKeyframes()
+{
+	keyframes.clear();
+	keyframesChanged = false;
+	if (!KeyframeSidecarUsable())
+		return;
+
+	//the last session with this movie may still be writing it
+	sidecarWriter.flush();
+
+	EMUFILE* is = FCEUD_UTF8_fstream(KeyframeSidecarName(), "rb");
+	if (!is)
+		return;
+	if (!is->fail() && keyframes.read(is, KeyframeSidecarKey()))
+		FCEU_printf("Read %d movie keyframes from %s\n", keyframes.getCount(), KeyframeSidecarName().c_str());
+	delete is;
+}
+
+//called when a movie stops
+static void CloseKeyframes()
+{
+	if (keyframesChanged && keyframes.getCount() && KeyframeSidecarUsable())
+	{
+		std::vector<uint8> image;
+		EMUFILE_MEMORY ms(&image);
+		keyframes.write(&ms, KeyframeSidecarKey());
+		image.resize(ms.size());
+		sidecarWriter.write(KeyframeSidecarName(), image);
+	}
+	keyframes.clear();
+	keyframesChanged = false;
+}
+
 /// Stop movie playback.
 static void StopPlayback()
 {
-	assert(movieMode != MOVIEMODE_RECORD && NULL == osRecordingMovie);
+	assert(movieMode != MOVIEMODE_RECORD && !recordingWriter.isOpen());
 
 	movieMode = MOVIEMODE_INACTIVE;
+	CloseKeyframes();
 	FCEU_DispMessageOnMovie("Movie playback stopped.");
 }
 
@@ -844,6 +1252,7 @@ static void StopRecording()
 
 	movieMode = MOVIEMODE_INACTIVE;
 	RedumpWholeMovieFile(true);
+	CloseKeyframes();
 	FCEU_DispMessage("Movie recording stopped.",0);
 }
 
@@ -1082,6 +1491,7 @@ bool FCEUI_LoadMovie(const char *fname, bool _read_only, int _pauseframe)
 	movieMode = MOVIEMODE_PLAY;
 	if (movieMode != MOVIEMODE_TASEDITOR)
 		currRerecordCount = currMovieData.rerecordCount;
+	OpenKeyframes();
 
 	if(movie_readonly)
 		FCEU_DispMessage("Replay started Read-Only.",0);
@@ -1113,6 +1523,74 @@ void FCEUI_SaveMovie(const char *fname, EMOVIE_FLAG flags, std::wstring author)
 }
 
 
+void FCEUI_SetMovieStateDigests(bool record)
+{
+	recordStateDigests = record;
+}
+
+void FCEUI_SetMovieKeyframes(bool enable, int interval, int budgetMB, bool sidecar)
+{
+	keyframesEnabled = enable;
+	keyframeSidecar = sidecar;
+	keyframes.configure((size_t)(budgetMB > 0 ? budgetMB : 1) << 20, interval);
+	if (!enable)
+		keyframes.clear();
+}
+
+void FCEUMOV_FrameStart()
+{
+	//a command given while recording has been carried out already, playback does it later on
+	if (keyframesEnabled
+		&& (movieMode == MOVIEMODE_PLAY || (movieMode == MOVIEMODE_RECORD && !_currCommand))
+		&& keyframes.wants(currFrameCounter))
+	{
+		static EMUFILE_MEMORY snapshot;
+		if (FCEUSS_SaveSnapshot(snapshot))
+		{
+			keyframes.add(currFrameCounter, snapshot.buf(), snapshot.size());
+			keyframesChanged = true;
+		}
+	}
+
+	haveFrameDigest = false;
+
+	bool wanted;
+	if (movieMode == MOVIEMODE_RECORD)
+		wanted = recordStateDigests;
+	else
+		wanted = movieMode == MOVIEMODE_PLAY && currFrameCounter < (int)currMovieData.digests.size();
+	if (!wanted)
+		return;
+
+	FCEUSS_Digest(frameDigest);
+	haveFrameDigest = true;
+}
+
+//reports the first frame of a desync, and again if the replay comes back in sync and loses it.
+//frames with a reset or power command aren't checked: recording carries those out as soon as
+//they're given, playback at the start of the frame
+static void CheckDigest(MovieRecord* mr)
+{
+	if (!haveFrameDigest || mr->commands || currFrameCounter >= (int)currMovieData.digests.size())
+		return;
+	const FCEUStateDigest& recorded = currMovieData.digests[currFrameCounter];
+	if (!recorded.isSet())
+		return;
+
+	int part = recorded.compare(frameDigest);
+	if (part < 0)
+	{
+		digestsDiverged = false;
+		return;
+	}
+	if (digestsDiverged)
+		return;
+	digestsDiverged = true;
+
+	FCEU_DispMessage("Desync at frame %d: %s state differs from the recording.", 0, currFrameCounter, FCEUSS_DigestPartName(part));
+	FCEU_printf("Movie desync at frame %d: %s state differs from the recording\n", currFrameCounter, FCEUSS_DigestPartName(part));
+}
+
 //the main interaction point between the emulator and the movie system.
 //either dumps the current joystick state or loads one state from the movie
 void FCEUMOV_AddInputState()
@@ -1124,7 +1602,8 @@ void FCEUMOV_AddInputState()
 		if (((int)currMovieData.records.size() - 1) < (currFrameCounter + 1))
 			currMovieData.insertEmpty(-1, (currFrameCounter + 1) - ((int)currMovieData.records.size() - 1));
 
-		MovieRecord* mr = &currMovieData.records[currFrameCounter];
+		MovieRecord rec = currMovieData.records.get(currFrameCounter);
+		MovieRecord* mr = &rec;
 		// replay buttons
 		joyports[0].load(mr);
 		joyports[1].load(mr);
@@ -1154,7 +1633,8 @@ void FCEUMOV_AddInputState()
 			portFC.driver->Update(portFC.ptr,portFC.attrib);
 		} else
 		{
-			MovieRecord* mr = &currMovieData.records[currFrameCounter];
+			MovieRecord rec = currMovieData.records.get(currFrameCounter);
+			MovieRecord* mr = &rec;
 
 			//reset and power cycle if necessary
 			if(mr->command_power())
@@ -1170,6 +1650,8 @@ void FCEUMOV_AddInputState()
 
 			joyports[0].load(mr);
 			joyports[1].load(mr);
+
+			CheckDigest(mr);
 		}
 
 		//if we are on the last frame, then pause the emulator if the player requested it
@@ -1200,11 +1682,10 @@ void FCEUMOV_AddInputState()
 			switch (movieRecordMode)
 			{
 			case MOVIE_RECORD_MODE_OVERWRITE:
-				currMovieData.records[currFrameCounter].Clone(mr);
+				currMovieData.records.set(currFrameCounter, mr);
 				break;
 			case MOVIE_RECORD_MODE_INSERT:
-				//FIXME: this could be very insufficient
-				currMovieData.records.insert(currMovieData.records.begin() + currFrameCounter, mr);
+				currMovieData.records.insert(currFrameCounter, mr);
 				break;
 			//case MOVIE_RECORD_MODE_TRUNCATE:
 			default:
@@ -1216,7 +1697,17 @@ void FCEUMOV_AddInputState()
 		else
 			currMovieData.records.push_back(mr);
 
-		mr.dump(&currMovieData, osRecordingMovie, currFrameCounter);	// to disk
+		//whatever followed this frame was recorded with other input
+		currMovieData.inputChangedFrom(currFrameCounter);
+		if (haveFrameDigest)
+		{
+			currMovieData.digests.resize(currFrameCounter);
+			currMovieData.digests.push_back(frameDigest);
+		}
+
+		//to disk, from the writer's thread
+		recordingWriter.record(currFrameCounter, movieRecordMode, mr, haveFrameDigest ? &frameDigest : NULL);
+		ReportMovieWriteFailures();
 	}
 
 	currFrameCounter++;
@@ -1285,13 +1776,30 @@ int CheckTimelines(MovieData& stateMovie, MovieData& currMovie)
 
 	for (int x = 0; x < end_frame; x++)
 	{
-		if (!stateMovie.records[x].Compare(currMovie.records[x]))
+		MovieRecord stateRec = stateMovie.records.get(x);
+		MovieRecord currRec = currMovie.records.get(x);
+		if (!stateRec.Compare(currRec))
 			return x;
 	}
 	// no mismatch found
 	return -1;
 }
 
+//the first frame with different input in the two movies, or the end of the shorter one
+static int FirstInputDifference(MovieData& a, MovieData& b)
+{
+	int end = std::min(a.records.size(), b.records.size());
+	MovieRecord recA, recB;
+	for (int x = 0; x < end; x++)
+	{
+		a.records.get(x, recA);
+		b.records.get(x, recB);
+		if (!recA.Compare(recB))
+			return x;
+	}
+	return end;
+}
+
 
 static bool load_successful;
 
@@ -1462,16 +1970,18 @@ bool FCEUMOV_ReadState(EMUFILE* is, uint32 size)
 		} else
 		{
 			//Read+Write mode
-			closeRecordingMovie();
+			//the file stays open while recording goes on, so the writer can rewrite it in place
+			bool wasRecording = (movieMode == MOVIEMODE_RECORD);
 
 			if (currFrameCounter > (int)tempMovieData.records.size())
 			{
 				//This is a post movie savestate, handle it differently
 				//Replace movie contents but then switch to movie finished mode
+				currMovieData.inputChangedFrom(FirstInputDifference(currMovieData, tempMovieData));
 				currMovieData = tempMovieData;
 				movieMode = MOVIEMODE_PLAY;
 				FCEUMOV_IncrementRerecordCount();
-				RedumpWholeMovieFile();
+				RedumpWholeMovieFile(wasRecording);
 				FinishPlayback();
 			} else
 			{
@@ -1480,10 +1990,11 @@ bool FCEUMOV_ReadState(EMUFILE* is, uint32 size)
 					//we can only assume this here since we have checked that the frame counter is not greater than the movie data
 					tempMovieData.truncateAt(currFrameCounter);
 				
+				currMovieData.inputChangedFrom(FirstInputDifference(currMovieData, tempMovieData));
 				currMovieData = tempMovieData;
 				movieMode = MOVIEMODE_RECORD;
 				FCEUMOV_IncrementRerecordCount();
-				RedumpWholeMovieFile(true);
+				RedumpWholeMovieFile(!wasRecording);
 			}
 		}
 	}
@@ -1652,8 +2163,7 @@ void FCEUI_MovieInsertFrame()
 	{
 		strcpy(message, "1 frame inserted");
 		strcat(message, GetMovieModeStr());
-		std::vector<MovieRecord>::iterator iter = currMovieData.records.begin();
-		currMovieData.records.insert(iter + currFrameCounter, MovieRecord());
+		currMovieData.insertEmpty(currFrameCounter, 1);
 		FCEUMOV_IncrementRerecordCount();
 		RedumpWholeMovieFile();
 	} else
@@ -1678,8 +2188,7 @@ void FCEUI_MovieDeleteFrame()
 	else if (movieMode == MOVIEMODE_RECORD || movieMode == MOVIEMODE_PLAY)
 	{
 		strcpy(message, "1 frame deleted");
-		std::vector<MovieRecord>::iterator iter = currMovieData.records.begin();
-		currMovieData.records.erase(iter + currFrameCounter);
+		currMovieData.eraseRecords(currFrameCounter);
 		FCEUMOV_IncrementRerecordCount();
 		RedumpWholeMovieFile();
 
@@ -1794,6 +2303,86 @@ void FCEUI_MoviePlayFromBeginning(void)
 #endif
 }
 
+//jumps to a frame of the movie: restores the last keyframe before it, unless playing on from where
+//the movie is gets there sooner, and emulates the rest unseen. the movie plays on read-only
+bool FCEUI_MovieSeek(int frame)
+{
+	if (movieMode != MOVIEMODE_PLAY && movieMode != MOVIEMODE_RECORD && movieMode != MOVIEMODE_FINISHED)
+		return false;
+	if (frame < 0 || frame > currMovieData.records.size())
+		return false;
+
+	if (movieMode == MOVIEMODE_RECORD)
+	{
+		movieMode = MOVIEMODE_PLAY;
+		RedumpWholeMovieFile(true);
+	}
+	movie_readonly = true;
+
+	//one before the target, so at least its frame is emulated and there's a picture of it
+	std::vector<uint8> state;
+	int at = 0;
+	bool haveKey = keyframesEnabled && keyframes.find(frame > 0 ? frame - 1 : 0, at, state);
+	if (frame < currFrameCounter || (haveKey && at > currFrameCounter))
+	{
+		if (haveKey)
+		{
+			EMUFILE_MEMORY ms(&state);
+			if (!FCEUSS_LoadSnapshot(ms))
+			{
+				keyframes.clear();
+				return false;
+			}
+			currFrameCounter = at;
+		}
+		else
+		{
+			//from the start, the way FCEUI_LoadMovie() begins it
+			poweron(true);
+			if (currMovieData.savestate.size())
+			{
+				//a plain savestate, with no movie in it for the one playing to be checked against
+				EMOVIEMODE mode = movieMode;
+				movieMode = MOVIEMODE_INACTIVE;
+				bool loaded = MovieData::loadSavestateFrom(&currMovieData.savestate);
+				movieMode = mode;
+				if (!loaded)
+				{
+					FCEU_DispMessage("Couldn't load the movie's starting savestate.",0);
+					return false;
+				}
+			}
+			else if (currMovieData.saveram.size())
+				MovieData::loadSaveramFrom(&currMovieData.saveram);
+			currFrameCounter = 0;
+		}
+	}
+
+	cur_input_display = 0;
+	digestsDiverged = false;
+	if (currFrameCounter < currMovieData.records.size())
+		movieMode = MOVIEMODE_PLAY;
+
+	//the frames on the way play unpaused, past the pause frame if it's among them
+	int paused = FCEUI_EmulationPaused();
+	int pauseAt = pauseframe;
+	FCEUI_SetEmulationPaused(0);
+	pauseframe = 0;
+	while (currFrameCounter < frame && FCEUI_EmulateHidden())
+		;
+	pauseframe = pauseAt > frame ? pauseAt : 0;
+	FCEUI_SetEmulationPaused(paused);
+
+	//paused, the emulator goes on showing the back buffer
+	if (paused)
+		FCEU_KeepBackBuffer();
+
+#ifdef WIN32
+	SetMainWindowText();
+#endif
+	return currFrameCounter == frame;
+}
+
 string FCEUI_GetMovieName(void)
 {
 	return curMovieFilename;
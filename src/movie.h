@@ -4,6 +4,7 @@
 #include "input/zapper.h"
 #include "utils/guid.h"
 #include "utils/md5.h"
+#include "statedigest.h"
 
 #include <vector>
 #include <map>
@@ -51,6 +52,8 @@ typedef struct
 } MOVIE_INFO;
 
 
+//takes the frame's state digest while digests are recorded or checked. called before the input is latched
+void FCEUMOV_FrameStart();
 void FCEUMOV_AddInputState();
 void FCEUMOV_AddCommand(int cmd);
 void FCEU_DrawMovies(uint8 *);
@@ -162,11 +165,11 @@ public:
 	void Clone(MovieRecord& sourceRec);
 	void clear();
 
-	void parse(MovieData* md, EMUFILE* is);
-	bool parseBinary(MovieData* md, EMUFILE* is);
+	void parse(MovieData* md, const char*& p, const char* end);
+	void parseBinary(MovieData* md, const uint8*& in);
 	void dump(MovieData* md, EMUFILE* os, int index);
 	void dumpBinary(MovieData* md, EMUFILE* os, int index);
-	void parseJoy(EMUFILE* is, uint8& joystate);
+	void parseJoy(const char*& p, const char* end, uint8& joystate);
 	void dumpJoy(EMUFILE* os, uint8 joystate);
 
 	static const char mnemonics[8];
@@ -175,6 +178,61 @@ private:
 	int mask(int bit) { return 1<<bit; }
 };
 
+//A movie's frames, stored by column: each frame's four joypad bytes packed into a uint32, and
+//commands and zapper data, which most frames don't have, in a sparse table beside them. Frames are
+//kept in chunks of up to CHUNK_FRAMES, so an insert or erase moves the rest of one chunk and the
+//chunk index rather than the whole tail of the movie, and an hour of input takes under a MB.
+//Frames are handed out by value; change one by setting it back.
+class MovieRecordList
+{
+public:
+	MovieRecordList();
+
+	int size() const { return count; }
+	bool empty() const { return count == 0; }
+	void clear();
+	//frames added at the end are blank
+	void resize(int frames);
+
+	MovieRecord get(int frame) const;
+	void get(int frame, MovieRecord& rec) const;
+	void set(int frame, const MovieRecord& rec);
+
+	void push_back(const MovieRecord& rec);
+	//blank frames, before at (or at the end if at is size())
+	void insert(int at, int frames);
+	void insert(int at, const MovieRecord& rec);
+	void erase(int at, int frames = 1);
+
+private:
+	enum { CHUNK_FRAMES = 4096 };
+
+	struct Extra
+	{
+		int offset;        //of the frame in its chunk
+		uint8 commands;
+		uint8 zapper[2][4]; //x, y, b, bogo
+		uint64 zaphit[2];
+	};
+
+	struct Chunk
+	{
+		std::vector<uint32> pads;
+		std::vector<Extra> extras; //in offset order
+	};
+
+	size_t find(int frame) const;
+	void append(int frames);
+	void split(size_t c);
+	void reindex(size_t from);
+	static size_t findExtra(const Chunk& chunk, int offset);
+
+	std::vector<Chunk> chunks; //none of them empty
+	std::vector<int> starts;   //the first frame of each chunk
+	int count;
+	mutable size_t last;       //the chunk found last; frames are mostly visited in order
+};
+
 class MovieData
 {
 public:
@@ -191,7 +249,10 @@ public:
 	std::string romFilename;
 	std::vector<uint8> savestate;
 	std::vector<uint8> saveram;
-	std::vector<MovieRecord> records;
+	MovieRecordList records;
+	//the machine's digest at the start of each frame, as recorded (text movies only). may be shorter
+	//than records, and all 0 for frames without one
+	std::vector<FCEUStateDigest> digests;
 	std::vector<std::wstring> comments;
 	std::vector<std::string> subtitles;
 	//this is the RERECORD COUNT. please rename variable.
@@ -210,7 +271,7 @@ public:
 	//whether microphone is enabled
 	bool microphone;
 
-	int getNumRecords() { return (int)records.size(); }
+	int getNumRecords() { return records.size(); }
 
 	int RAMInitOption, RAMInitSeed;
 
@@ -243,8 +304,14 @@ public:
 	};
 
 	void truncateAt(int frame);
+	//the input from frame on has changed: forgets what was taken from the old one, the digests
+	//from frame on and, for the movie being played, the keyframes past it
+	void inputChangedFrom(int frame);
 	void installValue(std::string& key, std::string& val);
 	int dump(EMUFILE* os, bool binary, bool seekToCurrFramePos = false);
+	void dumpHeader(EMUFILE* os, bool binary);
+	//a frame's digest line, which follows its record
+	static void dumpDigest(EMUFILE* os, const FCEUStateDigest& digest);
 
 	void clearRecordRange(int start, int len);
 	void eraseRecords(int at, int frames = 1);
@@ -285,6 +352,7 @@ void FCEUI_CreateMovieFile(std::string fn);
 void FCEUI_SaveMovie(const char *fname, EMOVIE_FLAG flags, std::wstring author);
 bool FCEUI_LoadMovie(const char *fname, bool read_only, int _stopframe);
 void FCEUI_MoviePlayFromBeginning(void);
+bool FCEUI_MovieSeek(int frame);
 void FCEUI_StopMovie(void);
 bool FCEUI_MovieGetInfo(FCEUFILE* fp, MOVIE_INFO& info, bool skipFrameCount = false);
 //char* FCEUI_MovieGetCurrentName(int addSlotNumber);
@@ -0,0 +1,171 @@
+/* FCE Ultra - NES/Famicom Emulator
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "movieindex.h"
+#include "rewind.h"
+#include "emufile.h"
+#include "utils/endian.h"
+
+#include <cstring>
+
+#define MKI_ENTRY_OVERHEAD  64          //bookkeeping counted against the budget for every keyframe
+#define MKI_MAGIC           "FCKI"
+#define MKI_VERSION         1
+#define MKI_MAX_STATE       (16 << 20)  //larger than any snapshot, to tell a damaged sidecar by
+
+MovieKeyframeIndex::MovieKeyframeIndex()
+	: budget(64 << 20)
+	, interval(60)
+	, spacing(60)
+	, used(0)
+{
+}
+
+void MovieKeyframeIndex::configure(size_t budget, int interval)
+{
+	this->budget = budget;
+	this->interval = interval > 0 ? interval : 1;
+	if(spacing < this->interval || keys.empty())
+		spacing = this->interval;
+	thin();
+}
+
+void MovieKeyframeIndex::clear()
+{
+	keys.clear();
+	used = 0;
+	spacing = interval;
+}
+
+bool MovieKeyframeIndex::wants(int frame) const
+{
+	return frame % spacing == 0 && keys.find(frame) == keys.end();
+}
+
+void MovieKeyframeIndex::add(int frame, const uint8 *state, size_t size)
+{
+	if(zeros.size() < size)
+		zeros.resize(size);
+	FCEU_EncodeStateDelta(state, &zeros[0], size, scratch);
+
+	Keyframe &key = keys[frame];
+	if(key.size)
+		used -= key.data.size() + MKI_ENTRY_OVERHEAD;
+	//sized to fit, so the budget counts what's really held
+	key.data.assign(scratch.begin(), scratch.end());
+	key.size = (uint32)size;
+	used += key.data.size() + MKI_ENTRY_OVERHEAD;
+
+	thin();
+}
+
+bool MovieKeyframeIndex::find(int frame, int &at, std::vector<uint8> &state) const
+{
+	std::map<int, Keyframe>::const_iterator it = keys.upper_bound(frame);
+	if(it == keys.begin())
+		return false;
+	--it;
+
+	state.assign(it->second.size, 0);
+	if(!FCEU_DecodeStateDelta(it->second.data, state))
+		return false;
+	at = it->first;
+	return true;
+}
+
+void MovieKeyframeIndex::dropAfter(int frame)
+{
+	std::map<int, Keyframe>::iterator it = keys.upper_bound(frame);
+	while(it != keys.end())
+	{
+		used -= it->second.data.size() + MKI_ENTRY_OVERHEAD;
+		keys.erase(it++);
+	}
+}
+
+void MovieKeyframeIndex::thin()
+{
+	while(used > budget && keys.size() > 1)
+	{
+		spacing *= 2;
+		std::map<int, Keyframe>::iterator it = keys.begin();
+		while(it != keys.end())
+		{
+			if(it->first % spacing)
+			{
+				used -= it->second.data.size() + MKI_ENTRY_OVERHEAD;
+				keys.erase(it++);
+			}
+			else
+				++it;
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+//sidecar files: the magic, the version, the key and the number of keyframes, then every keyframe's
+//frame, decoded size and encoded size followed by its data
+
+void MovieKeyframeIndex::write(EMUFILE *os, uint64 key) const
+{
+	os->fwrite(MKI_MAGIC, 4);
+	write32le(MKI_VERSION, os);
+	write64le(key, os);
+	write32le((uint32)keys.size(), os);
+	for(std::map<int, Keyframe>::const_iterator it = keys.begin(); it != keys.end(); ++it)
+	{
+		write32le((uint32)it->first, os);
+		write32le(it->second.size, os);
+		write32le((uint32)it->second.data.size(), os);
+		if(!it->second.data.empty())
+			os->fwrite(&it->second.data[0], it->second.data.size());
+	}
+}
+
+bool MovieKeyframeIndex::read(EMUFILE *is, uint64 key)
+{
+	char magic[4];
+	uint32 version, count;
+	uint64 fileKey;
+	if(is->fread(magic, 4) != 4 || memcmp(magic, MKI_MAGIC, 4)
+		|| !read32le(&version, is) || version != MKI_VERSION
+		|| !read64le(&fileKey, is) || fileKey != key
+		|| !read32le(&count, is))
+		return false;
+
+	std::map<int, Keyframe> loaded;
+	size_t loadedUsed = 0;
+	for(uint32 i = 0; i < count; i++)
+	{
+		uint32 frame, size, packed;
+		if(!read32le(&frame, is) || !read32le(&size, is) || !read32le(&packed, is)
+			|| !size || size > MKI_MAX_STATE || packed > 2 * size + 16)
+			return false;
+		Keyframe &k = loaded[(int)frame];
+		k.size = size;
+		k.data.resize(packed);
+		if(packed && is->fread(&k.data[0], packed) != packed)
+			return false;
+		loadedUsed += packed + MKI_ENTRY_OVERHEAD;
+	}
+
+	keys.swap(loaded);
+	used = loadedUsed;
+	spacing = interval;
+	thin();
+	return true;
+}
@@ -0,0 +1,64 @@
+#ifndef _MOVIEINDEX_H_
+#define _MOVIEINDEX_H_
+
+#include "types.h"
+
+#include <map>
+#include <vector>
+
+class EMUFILE;
+
+//Movie keyframe index.
+//
+//Snapshots of the machine taken every so many frames of a movie, so a seek can start from the
+//nearest one at or before its target instead of from power-on. They're kept by frame, encoded as
+//their bytes that aren't zero, the way the rewind history keeps its keyframes.
+//When they outgrow their budget the spacing doubles and the ones off the new spacing go, so what's
+//left still covers the whole movie, only more thinly. The index can be written to a sidecar file
+//and read back; the caller derives the key it's checked against from the movie and the ROM.
+class MovieKeyframeIndex
+{
+public:
+	MovieKeyframeIndex();
+
+	//budget: bytes of encoded snapshots to keep. interval: frames between keyframes, before thinning
+	void configure(size_t budget, int interval);
+	void clear();
+
+	//whether a keyframe belongs at frame and isn't there yet
+	bool wants(int frame) const;
+	void add(int frame, const uint8 *state, size_t size);
+
+	//the last keyframe at or before frame, decoded into state. false if there's none
+	bool find(int frame, int &at, std::vector<uint8> &state) const;
+
+	//drops the keyframes past frame, taken before the input that led to them changed
+	void dropAfter(int frame);
+
+	int getCount() const { return (int)keys.size(); }
+	size_t getUsed() const { return used; }
+
+	void write(EMUFILE *os, uint64 key) const;
+	//replaces the index with the one in is, if it was written with the same key. otherwise leaves
+	//it as it was and returns false
+	bool read(EMUFILE *is, uint64 key);
+
+private:
+	struct Keyframe
+	{
+		std::vector<uint8> data; //encoded
+		uint32 size;             //decoded
+	};
+
+	void thin();
+
+	std::map<int, Keyframe> keys;
+	size_t budget;
+	int interval;
+	int spacing;   //interval, doubled at every thinning
+	size_t used;
+	std::vector<uint8> zeros;  //what keyframes are encoded against
+	std::vector<uint8> scratch;
+};
+
+#endif
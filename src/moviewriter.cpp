@@ -0,0 +1,365 @@
+/* FCE Ultra - NES/Famicom Emulator
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "moviewriter.h"
+#include "emufile.h"
+#include "driver.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#ifdef WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#define MW_BATCH_FRAMES   60    //frames queued before the writer is woken for them
+#define MW_BATCH_WAIT_MS  500   //the longest a frame waits to be written when fewer are queued
+#define MW_SYNC_SECONDS   5     //between syncs of the file to disk while recording
+
+static bool Truncate(FILE *fp, long size)
+{
+	if(fflush(fp) != 0)
+		return false;
+#ifdef WIN32
+	return _chsize(_fileno(fp), size) == 0;
+#else
+	return ftruncate(fileno(fp), size) == 0;
+#endif
+}
+
+static bool SyncToDisk(FILE *fp)
+{
+	if(fflush(fp) != 0)
+		return false;
+#ifdef WIN32
+	return _commit(_fileno(fp)) == 0;
+#else
+	return fsync(fileno(fp)) == 0;
+#endif
+}
+
+static bool SameDigest(const MovieData &a, const MovieData &b, int frame)
+{
+	bool inA = frame < (int)a.digests.size() && a.digests[frame].isSet();
+	bool inB = frame < (int)b.digests.size() && b.digests[frame].isSet();
+	return inA == inB && (!inA || a.digests[frame].compare(b.digests[frame]) < 0);
+}
+
+//the first frame whose text would differ between the two
+static int FirstDifference(const MovieData &a, const MovieData &b)
+{
+	if(a.fourscore != b.fourscore || a.ports[0] != b.ports[0] || a.ports[1] != b.ports[1])
+		return 0;
+
+	int count = std::min(a.records.size(), b.records.size());
+	MovieRecord ra, rb;
+	for(int i = 0; i < count; i++)
+	{
+		a.records.get(i, ra);
+		b.records.get(i, rb);
+		if(!ra.Compare(rb) || !SameDigest(a, b, i))
+			return i;
+	}
+	return count;
+}
+
+MovieWriter::MovieWriter()
+	: fp(NULL)
+	, dirtyFrom(0)
+	, urgent(0)
+	, busy(false)
+	, quit(false)
+	, open(false)
+{}
+
+MovieWriter::~MovieWriter()
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		quit = true;
+	}
+	wake.notify_one();
+	if(worker.joinable())
+		worker.join();
+}
+
+void MovieWriter::rewrite(const std::string &path, const MovieData &movie)
+{
+	Job job;
+	job.type = JOB_REWRITE;
+	job.path = path;
+	job.movie.reset(new MovieData(movie));
+	queue(job);
+	open = true;
+}
+
+void MovieWriter::record(int frame, int mode, const MovieRecord &rec, const FCEUStateDigest *digest)
+{
+	Job job;
+	job.type = JOB_FRAME;
+	job.frame = frame;
+	job.mode = mode;
+	job.rec = rec;
+	job.hasDigest = digest != NULL;
+	if(digest)
+		job.digest = *digest;
+	queue(job);
+}
+
+void MovieWriter::close()
+{
+	if(!open)
+		return;
+	Job job;
+	job.type = JOB_CLOSE;
+	queue(job);
+	open = false;
+	flush();
+}
+
+void MovieWriter::queue(Job &job)
+{
+	bool now;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		if(job.type != JOB_FRAME)
+			urgent++;
+		jobs.push_back(std::move(job));
+		now = urgent || jobs.size() >= MW_BATCH_FRAMES;
+
+		//started on first use, so nothing runs for those who never record
+		if(!worker.joinable())
+			worker = std::thread(&MovieWriter::run, this);
+	}
+	//a frame alone doesn't wake the writer; it's picked up with the batch, or when the wait runs out
+	if(now)
+		wake.notify_one();
+}
+
+void MovieWriter::flush()
+{
+	std::unique_lock<std::mutex> guard(lock);
+	if(jobs.empty() && !busy)
+		return;
+	urgent++;
+	wake.notify_one();
+	while(!jobs.empty() || busy)
+		done.wait(guard);
+}
+
+std::vector<std::string> MovieWriter::takeFailures()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	std::vector<std::string> out;
+	out.swap(failures);
+	return out;
+}
+
+void MovieWriter::run()
+{
+	std::unique_lock<std::mutex> guard(lock);
+	for(;;)
+	{
+		while(!quit && !urgent && jobs.size() < MW_BATCH_FRAMES)
+		{
+			if(jobs.empty())
+				wake.wait(guard);
+			else if(wake.wait_for(guard, std::chrono::milliseconds(MW_BATCH_WAIT_MS)) == std::cv_status::timeout)
+				break;
+		}
+
+		//the batch is taken whole; flush() waits for it through busy
+		std::deque<Job> batch;
+		batch.swap(jobs);
+		urgent = 0;
+		busy = true;
+		bool last = quit;
+		guard.unlock();
+
+		for(size_t i = 0; i < batch.size(); i++)
+			perform(batch[i]);
+		emit();
+		if(last)
+			shut();
+		else
+			sync(false);
+
+		guard.lock();
+		busy = false;
+		done.notify_all();
+		if(last && jobs.empty())
+			return;
+	}
+}
+
+void MovieWriter::perform(Job &job)
+{
+	switch(job.type)
+	{
+	case JOB_FRAME:
+		applyFrame(job);
+		break;
+	case JOB_REWRITE:
+		applyRewrite(job);
+		break;
+	case JOB_CLOSE:
+		emit();
+		shut();
+		break;
+	}
+}
+
+//does to written what FCEUMOV_AddInputState() did to the movie
+void MovieWriter::applyFrame(const Job &job)
+{
+	MovieRecordList &records = written.records;
+	if(job.frame < records.size() && job.mode == MOVIE_RECORD_MODE_OVERWRITE)
+		records.set(job.frame, job.rec);
+	else if(job.frame < records.size() && job.mode == MOVIE_RECORD_MODE_INSERT)
+		records.insert(job.frame, job.rec);
+	else
+	{
+		records.resize(job.frame);
+		records.push_back(job.rec);
+	}
+
+	written.inputChangedFrom(job.frame);
+	if(job.hasDigest)
+	{
+		written.digests.resize(job.frame);
+		written.digests.push_back(job.digest);
+	}
+	dirtyFrom = std::min(dirtyFrom, job.frame);
+}
+
+void MovieWriter::applyRewrite(Job &job)
+{
+	std::vector<uint8> header;
+	EMUFILE_MEMORY ms(&header);
+	job.movie->dumpHeader(&ms, false);
+
+	//in place if the header fits where the old one was, and from the first frame that changed
+	if(fp && job.path == path && !offsets.empty() && offsets[0] == (long)header.size())
+	{
+		int keep = FirstDifference(written, *job.movie);
+		std::swap(written, *job.movie);
+		dirtyFrom = std::min(dirtyFrom, keep);
+		if(fseek(fp, 0, SEEK_SET) != 0 || fwrite(&header[0], 1, header.size(), fp) != header.size())
+			fail();
+		return;
+	}
+
+	//the frames still owed to another file go to it first
+	if(fp && job.path != path)
+		emit();
+	shut();
+
+	std::swap(written, *job.movie);
+	path = job.path;
+	dirtyFrom = 0;
+	fp = FCEUD_UTF8fopen(path, "wb");
+	if(!fp || fwrite(&header[0], 1, header.size(), fp) != header.size())
+	{
+		fail();
+		return;
+	}
+	offsets.assign(1, (long)header.size());
+	lastSync = std::chrono::steady_clock::now();
+}
+
+//writes the frames from dirtyFrom on, after cutting off what the file held from there
+void MovieWriter::emit()
+{
+	if(!fp)
+		return;
+
+	int count = written.records.size();
+	int inFile = (int)offsets.size() - 1;
+	if(dirtyFrom >= count && inFile == count)
+		return;
+
+	int from = std::min(dirtyFrom, inFile);
+	long at = offsets[from];
+	if(from < inFile && !Truncate(fp, at))
+	{
+		fail();
+		return;
+	}
+	offsets.resize(from + 1);
+
+	std::vector<uint8> text;
+	EMUFILE_MEMORY ms(&text);
+	MovieRecord rec;
+	for(int i = from; i < count; i++)
+	{
+		if(i > from)
+			offsets.push_back(at + ms.ftell());
+		written.records.get(i, rec);
+		rec.dump(&written, &ms, i);
+		if(i < (int)written.digests.size() && written.digests[i].isSet())
+			MovieData::dumpDigest(&ms, written.digests[i]);
+	}
+	offsets.push_back(at + (long)text.size());
+	dirtyFrom = count;
+
+	if(fseek(fp, at, SEEK_SET) != 0
+		|| (!text.empty() && fwrite(&text[0], 1, text.size(), fp) != text.size())
+		|| fflush(fp) != 0)
+		fail();
+}
+
+//every so often, or now if force is set
+void MovieWriter::sync(bool force)
+{
+	if(!fp)
+		return;
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if(!force && now - lastSync < std::chrono::seconds(MW_SYNC_SECONDS))
+		return;
+	lastSync = now;
+	if(!SyncToDisk(fp))
+		fail();
+}
+
+void MovieWriter::shut()
+{
+	if(!fp)
+		return;
+	bool ok = SyncToDisk(fp);
+	if(fclose(fp) != 0)
+		ok = false;
+	fp = NULL;
+	offsets.clear();
+	dirtyFrom = 0;
+	if(!ok)
+		fail();
+}
+
+//the file can't be trusted to hold what written says any more, so it's closed and left as it is
+void MovieWriter::fail()
+{
+	if(fp)
+		fclose(fp);
+	fp = NULL;
+	offsets.clear();
+
+	std::lock_guard<std::mutex> guard(lock);
+	failures.push_back(path);
+}
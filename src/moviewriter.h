@@ -0,0 +1,97 @@
+#ifndef _MOVIEWRITER_H_
+#define _MOVIEWRITER_H_
+
+#include "types.h"
+#include "movie.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//Background writer for the movie being recorded.
+//
+//The emulation thread hands over each recorded frame as it is, a record and a digest; a thread of
+//its own turns them into text a batch at a time and appends them with buffered writes, syncing the
+//file to disk every so often, so recording never waits on the disk. It keeps its own copy of what
+//the file holds and where every frame starts in it: when the whole movie is handed over again (a
+//rerecord, a toggle), it rewrites the header in place and only the frames from the first that
+//changed, unless the header came out a different length.
+class MovieWriter
+{
+public:
+	MovieWriter();
+	~MovieWriter(); //finishes the queued jobs and closes the file
+
+	//whether a movie file is open, as far as the jobs queued so far go
+	bool isOpen() const { return open; }
+
+	//queues writing movie (copied) to path, opening it if it isn't the file that's open
+	void rewrite(const std::string &path, const MovieData &movie);
+
+	//queues a frame recorded at frame in a movie record mode (MOVIE_RECORD_MODE_*), which says
+	//what it did to a frame that was there already. digest may be NULL
+	void record(int frame, int mode, const MovieRecord &rec, const FCEUStateDigest *digest);
+
+	//writes what's queued, syncs and closes the file, and waits until that's done
+	void close();
+
+	//waits until every queued job is done and the file's written
+	void flush();
+
+	//the paths that couldn't be written since the last call
+	std::vector<std::string> takeFailures();
+
+private:
+	enum JobType { JOB_FRAME, JOB_REWRITE, JOB_CLOSE };
+
+	struct Job
+	{
+		JobType type;
+		int frame;
+		int mode;
+		bool hasDigest;
+		MovieRecord rec;
+		FCEUStateDigest digest;
+		std::string path;
+		std::unique_ptr<MovieData> movie;
+	};
+
+	void queue(Job &job);
+	void run();
+	void perform(Job &job);
+	void applyFrame(const Job &job);
+	void applyRewrite(Job &job);
+	void emit();
+	void sync(bool force);
+	void shut();
+	void fail();
+
+	//worker side: the file and what it holds
+	FILE *fp;
+	std::string path;
+	MovieData written;            //the movie as it's to be in the file
+	std::vector<long> offsets;    //where each frame written starts, and after them the end
+	int dirtyFrom;                //the first frame that isn't in the file as it is in written
+	std::chrono::steady_clock::time_point lastSync;
+
+	std::thread worker;
+	std::mutex lock;
+	std::condition_variable wake, done;
+	std::deque<Job> jobs;
+	int urgent;                   //jobs queued that shouldn't wait for a batch to fill
+	bool busy;                    //a batch taken from jobs is being worked on
+	bool quit;
+	std::vector<std::string> failures;
+
+	bool open;                    //emulation side
+
+	MovieWriter(const MovieWriter &);
+	MovieWriter &operator=(const MovieWriter &);
+};
+
+#endif
@@ -34,6 +34,7 @@
 #include "cart.h"
 #include "input.h"
 #include "state.h"
+#include "statedigest.h"
 #include "driver.h"
 
 #ifndef M_PI
@@ -159,7 +160,10 @@ static INLINE void BANKSET(uint32 A, uint32 bank)
 {
 	bank&=NSFMaxBank;
 	if(NSFHeader.SoundChip&4)
+	{
 		memcpy(ExWRAM+(A-0x6000),NSFDATA+(bank<<12),4096);
+		FCEUSS_MarkWritten(ExWRAM+(A-0x6000),4096);
+	}
 	else
 		setprg4(A,bank);
 }
@@ -432,6 +436,7 @@ static DECLFR(NSF_read)
 		if(!fceuindbg)
 		{
 			memset(RAM,0x00,0x800);
+			RAMDirty=~0u;
 
 			BWrite[0x4015](0x4015,0x0);
 			for(x=0;x<0x14;x++)
@@ -650,11 +650,13 @@ EFCM_CONVERTRESULT convert_fcm(MovieData& md, std::string fname)
 		if(i==0 && initreset)
 			joopcmd = MOVIECMD_RESET;
 		_addjoy();
-		md.records[i].commands = joopcmd;
+		MovieRecord rec;
+		rec.commands = joopcmd;
 		for(int j=0;j<4;j++) {
 			joymask[j] |= joop[j];
-			md.records[i].joysticks[j] = joop[j];
+			rec.joysticks[j] = joop[j];
 		}
+		md.records.set(i,rec);
 	}
 
 	md.ports[2] = SIS_NONE;
@@ -0,0 +1,293 @@
+/* FCE Ultra - NES/Famicom Emulator
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "perftrace.h"
+#include "fceu.h"
+#include "x6502.h"
+#include "driver.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define PERF_RING 16384 //events kept per thread, about half a minute of frames
+
+bool perfTraceEnabled = false;
+uint32 perfCPUCalls = 0;
+
+//the X6502_Run calls that were timed: how long they took, and how many cycles they ran
+static uint64 sampledCPUTicks = 0;
+static uint64 sampledCPUCycles = 0;
+
+static const char *phaseNames[PERF_PHASES] = {
+	"input", "cpu", "ppu", "sound", "overlays", "blit", "throttle", "autosave"
+};
+
+struct PerfEvent
+{
+	uint64 start, end;
+	uint64 cpu;
+	int phase;
+};
+
+//written only by its own thread; the counters are atomic so they can be read from another
+struct PerfThread
+{
+	int id;
+	std::string name;
+	std::atomic<uint64> head; //events written so far
+	PerfEvent ring[PERF_RING];
+	std::atomic<uint64> count[PERF_PHASES];
+	std::atomic<uint64> ticks[PERF_PHASES];
+	std::atomic<uint32> histogram[PERF_PHASES][PERF_BUCKETS];
+
+	void clear()
+	{
+		head = 0;
+		for(int p = 0; p < PERF_PHASES; p++)
+		{
+			count[p] = 0;
+			ticks[p] = 0;
+			for(int b = 0; b < PERF_BUCKETS; b++)
+				histogram[p][b] = 0;
+		}
+	}
+};
+
+//threads register on their first event and are never removed
+static std::mutex threadsLock;
+static std::vector<PerfThread*> threads;
+static thread_local PerfThread *thisThread = NULL;
+
+static uint64 epoch;
+static uint64 framesBase, framesNow;
+static uint64 instructionsBase, cyclesBase;
+
+extern uint64 total_instructions;
+
+static PerfThread *GetThread()
+{
+	if(!thisThread)
+	{
+		PerfThread *t = new PerfThread();
+		t->clear();
+		std::lock_guard<std::mutex> guard(threadsLock);
+		t->id = (int)threads.size() + 1;
+		char name[32];
+		sprintf(name, "thread %d", t->id);
+		t->name = name;
+		threads.push_back(t);
+		thisThread = t;
+	}
+	return thisThread;
+}
+
+static void AddToHistogram(PerfThread *t, int phase, uint64 ticks)
+{
+	uint64 us = ticks * 1000000 / FCEUD_GetTimeFreq();
+	int bucket = 0;
+	while(us && bucket < PERF_BUCKETS - 1)
+	{
+		us >>= 1;
+		bucket++;
+	}
+
+	t->count[phase].fetch_add(1, std::memory_order_relaxed);
+	t->ticks[phase].fetch_add(ticks, std::memory_order_relaxed);
+	t->histogram[phase][bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+void FCEU_PerfRecord(int phase, uint64 start, uint64 end, uint64 cpu)
+{
+	PerfThread *t = GetThread();
+
+	uint64 head = t->head.load(std::memory_order_relaxed);
+	PerfEvent &e = t->ring[head % PERF_RING];
+	e.start = start;
+	e.end = end;
+	e.cpu = cpu;
+	e.phase = phase;
+	t->head.store(head + 1, std::memory_order_release);
+
+	if(phase == PERF_PPU)
+	{
+		AddToHistogram(t, PERF_CPU, cpu);
+		AddToHistogram(t, PERF_PPU, end - start - cpu);
+	}
+	else
+		AddToHistogram(t, phase, end - start);
+}
+
+void PerfCPUScope::begin()
+{
+	start = FCEUD_GetTime();
+	cycleStart = timestamp;
+}
+
+void PerfCPUScope::end()
+{
+	sampledCPUTicks += FCEUD_GetTime() - start;
+	sampledCPUCycles += timestamp - cycleStart;
+}
+
+PerfEmulateScope::PerfEmulateScope()
+	: start(perfTraceEnabled ? FCEUD_GetTime() : 0)
+	, cycleStart(timestampbase + timestamp)
+	, sampledTicksStart(sampledCPUTicks)
+	, sampledCyclesStart(sampledCPUCycles)
+{}
+
+PerfEmulateScope::~PerfEmulateScope()
+{
+	if(!start)
+		return;
+
+	uint64 end = FCEUD_GetTime();
+
+	//the CPU time of the frame, from the time per cycle of the calls that were timed
+	uint64 cycles = timestampbase + timestamp - cycleStart;
+	uint64 sampledTicks = sampledCPUTicks - sampledTicksStart;
+	uint64 sampledCycles = sampledCPUCycles - sampledCyclesStart;
+	uint64 cpu = sampledCycles ? (uint64)((double)sampledTicks * cycles / sampledCycles) : 0;
+	if(cpu > end - start)
+		cpu = end - start;
+	FCEU_PerfRecord(PERF_PPU, start, end, cpu);
+}
+
+void FCEU_PerfFrame(void)
+{
+	if(perfTraceEnabled)
+		framesNow++;
+}
+
+//-----------------------------------------------------------------------------
+
+void FCEUI_ResetPerfCounters(void)
+{
+	std::lock_guard<std::mutex> guard(threadsLock);
+	for(size_t i = 0; i < threads.size(); i++)
+		threads[i]->clear();
+
+	epoch = FCEUD_GetTime();
+	framesBase = framesNow;
+	instructionsBase = total_instructions;
+	cyclesBase = timestampbase + timestamp;
+}
+
+void FCEUI_SetPerfTrace(bool enable)
+{
+	if(enable && !perfTraceEnabled)
+		FCEUI_ResetPerfCounters();
+	perfTraceEnabled = enable;
+}
+
+bool FCEUI_GetPerfTrace(void)
+{
+	return perfTraceEnabled;
+}
+
+void FCEUI_SetPerfThreadName(const char *name)
+{
+	PerfThread *t = GetThread();
+	std::lock_guard<std::mutex> guard(threadsLock);
+	t->name = name;
+}
+
+void FCEUI_GetPerfCounters(FCEUPerfCounters *out)
+{
+	memset(out, 0, sizeof(*out));
+	out->frames = framesNow - framesBase;
+	out->instructions = total_instructions - instructionsBase;
+	out->cycles = timestampbase + timestamp - cyclesBase;
+
+	double freq = (double)FCEUD_GetTimeFreq();
+	std::lock_guard<std::mutex> guard(threadsLock);
+	for(int p = 0; p < PERF_PHASES; p++)
+	{
+		FCEUPerfCounters::Phase &phase = out->phases[p];
+		phase.name = phaseNames[p];
+		for(size_t i = 0; i < threads.size(); i++)
+		{
+			PerfThread *t = threads[i];
+			phase.count += t->count[p].load(std::memory_order_relaxed);
+			phase.seconds += t->ticks[p].load(std::memory_order_relaxed) / freq;
+			for(int b = 0; b < PERF_BUCKETS; b++)
+				phase.histogram[b] += t->histogram[p][b].load(std::memory_order_relaxed);
+		}
+	}
+}
+
+//copies out what the ring still holds. events that may have been overwritten while copying
+//are dropped, so this can run while the other threads keep tracing
+static void SnapshotRing(PerfThread *t, std::vector<PerfEvent> &events)
+{
+	uint64 head = t->head.load(std::memory_order_acquire);
+	uint64 first = head > PERF_RING ? head - PERF_RING : 0;
+	events.clear();
+	for(uint64 i = first; i < head; i++)
+		events.push_back(t->ring[i % PERF_RING]);
+
+	uint64 after = t->head.load(std::memory_order_acquire);
+	uint64 valid = after > PERF_RING ? after - PERF_RING : 0;
+	if(valid > first)
+		events.erase(events.begin(), events.begin() + (size_t)std::min<uint64>(valid - first, events.size()));
+}
+
+bool FCEUI_ExportPerfTrace(const char *path)
+{
+	FILE *fp = FCEUD_UTF8fopen(path, "w");
+	if(!fp)
+		return false;
+
+	double usPerTick = 1000000.0 / FCEUD_GetTimeFreq();
+	std::vector<PerfEvent> events;
+
+	fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", fp);
+	fputs("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"FCEUX\"}}", fp);
+
+	std::lock_guard<std::mutex> guard(threadsLock);
+	for(size_t i = 0; i < threads.size(); i++)
+	{
+		PerfThread *t = threads[i];
+		fprintf(fp, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", t->id, t->name.c_str());
+
+		SnapshotRing(t, events);
+		for(size_t j = 0; j < events.size(); j++)
+		{
+			const PerfEvent &e = events[j];
+			if(e.start < epoch)
+				continue;
+
+			double ts = (e.start - epoch) * usPerTick;
+			double dur = (e.end - e.start) * usPerTick;
+			if(e.phase == PERF_PPU)
+				fprintf(fp, ",\n{\"name\":\"emulate\",\"cat\":\"frame\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"cpu_us\":%.3f,\"ppu_us\":%.3f}}",
+					t->id, ts, dur, e.cpu * usPerTick, dur - e.cpu * usPerTick);
+			else
+				fprintf(fp, ",\n{\"name\":\"%s\",\"cat\":\"frame\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+					phaseNames[e.phase], t->id, ts, dur);
+		}
+	}
+
+	fputs("\n]}\n", fp);
+	fclose(fp);
+	return true;
+}
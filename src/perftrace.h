@@ -0,0 +1,119 @@
+#ifndef _PERFTRACE_H_
+#define _PERFTRACE_H_
+
+#include "types.h"
+
+//Frame-phase timing.
+//
+//PerfScope times a phase of the frame loop and records it in a ring buffer owned by the calling
+//thread, along with a per-phase histogram. While tracing is off a scope costs one branch.
+//The buffers can be summed up with FCEUI_GetPerfCounters() or written out as Chrome trace-event
+//JSON (chrome://tracing, Perfetto) with FCEUI_ExportPerfTrace().
+
+enum EPERFPHASE
+{
+	PERF_INPUT,     //FCEU_UpdateInput, and late input polling
+	PERF_CPU,       //X6502_Run, estimated over the frame from a sample of its calls
+	PERF_PPU,       //FCEUPPU_Loop without the CPU time
+	PERF_SOUND,     //FlushEmulateSound
+	PERF_OVERLAYS,  //FCEU_PutImage
+	PERF_BLIT,      //the driver's blit and scaler
+	PERF_THROTTLE,  //the driver waiting for the next frame
+	PERF_AUTOSAVE,
+	PERF_PHASES
+};
+
+//log2 buckets of microseconds: [0] is under 1us, [n] is 2^(n-1) up to 2^n us
+#define PERF_BUCKETS 24
+
+struct FCEUPerfCounters
+{
+	uint64 frames;
+	uint64 instructions;
+	uint64 cycles;
+	struct Phase
+	{
+		const char *name;
+		uint64 count;
+		double seconds;
+		uint32 histogram[PERF_BUCKETS];
+	} phases[PERF_PHASES];
+};
+
+extern bool perfTraceEnabled;
+
+uint64 FCEUD_GetTime(void);
+
+//records a phase that ran from start to end (FCEUD_GetTime() ticks) on the calling thread.
+//cpu: for PERF_PPU, how much of it was CPU time
+void FCEU_PerfRecord(int phase, uint64 start, uint64 end, uint64 cpu = 0);
+
+class PerfScope
+{
+public:
+	PerfScope(int phase)
+		: phase(phase)
+		, start(perfTraceEnabled ? FCEUD_GetTime() : 0)
+	{}
+
+	~PerfScope()
+	{
+		if(start)
+			FCEU_PerfRecord(phase, start, FCEUD_GetTime());
+	}
+
+private:
+	int phase;
+	uint64 start;
+};
+
+//one X6502_Run call in this many is timed (a power of 2)
+#define PERF_CPU_SAMPLE 64
+
+extern uint32 perfCPUCalls;
+
+//X6502_Run's scope. The new PPU runs the CPU a few cycles at a time, tens of thousands of calls a
+//frame, so timing each would cost more than the calls; only a sample of them is timed, along with
+//the cycles they ran, and PerfEmulateScope scales that up to the cycles of the whole frame.
+class PerfCPUScope
+{
+public:
+	PerfCPUScope()
+		: start(0)
+	{
+		if(perfTraceEnabled && !(++perfCPUCalls & (PERF_CPU_SAMPLE - 1)))
+			begin();
+	}
+
+	~PerfCPUScope()
+	{
+		if(start)
+			end();
+	}
+
+private:
+	void begin();
+	void end();
+
+	uint64 start;
+	uint32 cycleStart;
+};
+
+//FCEUPPU_Loop's scope, splits its time into PERF_CPU and PERF_PPU
+class PerfEmulateScope
+{
+public:
+	PerfEmulateScope();
+	~PerfEmulateScope();
+
+private:
+	uint64 start;
+	uint64 cycleStart;
+	uint64 sampledTicksStart;
+	uint64 sampledCyclesStart;
+};
+
+//counts an emulated frame
+void FCEU_PerfFrame(void);
+
+#endif
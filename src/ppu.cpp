@@ -32,9 +32,11 @@
 #include "cart.h"
 #include "palette.h"
 #include "state.h"
+#include "statedigest.h"
 #include "video.h"
 #include "input.h"
 #include "driver.h"
+#include "perftrace.h"
 #include "debug.h"
 		 
 #include <cstring>
@@ -429,8 +431,10 @@ inline void FFCEUX_PPUWrite_Default(uint32 A, uint8 V) {
 	if (PPU_hook) PPU_hook(A);
 
 	if (tmp < 0x2000) {
-		if (PPUCHRRAM & (1 << (tmp >> 10)))
+		if (PPUCHRRAM & (1 << (tmp >> 10))) {
 			VPage[tmp >> 10][tmp] = V;
+			FCEUSS_MarkWritten(&VPage[tmp >> 10][tmp]);
+		}
 	} else if (tmp < 0x3F00) {
 		if (QTAIHack && (qtaintramreg & 1)) {
 			QTAINTRAM[((((tmp & 0xF00) >> 10) >> ((qtaintramreg >> 1)) & 1) << 10) | (tmp & 0x3FF)] = V;
@@ -962,8 +966,10 @@ static DECLFW(B2007) {
 	} else {
 		PPUGenLatch = V;
 		if (tmp < 0x2000) {
-			if (PPUCHRRAM & (1 << (tmp >> 10)))
+			if (PPUCHRRAM & (1 << (tmp >> 10))) {
 				VPage[tmp >> 10][tmp] = V;
+				FCEUSS_MarkWritten(&VPage[tmp >> 10][tmp]);
+			}
 		} else if (tmp < 0x3F00) {
 			if (QTAIHack && (qtaintramreg & 1)) {
 				QTAINTRAM[((((tmp & 0xF00) >> 10) >> ((qtaintramreg >> 1)) & 1) << 10) | (tmp & 0x3FF)] = V;
@@ -1752,6 +1758,8 @@ void FCEUPPU_Power(void) {
 }
 
 int FCEUPPU_Loop(int skip) {
+	PerfEmulateScope perf;
+
 	if ((newppu) && (GameInfo->type != GIT_NSF)) {
 		int FCEUX_PPU_Loop(int skip);
 		return FCEUX_PPU_Loop(skip);
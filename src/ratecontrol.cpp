@@ -0,0 +1,135 @@
+/* FCE Ultra - NES/Famicom Emulator
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "ratecontrol.h"
+
+#include <cmath>
+
+AudioRateControl::AudioRateControl()
+	: target(0)
+	, maxDeviation(RATECONTROL_MAX_DEVIATION)
+	, smoothed(0)
+	, bias(0)
+	, ratio(1.0)
+{
+}
+
+void AudioRateControl::configure(int target, double maxDeviation)
+{
+	this->target = target;
+	this->maxDeviation = maxDeviation;
+	reset();
+}
+
+void AudioRateControl::reset()
+{
+	smoothed = target;
+	bias = 0;
+	ratio = 1.0;
+}
+
+double AudioRateControl::update(int buffered)
+{
+	if(target <= 0)
+		return ratio = 1.0;
+
+	//the fill level jumps by a whole frame on every enqueue and by a device period on every
+	//dequeue, so only follow its average
+	smoothed += (buffered - smoothed) / 16;
+
+	double error = (smoothed - target) / target;
+	if(error > 1) error = 1;
+	if(error < -1) error = -1;
+
+	//a steady clock mismatch needs a steady correction. collect it slowly so the fill
+	//level returns to the target instead of settling wherever the error pays for the drift
+	bias += error / 512;
+	if(bias > 1) bias = 1;
+	if(bias < -1) bias = -1;
+
+	double correction = error + bias;
+	if(correction > 1) correction = 1;
+	if(correction < -1) correction = -1;
+
+	ratio = 1.0 + maxDeviation * correction;
+	return ratio;
+}
+
+//--------------------------------------------------------------------
+
+FramePacer::FramePacer()
+	: lock(true)
+{
+}
+
+void FramePacer::configure(double emuHz, double displayHz, double lockTolerance)
+{
+	if(emuHz <= 0 || displayHz <= 0)
+	{
+		lock = true;
+		return;
+	}
+
+	lock = fabs(emuHz / displayHz - 1.0) <= lockTolerance;
+}
+
+//--------------------------------------------------------------------
+
+RefreshTimer::RefreshTimer()
+	: nominalHz(0)
+{
+	reset();
+}
+
+void RefreshTimer::reset()
+{
+	last = -1;
+	elapsed = 0;
+	refreshes = 0;
+}
+
+void RefreshTimer::vblank(double time, int nominalHz)
+{
+	if(nominalHz != this->nominalHz)
+	{
+		reset();
+		this->nominalHz = nominalHz;
+	}
+	if(nominalHz <= 0)
+		return;
+
+	if(last >= 0)
+	{
+		//a whole Hz off is under 2% at 60Hz, so even four refreshes round to the right count
+		double interval = time - last;
+		double spanned = interval * nominalHz;
+		double count = floor(spanned + 0.5);
+		if(count >= 1 && count <= 4 && fabs(spanned - count) < 0.25)
+		{
+			elapsed += interval;
+			refreshes += (int)count;
+		}
+	}
+	last = time;
+}
+
+double RefreshTimer::getRate() const
+{
+	if(elapsed < 1.0)
+		return 0;
+	return refreshes / elapsed;
+}
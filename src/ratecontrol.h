@@ -0,0 +1,83 @@
+#ifndef _RATECONTROL_H_
+#define _RATECONTROL_H_
+
+//Dynamic rate control.
+//
+//When frames are paced by the display (vsync) instead of by the sound card, the two clocks
+//drift apart: a 60.0988 fps NES slowed to a 59.94 Hz monitor produces ~0.26% less audio than
+//the device plays. AudioRateControl watches the fill level of the audio queue once per frame and
+//nudges the resampling ratio (FCEUI_SetSoundResampleRatio) by at most a fraction of a percent
+//so the queue settles at a small fixed latency. FramePacer decides whether the display runs close
+//enough to the emulated rate to pace the frames itself, which it does only when the difference is
+//one AudioRateControl can make up. RefreshTimer measures the display's rate. None of them reads a
+//clock, so all can be driven by a simulated one.
+
+//the largest ratio change AudioRateControl applies by default, and so the largest mismatch
+//FramePacer locks by default
+#define RATECONTROL_MAX_DEVIATION 0.005
+
+class AudioRateControl
+{
+public:
+	AudioRateControl();
+
+	//target: queue fill level to settle at, in samples
+	//maxDeviation: largest ratio change applied, 0.005 = 0.5%
+	void configure(int target, double maxDeviation = RATECONTROL_MAX_DEVIATION);
+	void reset();
+
+	//call once per frame with the number of samples queued for playback.
+	//returns the resampling ratio for the next frame; >1 means produce fewer samples
+	double update(int buffered);
+
+	double getRatio() const { return ratio; }
+	int getTarget() const { return target; }
+
+private:
+	int target;
+	double maxDeviation;
+	double smoothed; //averaged fill level
+	double bias;     //accumulated error, cancels out a constant drift
+	double ratio;
+};
+
+class FramePacer
+{
+public:
+	FramePacer();
+
+	//emuHz: emulated frames per second (including fps_scale), displayHz: refresh rate.
+	//rates within lockTolerance of each other are locked 1:1 and left to AudioRateControl
+	void configure(double emuHz, double displayHz, double lockTolerance = RATECONTROL_MAX_DEVIATION);
+
+	//true when exactly one frame is emulated per refresh
+	bool locked() const { return lock; }
+
+private:
+	bool lock;
+};
+
+//DirectDraw only reports the refresh rate in whole Hz, so 59.94 comes back as 59 or 60: further off
+//than the audio can be corrected. RefreshTimer measures it from the times of the vertical blanks
+//waited for. A frame that ran long misses a refresh, so each interval counts as the whole number
+//of refreshes it spans at the reported rate; gaps of more than a few are left out.
+class RefreshTimer
+{
+public:
+	RefreshTimer();
+	void reset();
+
+	//time: of a vertical blank just waited for, in seconds. nominalHz: the reported rate
+	void vblank(double time, int nominalHz);
+
+	//refreshes per second over the intervals counted, 0 until they add up to a second
+	double getRate() const;
+
+private:
+	double last;
+	int nominalHz;
+	double elapsed;
+	int refreshes;
+};
+
+#endif
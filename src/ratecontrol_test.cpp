@@ -0,0 +1,218 @@
+/* FCE Ultra - NES/Famicom Emulator
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+//Standalone test of AudioRateControl, FramePacer and RefreshTimer against a simulated display and
+//sound card.
+//Not part of the emulator build:
+//  g++ -std=c++11 -I. ratecontrol_test.cpp ratecontrol.cpp -o ratecontrol_test
+
+#include "ratecontrol.h"
+
+#include <cmath>
+#include <cstdio>
+
+static int failures = 0;
+
+#define CHECK(cond) do { if(!(cond)) { printf("%s:%d: failed: %s\n", __FILE__, __LINE__, #cond); failures++; } } while(0)
+
+#define RATE      44100
+#define NES_FPS   60.0988
+#define DEVICE_PERIOD 441 //samples the device takes at a time, every 10ms
+
+struct RunResult
+{
+	double ratio;       //at the end
+	double meanFill;    //over the last minute
+	int underruns;      //after the first 10 seconds
+	bool withinLimit;   //the ratio never went past maxDeviation
+};
+
+//a display running at displayHz paces the frames; each one queues a frame of sound, resampled
+//by the ratio from the frame before, and the device takes what a refresh lasts in DEVICE_PERIOD
+//blocks, so the fill level seen once a frame jumps around the way it does on a real one
+static RunResult Run(double displayHz, int seconds, double maxDeviation = 0.005)
+{
+	AudioRateControl control;
+	int target = RATE * 2 / 60;
+	control.configure(target, maxDeviation);
+
+	RunResult r = { 1.0, 0, 0, true };
+	double queued = target;
+	double deviceOwed = 0;
+	double fillSum = 0;
+	int fillCount = 0;
+	int frames = (int)(seconds * displayHz);
+	int warmup = (int)(10 * displayHz);
+	int lastMinute = frames - (int)(60 * displayHz);
+
+	for(int i = 0; i < frames; i++)
+	{
+		double ratio = control.update((int)queued);
+		if(fabs(ratio - 1.0) > maxDeviation + 1e-9)
+			r.withinLimit = false;
+		r.ratio = ratio;
+
+		queued += RATE / NES_FPS / ratio;
+
+		deviceOwed += RATE / displayHz;
+		while(deviceOwed >= DEVICE_PERIOD)
+		{
+			deviceOwed -= DEVICE_PERIOD;
+			queued -= DEVICE_PERIOD;
+			if(queued < 0)
+			{
+				queued = 0;
+				if(i >= warmup)
+					r.underruns++;
+			}
+		}
+
+		if(i >= lastMinute)
+		{
+			fillSum += queued;
+			fillCount++;
+		}
+	}
+	r.meanFill = fillSum / fillCount;
+	return r;
+}
+
+//an NTSC NES slowed to a 59.94Hz monitor makes about 0.26% too little sound, which the ratio makes up
+static void TestSlowDisplay()
+{
+	RunResult r = Run(59.94, 600);
+	int target = RATE * 2 / 60;
+	CHECK(fabs(r.ratio - 59.94 / NES_FPS) < 0.0005);
+	CHECK(fabs(r.meanFill - target) < target * 0.1);
+	CHECK(r.underruns == 0);
+	CHECK(r.withinLimit);
+}
+
+//and on a fast one, too much
+static void TestFastDisplay()
+{
+	RunResult r = Run(60.3, 600);
+	int target = RATE * 2 / 60;
+	CHECK(fabs(r.ratio - 60.3 / NES_FPS) < 0.0005);
+	CHECK(fabs(r.meanFill - target) < target * 0.1);
+	CHECK(r.underruns == 0);
+	CHECK(r.withinLimit);
+}
+
+//on a matching one the ratio stays at 1
+static void TestMatchingDisplay()
+{
+	RunResult r = Run(NES_FPS, 300);
+	CHECK(fabs(r.ratio - 1.0) < 0.0005);
+	CHECK(r.underruns == 0);
+}
+
+//a mismatch bigger than the largest correction isn't chased past it
+static void TestBeyondLimit()
+{
+	RunResult r = Run(59.0, 120);
+	CHECK(r.withinLimit);
+	CHECK(fabs(r.ratio - 0.995) < 1e-6);
+}
+
+//with no target the ratio is left alone
+static void TestUnconfigured()
+{
+	AudioRateControl control;
+	CHECK(control.update(100) == 1.0);
+	CHECK(control.update(100000) == 1.0);
+}
+
+static void TestPacer()
+{
+	FramePacer pacer;
+	pacer.configure(NES_FPS, 59.94);
+	CHECK(pacer.locked());
+	pacer.configure(NES_FPS, 60);
+	CHECK(pacer.locked());
+	pacer.configure(NES_FPS, 59);    //more than the audio can be corrected by
+	CHECK(!pacer.locked());
+	pacer.configure(NES_FPS, 59.7);
+	CHECK(!pacer.locked());
+	pacer.configure(NES_FPS, 75);
+	CHECK(!pacer.locked());
+	pacer.configure(50.007, 60);
+	CHECK(!pacer.locked());
+	pacer.configure(NES_FPS, 120);
+	CHECK(!pacer.locked());
+}
+
+//vblanks of a display running at displayHz, reported as reportedHz, waited for after frames that
+//sometimes miss a refresh, with up to half a millisecond of jitter on every wait
+static double MeasureRefresh(double displayHz, int reportedHz, int seconds)
+{
+	RefreshTimer timer;
+	unsigned seed = 12345;
+	int refresh = 0;
+	for(int i = 0; refresh < seconds * displayHz; i++)
+	{
+		refresh += (i % 7 == 6) ? 2 : 1;
+		if(i % 97 == 96)
+			refresh += 30; //a stall, left out
+		seed = seed * 1103515245 + 12345;
+		double jitter = ((seed >> 16) % 1000) / 1000.0 * 0.0005;
+		timer.vblank(refresh / displayHz + jitter, reportedHz);
+	}
+	return timer.getRate();
+}
+
+static void TestRefreshTimer()
+{
+	CHECK(fabs(MeasureRefresh(59.94, 59, 10) - 59.94) < 0.01);
+	CHECK(fabs(MeasureRefresh(59.94, 60, 10) - 59.94) < 0.01);
+	CHECK(fabs(MeasureRefresh(75.0, 75, 10) - 75.0) < 0.01);
+
+	//the measured rate locks where the reported one wouldn't
+	FramePacer pacer;
+	pacer.configure(NES_FPS, MeasureRefresh(59.94, 59, 10));
+	CHECK(pacer.locked());
+
+	//nothing until there's a second of it
+	RefreshTimer timer;
+	for(int i = 0; i < 30; i++)
+		timer.vblank(i / 60.0, 60);
+	CHECK(timer.getRate() == 0);
+
+	//and no reported rate, no measurement
+	for(int i = 0; i < 300; i++)
+		timer.vblank(i / 60.0, 0);
+	CHECK(timer.getRate() == 0);
+}
+
+int main()
+{
+	TestSlowDisplay();
+	TestFastDisplay();
+	TestMatchingDisplay();
+	TestBeyondLimit();
+	TestUnconfigured();
+	TestPacer();
+	TestRefreshTimer();
+
+	if(failures)
+	{
+		printf("%d checks failed\n", failures);
+		return 1;
+	}
+	printf("all passed\n");
+	return 0;
+}
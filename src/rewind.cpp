@@ -0,0 +1,314 @@
+/* FCE Ultra - NES/Famicom Emulator
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "rewind.h"
+#include "fceu.h"
+#include "git.h"
+#include "emufile.h"
+#include "state.h"
+#include "movie.h"
+#include "netplay.h"
+#include "driver.h"
+
+#include <cstring>
+
+#define RW_ENTRY_OVERHEAD  64  //bookkeeping counted against the budget for every snapshot
+#define RW_MIN_GAP         4   //unchanged bytes it takes to end a run of changed ones
+
+//-----------------------------------------------------------------------------
+//encoding: pairs of varints, unchanged bytes to skip and changed bytes to follow, then the
+//changed bytes XORed with the reference
+
+static void PutVarint(std::vector<uint8> &out, size_t v)
+{
+	while(v >= 0x80)
+	{
+		out.push_back((uint8)(v | 0x80));
+		v >>= 7;
+	}
+	out.push_back((uint8)v);
+}
+
+static bool GetVarint(const uint8 *&p, const uint8 *end, size_t &v)
+{
+	v = 0;
+	int shift = 0;
+	uint8 b;
+	do
+	{
+		if(p == end || shift > 56)
+			return false;
+		b = *p++;
+		v |= (size_t)(b & 0x7F) << shift;
+		shift += 7;
+	} while(b & 0x80);
+	return true;
+}
+
+void FCEU_EncodeStateDelta(const uint8 *cur, const uint8 *ref, size_t size, std::vector<uint8> &out)
+{
+	out.clear();
+	size_t i = 0;
+	while(i < size)
+	{
+		//unchanged bytes, eight at a time while they last
+		size_t start = i;
+		while(i + 8 <= size && !memcmp(cur + i, ref + i, 8))
+			i += 8;
+		while(i < size && cur[i] == ref[i])
+			i++;
+		size_t same = i - start;
+
+		//changed bytes, up to a gap of unchanged ones worth starting a new pair for
+		size_t changed = i;
+		while(i < size)
+		{
+			if(cur[i] != ref[i])
+			{
+				i++;
+				continue;
+			}
+			size_t j = i;
+			while(j < size && j - i < RW_MIN_GAP && cur[j] == ref[j])
+				j++;
+			if(j - i >= RW_MIN_GAP || j == size)
+				break;
+			i = j;
+		}
+
+		PutVarint(out, same);
+		PutVarint(out, i - changed);
+		for(size_t k = changed; k < i; k++)
+			out.push_back(cur[k] ^ ref[k]);
+	}
+}
+
+//checked, as the encoding may come from a file
+bool FCEU_DecodeStateDelta(const std::vector<uint8> &in, std::vector<uint8> &state)
+{
+	const uint8 *p = in.empty() ? NULL : &in[0];
+	const uint8 *end = p + in.size();
+	size_t i = 0;
+	while(p < end)
+	{
+		size_t same, changed;
+		if(!GetVarint(p, end, same) || !GetVarint(p, end, changed)
+			|| same > state.size() - i || changed > state.size() - i - same || changed > (size_t)(end - p))
+			return false;
+		i += same;
+		for(size_t k = 0; k < changed; k++)
+			state[i++] ^= *p++;
+	}
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+
+RewindBuffer::RewindBuffer()
+	: budget(64 << 20)
+	, keyInterval(60)
+{
+	clear();
+}
+
+void RewindBuffer::configure(size_t budget, int keyInterval)
+{
+	this->budget = budget;
+	this->keyInterval = keyInterval > 0 ? keyInterval : 1;
+	while(used > budget && entries.size() > 1)
+		dropOldest();
+}
+
+void RewindBuffer::clear()
+{
+	entries.clear();
+	used = 0;
+	size = 0;
+	nextSeq = 1;
+	sinceKey = 0;
+	key.clear();
+	cachedKeySeq = 0;
+}
+
+void RewindBuffer::push(const uint8 *state, size_t size)
+{
+	if(!size)
+		return;
+	if(size != this->size)
+	{
+		clear();
+		this->size = size;
+		zeros.assign(size, 0);
+	}
+
+	entries.push_back(Entry());
+	Entry &e = entries.back();
+	e.seq = nextSeq++;
+	e.key = entries.size() == 1 || sinceKey >= keyInterval;
+	if(e.key)
+	{
+		key.assign(state, state + size);
+		FCEU_EncodeStateDelta(state, &zeros[0], size, scratch);
+		sinceKey = 1;
+	}
+	else
+	{
+		FCEU_EncodeStateDelta(state, &key[0], size, scratch);
+		sinceKey++;
+	}
+
+	//sized to fit, so the budget counts what's really held
+	e.data.assign(scratch.begin(), scratch.end());
+	used += e.data.size() + RW_ENTRY_OVERHEAD;
+
+	while(used > budget && entries.size() > 1)
+		dropOldest();
+}
+
+//the oldest keyframe and the deltas taken against it. the newest group stays, whatever its size
+void RewindBuffer::dropOldest()
+{
+	size_t next = 1;
+	while(next < entries.size() && !entries[next].key)
+		next++;
+	if(next == entries.size())
+		return;
+
+	for(size_t i = 0; i < next; i++)
+	{
+		used -= entries.front().data.size() + RW_ENTRY_OVERHEAD;
+		entries.pop_front();
+	}
+}
+
+void RewindBuffer::decodeNewest(std::vector<uint8> &state)
+{
+	size_t newest = entries.size() - 1;
+	size_t k = newest;
+	while(!entries[k].key)
+		k--;
+
+	if(cachedKeySeq != entries[k].seq)
+	{
+		cachedKey = zeros;
+		FCEU_DecodeStateDelta(entries[k].data, cachedKey);
+		cachedKeySeq = entries[k].seq;
+	}
+
+	state = cachedKey;
+	if(k != newest)
+		FCEU_DecodeStateDelta(entries[newest].data, state);
+}
+
+bool RewindBuffer::peek(std::vector<uint8> &state)
+{
+	if(entries.empty())
+		return false;
+	decodeNewest(state);
+	return true;
+}
+
+bool RewindBuffer::pop(std::vector<uint8> &state)
+{
+	if(entries.empty())
+		return false;
+	decodeNewest(state);
+
+	used -= entries.back().data.size() + RW_ENTRY_OVERHEAD;
+	entries.pop_back();
+
+	//key may be a keyframe that's gone now, so the next push starts a new one
+	sinceKey = keyInterval;
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+
+static RewindBuffer history;
+static FCEUFlatSnapshot snapshot;
+static bool enabled = false;
+static bool rewinding = false;
+static int interval = 1;     //frames between snapshots
+static int counter = 0;
+static uint32 layout = 0;    //the flat snapshot layout the history was taken with
+
+void FCEUI_SetRewind(bool enable, int frames, int budgetMB)
+{
+	enabled = enable;
+	interval = frames > 0 ? frames : 1;
+	history.configure((size_t)(budgetMB > 0 ? budgetMB : 1) << 20, 60);
+	if(!enabled)
+		history.clear();
+}
+
+bool FCEUI_GetRewind(void)
+{
+	return enabled;
+}
+
+void FCEUI_SetRewinding(bool on)
+{
+	rewinding = on;
+}
+
+//the history can't be replayed into movies or netplay, which need every frame's input
+static bool RewindAllowed(void)
+{
+	return enabled
+		&& GameInfo
+		&& GameInfo->type != GIT_NSF
+		&& FCEUMOV_Mode(MOVIEMODE_INACTIVE)
+		&& !FCEUnetplay;
+}
+
+bool FCEU_RewindStep(void)
+{
+	if(!rewinding || !RewindAllowed())
+		return false;
+
+	//at the oldest snapshot, keep showing it
+	bool ok = history.getCount() > 1 ? history.pop(snapshot.data) : history.peek(snapshot.data);
+	if(!ok)
+		return false;
+
+	snapshot.plan = layout;
+	if(!FCEUSS_LoadFlat(snapshot))
+	{
+		history.clear();
+		return false;
+	}
+	counter = 0;
+	return true;
+}
+
+void FCEU_RewindCapture(void)
+{
+	if(!RewindAllowed() || ++counter < interval)
+		return;
+	counter = 0;
+
+	if(!FCEUSS_SaveFlat(snapshot))
+		return;
+
+	//another game, or the same one with different mapper state registered
+	if(snapshot.plan != layout)
+	{
+		history.clear();
+		layout = snapshot.plan;
+	}
+	history.push(&snapshot.data[0], snapshot.data.size());
+}
@@ -0,0 +1,77 @@
+#ifndef _REWIND_H_
+#define _REWIND_H_
+
+#include "types.h"
+
+#include <deque>
+#include <vector>
+
+//Rewind history.
+//
+//A bounded ring of machine snapshots, newest last. Every keyInterval-th one is a keyframe; the
+//others are stored as the bytes that differ from their keyframe (XOR, with unchanged runs
+//skipped), which for a frame's worth of play is usually a small part of RAM, WRAM and CHR-RAM.
+//Keyframes are stored the same way against zeros. When the ring outgrows its budget the oldest
+//keyframe goes, together with the deltas that depend on it. Nothing here knows what a snapshot
+//holds, so it can be fed any buffers.
+class RewindBuffer
+{
+public:
+	RewindBuffer();
+
+	//budget: bytes of encoded snapshots to keep. keyInterval: snapshots per keyframe
+	void configure(size_t budget, int keyInterval);
+	void clear();
+
+	//adds a snapshot. one of a different size than the last starts a new history
+	void push(const uint8 *state, size_t size);
+
+	//restores the newest snapshot into state and drops it. false if there are none
+	bool pop(std::vector<uint8> &state);
+
+	//restores the newest snapshot without dropping it
+	bool peek(std::vector<uint8> &state);
+
+	int getCount() const { return (int)entries.size(); }
+	size_t getUsed() const { return used; }
+
+private:
+	struct Entry
+	{
+		std::vector<uint8> data;
+		uint64 seq;
+		bool key;
+	};
+
+	void decodeNewest(std::vector<uint8> &state);
+	void dropOldest();
+
+	std::deque<Entry> entries;
+	size_t budget;
+	int keyInterval;
+	size_t used;
+	size_t size;               //of a snapshot
+	uint64 nextSeq;
+	int sinceKey;              //snapshots pushed since the newest keyframe, including it
+	std::vector<uint8> key;    //the newest keyframe, which pushes are encoded against
+	std::vector<uint8> zeros;
+	std::vector<uint8> scratch;
+	uint64 cachedKeySeq;       //the keyframe decoded in cachedKey, 0 if none
+	std::vector<uint8> cachedKey;
+};
+
+//the encoding the history keeps snapshots in, for others that keep them: the bytes of cur that
+//differ from ref, XORed with it, with the unchanged runs between them skipped
+void FCEU_EncodeStateDelta(const uint8 *cur, const uint8 *ref, size_t size, std::vector<uint8> &out);
+//state holds the reference, and becomes the encoded snapshot. false if in doesn't fit it
+bool FCEU_DecodeStateDelta(const std::vector<uint8> &in, std::vector<uint8> &state);
+
+//core hooks, they do nothing unless rewind is enabled
+
+//called before a frame is emulated. while rewinding, restores the previous snapshot and returns
+//true: the frame is emulated from there and its sound is dropped
+bool FCEU_RewindStep(void);
+//called after a frame that didn't rewind
+void FCEU_RewindCapture(void);
+
+#endif
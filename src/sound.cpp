@@ -27,6 +27,7 @@
 #include "state.h"
 #include "wave.h"
 #include "debug.h"
+#include "perftrace.h"
 
 #include <cstdlib>
 #include <cstdio>
@@ -145,6 +146,12 @@ static void (*DoSQ2)(void)=Dummyfunc;
 
 static uint32 ChannelBC[5];
 
+/* Nonzero while sound output is being skipped (muted turbo, see FCEUSND_SetFastSkip).
+   The channel functions then only advance the waveform generators, in CPU cycles.
+   Never set with expansion sound, whose register writes synthesize regardless. */
+static int apufastskip=0;
+static int32 inbuf=0;
+
 //savestate sync hack stuff
 int movieSyncHackOn=0,resetDMCacc=0,movieConvertOffset1,movieConvertOffset2;
 
@@ -1008,6 +1015,239 @@ static void RDoNoise(void)
  ChannelBC[3]=SOUNDTS;
 }
 
+/* State-only channel updates used when no samples are wanted.  Length counters,
+   envelopes and sweeps are clocked by FrameSoundStuff() as usual; these just bring the
+   per-channel timers, duty/triangle steps and the noise shift register up to SOUNDTS
+   in closed form instead of cycle by cycle, and never touch WaveHi. */
+
+/* Advances a count-down timer that reloads with "period" when it reaches zero, returns
+   the number of reloads.  Same result as decrementing it "cycles" times. */
+static INLINE uint32 SkipTimer(int32 *count, int32 period, uint32 cycles)
+{
+ uint32 steps;
+
+ if(*count<=0) *count=period;
+ if(cycles<(uint32)*count)
+ {
+  *count-=cycles;
+  return(0);
+ }
+ cycles-=*count;
+ steps=1+cycles/period;
+ *count=period-cycles%period;
+ return(steps);
+}
+
+/* Clocks the noise LFSR "steps" times.  The feedback bits for the next 13 (long mode)
+   or 9 (short mode) shifts only depend on the current register, so they are produced
+   a chunk at a time. */
+static void SkipNoiseLFSR(uint32 steps)
+{
+ uint32 r=nreg;
+ int tap=(PSG[0xE]&0x80)?6:1;
+ uint32 chunk=(PSG[0xE]&0x80)?9:13;
+
+ while(steps)
+ {
+  uint32 k=steps<chunk?steps:chunk;
+  uint32 fb=(r^(r>>tap))>>(14-tap+1-k);
+  r=((r<<k)|(fb&((1<<k)-1)))&0x7fff;
+  steps-=k;
+ }
+ nreg=r;
+}
+
+static INLINE void SDoSQ(int x)
+{
+ if(curfreq[x]>=8 && curfreq[x]<=0x7ff && CheckFreq(curfreq[x],PSG[(x<<2)|0x1]) && lengthcount[x] && SOUNDTS>ChannelBC[x])
+  RectDutyCount[x]=(RectDutyCount[x]+SkipTimer(&wlcount[x],(curfreq[x]+1)*2,SOUNDTS-ChannelBC[x]))&7;
+ ChannelBC[x]=SOUNDTS;
+}
+
+static void SDoSQ1(void)
+{
+ SDoSQ(0);
+}
+
+static void SDoSQ2(void)
+{
+ SDoSQ(1);
+}
+
+static void SDoTriangle(void)
+{
+ if(lengthcount[2] && TriCount && SOUNDTS>ChannelBC[2])
+  tristep+=SkipTimer(&wlcount[2],(PSG[0xa]|((PSG[0xb]&7)<<8))+1,SOUNDTS-ChannelBC[2]);
+ ChannelBC[2]=SOUNDTS;
+}
+
+static void SDoNoise(void)
+{
+ if(SOUNDTS>ChannelBC[3])
+ {
+  int32 period=PAL?NoiseFreqTablePAL[PSG[0xE]&0xF]:NoiseFreqTableNTSC[PSG[0xE]&0xF];
+  SkipNoiseLFSR(SkipTimer(&wlcount[3],period,SOUNDTS-ChannelBC[3]));
+ }
+ ChannelBC[3]=SOUNDTS;
+}
+
+static void SDoPCM(void)
+{
+ ChannelBC[4]=SOUNDTS;
+}
+
+static void SetSoundChannelFuncs(void)
+{
+ if(!FSettings.SndRate || apufastskip)
+ {
+  DoSQ1=SDoSQ1;
+  DoSQ2=SDoSQ2;
+  DoTriangle=SDoTriangle;
+  DoNoise=SDoNoise;
+  DoPCM=SDoPCM;
+ }
+ else if(FSettings.soundq>=1)
+ {
+  DoNoise=RDoNoise;
+  DoTriangle=RDoTriangle;
+  DoPCM=RDoPCM;
+  DoSQ1=RDoSQ1;
+  DoSQ2=RDoSQ2;
+ }
+ else
+ {
+  DoSQ1=RDoSQLQ;
+  DoSQ2=RDoSQLQ;
+  DoTriangle=RDoTriangleNoisePCMLQ;
+  DoNoise=RDoTriangleNoisePCMLQ;
+  DoPCM=RDoTriangleNoisePCMLQ;
+ }
+}
+
+/* Brings the channels up to date without producing samples and rebases them on the
+   timestamp the next frame starts at.  In fast-skip mode the timestamps are in CPU cycles
+   at either quality. */
+static void SyncSkippedSound(uint32 nextbase)
+{
+ DoSQ1();
+ DoSQ2();
+ DoTriangle();
+ DoNoise();
+ DoPCM();
+
+ for(int x=0;x<5;x++)
+  ChannelBC[x]=nextbase;
+}
+
+/* The expansion chips render into WaveHi/Wave from their own write handlers and keep their
+   own positions in it, which only a real frame end rebases (HiSync at high quality, Fill at
+   low), so they have no state-only mode. */
+static int ExpSoundSynthesizes(void)
+{
+ return GameExpSound.Fill || GameExpSound.HiFill || GameExpSound.NeoFill;
+}
+
+/* Switches sound synthesis off (on!=0) or back on.  While off, the APU still runs with
+   exact register-visible state, but nothing is written to WaveHi/Wave; end such frames
+   with SkipEmulateSound() instead of FlushEmulateSound().  Best called between frames.
+   With expansion sound it stays on, and SkipEmulateSound() mixes the frame and drops it. */
+void FCEUSND_SetFastSkip(int on)
+{
+ on=(on && !ExpSoundSynthesizes())?1:0;
+ if(on==apufastskip) return;
+
+ if(!FSettings.SndRate)
+ {
+  apufastskip=on;
+  return;
+ }
+
+ if(on)
+ {
+  DoSQ1();
+  DoSQ2();
+  DoTriangle();
+  DoNoise();
+  DoPCM();
+  apufastskip=1;
+  SetSoundChannelFuncs();
+  for(int x=0;x<5;x++)
+   ChannelBC[x]=SOUNDTS;
+ }
+ else
+ {
+  DoSQ1();
+  DoSQ2();
+  DoTriangle();
+  DoNoise();
+  DoPCM();
+  apufastskip=0;
+  SetSoundChannelFuncs();
+
+  /* Whatever was left in the buffers belongs to frames that were never output. */
+  memset(Wave,0,sizeof(Wave));
+  memset(WaveHi,0,sizeof(WaveHi));
+  if(FSettings.soundq>=1)
+  {
+   for(int x=0;x<5;x++)
+    ChannelBC[x]=SOUNDTS;
+  }
+  else
+  {
+   for(int x=0;x<5;x++)
+    ChannelBC[x]=(SOUNDTS<<16)/soundtsinc;
+  }
+ }
+}
+
+int FCEUSND_GetFastSkip(void)
+{
+ return(apufastskip);
+}
+
+/* Frames that are emulated and then undone by reloading a snapshot (run-ahead).  They run in
+   fast-skip mode, and FCEUSND_EndHiddenFrames(), called once the snapshot is back, returns the
+   synthesis to exactly where the last audible frame left it: the waveform positions aren't part
+   of a savestate, and unlike when leaving fast-skip mode, the samples carried over from that
+   frame are kept, since they still belong to the output.
+   Call both between frames, outside of fast-skip mode, and not with expansion sound, which
+   stays synthesized (see FCEUSND_SetFastSkip) and isn't restored here. */
+static struct
+{
+ uint32 channelbc[5];
+ uint32 tsoffs;
+ int32 inbuf;
+ int32 tristep;
+ int32 wlcount[4];
+ int32 rectdutycount[2];
+ int32 sqacc[2];
+} hidden;
+
+void FCEUSND_BeginHiddenFrames(void)
+{
+ memcpy(hidden.channelbc,ChannelBC,sizeof(ChannelBC));
+ hidden.tsoffs=soundtsoffs;
+ hidden.inbuf=inbuf;
+ hidden.tristep=tristep;
+ memcpy(hidden.wlcount,wlcount,sizeof(wlcount));
+ memcpy(hidden.rectdutycount,RectDutyCount,sizeof(RectDutyCount));
+ memcpy(hidden.sqacc,sqacc,sizeof(sqacc));
+ FCEUSND_SetFastSkip(1);
+}
+
+void FCEUSND_EndHiddenFrames(void)
+{
+ memcpy(ChannelBC,hidden.channelbc,sizeof(ChannelBC));
+ soundtsoffs=hidden.tsoffs;
+ inbuf=hidden.inbuf;
+ tristep=hidden.tristep;
+ memcpy(wlcount,hidden.wlcount,sizeof(wlcount));
+ memcpy(RectDutyCount,hidden.rectdutycount,sizeof(RectDutyCount));
+ memcpy(sqacc,hidden.sqacc,sizeof(sqacc));
+ apufastskip=0;
+ SetSoundChannelFuncs();
+}
+
 DECLFW(Write_IRQFM)
 {
  V=(V&0xC0)>>6;
@@ -1031,8 +1271,8 @@ void SetNESSoundMap(void)
   SetReadHandler(0x4015,0x4015,StatusRead);
 }
 
-static int32 inbuf=0;
-int FlushEmulateSound(void)
+/* Mixes the frame into WaveFinal, returning the number of samples. */
+static int MixSoundFrame(void)
 {
   int x;
   int32 end,left;
@@ -1041,6 +1281,7 @@ int FlushEmulateSound(void)
 
   if(!FSettings.SndRate)
   {
+   SyncSkippedSound(0);
    left=0;
    end=0;
    goto nosoundo;
@@ -1101,6 +1342,13 @@ int FlushEmulateSound(void)
    end>>=4;
   }
   inbuf=end;
+  return(end);
+}
+
+int FlushEmulateSound(void)
+{
+  PerfScope perf(PERF_SOUND);
+  int end=MixSoundFrame();
 
   FCEU_WriteWaveData(WaveFinal, end); /* This function will just return
 				    if sound recording is off. */
@@ -1113,6 +1361,22 @@ int GetSoundBuffer(int32 **W)
  return(inbuf);
 }
 
+/* Frame end counterpart of FlushEmulateSound() for frames emulated in fast-skip mode. */
+void SkipEmulateSound(void)
+{
+ if(!apufastskip)
+ {
+  MixSoundFrame();
+  inbuf=0;
+  return;
+ }
+
+ if(!soundtimestamp) return;
+
+ SyncSkippedSound(soundtsoffs);
+ inbuf=0;
+}
+
 /* FIXME:  Find out what sound registers get reset on reset.  I know $4001/$4005 don't,
 due to that whole MegaMan 2 Game Genie thing.
 */
@@ -1232,27 +1496,12 @@ void SetSoundVariables(void)
     wlookup2[x]=(double)16*16*16*4*163.67/((double)24329/(double)x+100);
     if(!FSettings.soundq) wlookup2[x]>>=4;
    }
-   if(FSettings.soundq>=1)
-   {
-    DoNoise=RDoNoise;
-    DoTriangle=RDoTriangle;
-    DoPCM=RDoPCM;
-    DoSQ1=RDoSQ1;
-    DoSQ2=RDoSQ2;
-   }
-   else
-   {
-    DoNoise=DoTriangle=DoPCM=DoSQ1=DoSQ2=Dummyfunc;
-    DoSQ1=RDoSQLQ;
-    DoSQ2=RDoSQLQ;
-    DoTriangle=RDoTriangleNoisePCMLQ;
-    DoNoise=RDoTriangleNoisePCMLQ;
-    DoPCM=RDoTriangleNoisePCMLQ;
-   }
+   SetSoundChannelFuncs();
   }
   else
   {
-   DoNoise=DoTriangle=DoPCM=DoSQ1=DoSQ2=Dummyfunc;
+   /* No output, but keep the channel timers and noise register running. */
+   SetSoundChannelFuncs();
    return;
   }
 
@@ -1287,6 +1536,11 @@ void FCEUI_SetSoundQuality(int quality)
 	SetSoundVariables();
 }
 
+void FCEUI_SetSoundResampleRatio(double ratio)
+{
+	SetFilterResampleRatio(ratio);
+}
+
 void FCEUI_SetSoundVolume(uint32 volume)
 {
 	FSettings.SoundVolume=volume;
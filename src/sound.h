@@ -46,6 +46,11 @@ void SetSoundVariables(void);
 
 int GetSoundBuffer(int32 **W);
 int FlushEmulateSound(void);
+void SkipEmulateSound(void);
+void FCEUSND_SetFastSkip(int on);
+int FCEUSND_GetFastSkip(void);
+void FCEUSND_BeginHiddenFrames(void);
+void FCEUSND_EndHiddenFrames(void);
 extern int32 Wave[2048+512];
 extern int32 WaveFinal[2048+512];
 extern int32 WaveHi[];
@@ -53,6 +53,15 @@ static void read_json_bool_if_present(bool * value, Document & d, char const * k
     }
 }
 
+static void read_json_uint_if_present(uint32_t * value, Document & d, char const * key)
+{
+    Document::MemberIterator it = d.FindMember(key);
+    if (it != d.MemberEnd())
+    {
+        *value = it->value.GetUint();
+    }
+}
+
 //==================================================================================================
 void StandaloneConfig::LoadFromFile(std::string const file_path)
 {
@@ -77,6 +86,25 @@ void StandaloneConfig::LoadFromFile(std::string const file_path)
         read_json_bool_if_present(&use_hq2x, d, "use_hq2x");
         read_json_bool_if_present(&disable_spritelimit, d, "disable_spritelimit");
         read_json_bool_if_present(&stretch_to_screen, d, "stretch_to_screen");
+        read_json_bool_if_present(&adaptive_quality, d, "adaptive_quality");
+        read_json_bool_if_present(&pipelined_presentation, d, "pipelined_presentation");
+        read_json_uint_if_present(&run_ahead_frames, d, "run_ahead_frames");
+        read_json_bool_if_present(&frame_delay, d, "frame_delay");
+        read_json_bool_if_present(&late_input_poll, d, "late_input_poll");
+        read_json_bool_if_present(&measure_latency, d, "measure_latency");
+        read_json_bool_if_present(&perf_trace, d, "perf_trace");
+        read_json_bool_if_present(&audio_log, d, "audio_log");
+        read_json_bool_if_present(&max_speed_turbo, d, "max_speed_turbo");
+        read_json_bool_if_present(&rewind, d, "rewind");
+        read_json_uint_if_present(&rewind_interval, d, "rewind_interval");
+        read_json_uint_if_present(&rewind_budget_mb, d, "rewind_budget_mb");
+        read_json_bool_if_present(&resume_session, d, "resume_session");
+        read_json_uint_if_present(&resume_save_interval_s, d, "resume_save_interval_s");
+        read_json_bool_if_present(&movie_state_digests, d, "movie_state_digests");
+        read_json_bool_if_present(&movie_keyframes, d, "movie_keyframes");
+        read_json_uint_if_present(&movie_keyframe_interval, d, "movie_keyframe_interval");
+        read_json_uint_if_present(&movie_keyframe_budget_mb, d, "movie_keyframe_budget_mb");
+        read_json_bool_if_present(&movie_keyframe_sidecar, d, "movie_keyframe_sidecar");
 
         if (d.HasMember("button_mappings"))
         {
@@ -146,6 +174,25 @@ void StandaloneConfig::SaveToFile(std::string const file_path)
         d.AddMember("use_hq2x", use_hq2x, d.GetAllocator());
         d.AddMember("disable_spritelimit", disable_spritelimit, d.GetAllocator());
         d.AddMember("stretch_to_screen", stretch_to_screen, d.GetAllocator());
+        d.AddMember("adaptive_quality", adaptive_quality, d.GetAllocator());
+        d.AddMember("pipelined_presentation", pipelined_presentation, d.GetAllocator());
+        d.AddMember("run_ahead_frames", run_ahead_frames, d.GetAllocator());
+        d.AddMember("frame_delay", frame_delay, d.GetAllocator());
+        d.AddMember("late_input_poll", late_input_poll, d.GetAllocator());
+        d.AddMember("measure_latency", measure_latency, d.GetAllocator());
+        d.AddMember("perf_trace", perf_trace, d.GetAllocator());
+        d.AddMember("audio_log", audio_log, d.GetAllocator());
+        d.AddMember("max_speed_turbo", max_speed_turbo, d.GetAllocator());
+        d.AddMember("rewind", rewind, d.GetAllocator());
+        d.AddMember("rewind_interval", rewind_interval, d.GetAllocator());
+        d.AddMember("rewind_budget_mb", rewind_budget_mb, d.GetAllocator());
+        d.AddMember("resume_session", resume_session, d.GetAllocator());
+        d.AddMember("resume_save_interval_s", resume_save_interval_s, d.GetAllocator());
+        d.AddMember("movie_state_digests", movie_state_digests, d.GetAllocator());
+        d.AddMember("movie_keyframes", movie_keyframes, d.GetAllocator());
+        d.AddMember("movie_keyframe_interval", movie_keyframe_interval, d.GetAllocator());
+        d.AddMember("movie_keyframe_budget_mb", movie_keyframe_budget_mb, d.GetAllocator());
+        d.AddMember("movie_keyframe_sidecar", movie_keyframe_sidecar, d.GetAllocator());
 
         // Gamepad config.
         std::array<std::string, NESButton::COUNT> const enum_to_key = {
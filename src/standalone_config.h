@@ -41,6 +41,25 @@ public:
     bool use_hq2x = false;
     bool disable_spritelimit = false;
     bool stretch_to_screen = false;
+    bool adaptive_quality = true;
+    bool pipelined_presentation = false;
+    uint32_t run_ahead_frames = 0;
+    bool frame_delay = false;
+    bool late_input_poll = false;
+    bool measure_latency = false;
+    bool perf_trace = false;
+    bool audio_log = false;
+    bool max_speed_turbo = true;
+    bool rewind = false;
+    uint32_t rewind_interval = 1;
+    uint32_t rewind_budget_mb = 64;
+    bool resume_session = false;
+    uint32_t resume_save_interval_s = 60;
+    bool movie_state_digests = false;
+    bool movie_keyframes = false;
+    uint32_t movie_keyframe_interval = 60;
+    uint32_t movie_keyframe_budget_mb = 64;
+    bool movie_keyframe_sidecar = false;
 
     std::vector<ButtonMapping> button_mappings;
 
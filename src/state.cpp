@@ -37,6 +37,8 @@
 #include "video.h"
 #include "input.h"
 #include "driver.h"
+#include "statewriter.h"
+#include "statedigest.h"
 
 //TODO - we really need some kind of global platform-specific options api
 #ifdef WIN32
@@ -50,7 +52,10 @@
 //#include <unistd.h> //mbg merge 7/17/06 removed
 
 #include <vector>
+#include <deque>
+#include <algorithm>
 #include <fstream>
+#include <unordered_map>
 
 using namespace std;
 
@@ -85,6 +90,8 @@ std::vector<uint8> compressed_buf;
 static SFORMAT SFMDATA[SFMDATA_SIZE];
 static int SFEXINDEX;
 
+static uint32 stateLayoutId = 1;	//bumped whenever the registered state changes
+
 #define RLSB 		FCEUSTATE_RLSB	//0x80000000
 
 
@@ -180,33 +187,76 @@ static int WriteStateChunk(EMUFILE* os, int type, SFORMAT *sf)
 	return (bsize+5);
 }
 
-static SFORMAT *CheckS(SFORMAT *sf, uint32 tsize, char *desc)
+//tag -> entry indexes of the SFORMAT lists, so that ReadStateChunk() finds a field without
+//walking its list. rebuilt when the registered state changes
+struct StateIndex
 {
-	while(sf->v)
+	SFORMAT *root;
+	uint32 layout;
+	std::unordered_map<uint32,SFORMAT*> tags;
+};
+
+static std::vector<StateIndex> stateIndexes;
+
+static uint32 StateTag(const char *desc)
+{
+	uint32 tag;
+	memcpy(&tag,desc,4);
+	return tag;
+}
+
+static void IndexStateList(StateIndex &index, SFORMAT *sf)
+{
+	for(;sf->v;sf++)
 	{
 		if(sf->s==~0)		// Link to another SFORMAT structure.
 		{
-			SFORMAT *tmp;
-			if((tmp= CheckS((SFORMAT *)sf->v, tsize, desc) ))
-				return(tmp);
-			sf++;
+			IndexStateList(index,(SFORMAT *)sf->v);
 			continue;
 		}
-		if(!memcmp(desc,sf->desc,4))
-		{
-			if(tsize!=(sf->s&(~FCEUSTATE_FLAGS)))
-				return(0);
-			return(sf);
-		}
-		sf++;
+		//the first entry with a tag wins, as it did when the lists were searched
+		if(sf->desc)
+			index.tags.insert(std::make_pair(StateTag(sf->desc),sf));
 	}
-	return(0);
+}
+
+static const StateIndex &GetStateIndex(SFORMAT *sf)
+{
+	size_t i;
+	for(i=0;i<stateIndexes.size();i++)
+		if(stateIndexes[i].root==sf)
+			break;
+	if(i==stateIndexes.size())
+	{
+		stateIndexes.push_back(StateIndex());
+		stateIndexes[i].root=sf;
+		stateIndexes[i].layout=0;
+	}
+
+	StateIndex &index = stateIndexes[i];
+	if(index.layout!=stateLayoutId)
+	{
+		index.tags.clear();
+		IndexStateList(index,sf);
+		index.layout=stateLayoutId;
+	}
+	return index;
+}
+
+//a field whose size doesn't match the entry is skipped
+static SFORMAT *CheckS(const StateIndex &index, uint32 tsize, char *desc)
+{
+	std::unordered_map<uint32,SFORMAT*>::const_iterator it = index.tags.find(StateTag(desc));
+	if(it==index.tags.end() || tsize!=(it->second->s&(~FCEUSTATE_FLAGS)))
+		return(0);
+	return(it->second);
 }
 
 static bool ReadStateChunk(EMUFILE* is, SFORMAT *sf, int size)
 {
 	SFORMAT *tmp;
 	int temp = is->ftell();
+	const StateIndex &index = GetStateIndex(sf);
 
 	while(is->ftell()<temp+size)
 	{
@@ -217,7 +267,7 @@ static bool ReadStateChunk(EMUFILE* is, SFORMAT *sf, int size)
 
 		read32le(&tsize,is);
 
-		if((tmp=CheckS(sf,tsize,toa)))
+		if((tmp=CheckS(index,tsize,toa)))
 		{
 			if(tmp->s&FCEUSTATE_INDIRECT)
 				is->fread(*(char **)tmp->v,tmp->s&(~FCEUSTATE_FLAGS));
@@ -235,6 +285,66 @@ static bool ReadStateChunk(EMUFILE* is, SFORMAT *sf, int size)
 	return true;
 }
 
+//the fields of a chunk must add up to its size
+static bool ValidateStateFields(EMUFILE* is, uint32 size)
+{
+	while(size)
+	{
+		char toa[4];
+		uint32 tsize;
+		if(size<8 || is->fread(toa,4)<4 || !read32le(&tsize,is))
+			return false;
+		size-=8;
+		if(tsize>size)
+			return false;
+		is->fseek(tsize,SEEK_CUR);
+		size-=tsize;
+	}
+	return true;
+}
+
+//walks the chunk and field headers without loading anything, so that a state whose sizes
+//don't add up fails before it has overwritten part of the machine
+static bool ValidateStateChunks(EMUFILE* is, int32 totalsize)
+{
+	int start = is->ftell();
+	bool ok = true;
+
+	while(totalsize > 0)
+	{
+		int t=is->fgetc();
+		uint32 size;
+		if(t==EOF || !read32le(&size,is)) break;
+		if((int64)size + 5 > totalsize)
+		{
+			ok=false;
+			break;
+		}
+		totalsize -= size + 5;
+
+		switch(t)
+		{
+		case 1: case 2: case 3: case 31: case 4: case 5: case 6: case 0x10:
+			if(!ValidateStateFields(is,size))
+				ok=false;
+			break;
+		case 8:
+			//read straight into XBackBuf, so it has to be the size that's written
+			if(size != 256*256+8)
+				ok=false;
+			else
+				is->fseek(size,SEEK_CUR);
+			break;
+		default:
+			is->fseek(size,SEEK_CUR);
+		}
+		if(!ok) break;
+	}
+
+	is->fseek(start,SEEK_SET);
+	return ok;
+}
+
 static int read_sfcpuc=0, read_snd=0;
 
 void FCEUD_BlitScreen(uint8 *XBuf); //mbg merge 7/17/06 YUCKY had to add
@@ -249,6 +359,12 @@ static bool ReadStateChunks(EMUFILE* is, int32 totalsize)
 	read_sfcpuc=0;
 	read_snd=0;
 
+	if(!ValidateStateChunks(is,totalsize))
+		return false;
+
+	//RAM is about to be written behind the CPU's back
+	RAMDirty = ~0u;
+
 	//mbg 6/16/08 - wtf
 	//// int moo=X.mooPI;
 	// if(!scan_chunks)
@@ -357,17 +473,151 @@ int CurrentState=0;
 extern int geniestage;
 
 
+//writes every chunk of the machine state. the movie chunks are left out of snapshots that
+//never leave the emulator, the back buffer when the caller only wants the machine itself
+static uint32 WriteStateChunks(EMUFILE* os, bool withMovie, bool withBackBuffer)
+{
+	uint32 totalsize = 0;
+
+	FCEUPPU_SaveState();
+	FCEUSND_SaveState();
+	totalsize=WriteStateChunk(os,1,SFCPU);
+	totalsize+=WriteStateChunk(os,2,SFCPUC);
+	totalsize+=WriteStateChunk(os,3,FCEUPPU_STATEINFO);
+	totalsize+=WriteStateChunk(os,31,FCEU_NEWPPU_STATEINFO);
+	totalsize+=WriteStateChunk(os,4,FCEUCTRL_STATEINFO);
+	totalsize+=WriteStateChunk(os,5,FCEUSND_STATEINFO);
+	if(withMovie && FCEUMOV_Mode(MOVIEMODE_PLAY|MOVIEMODE_RECORD|MOVIEMODE_FINISHED))
+	{
+		totalsize+=WriteStateChunk(os,6,FCEUMOV_STATEINFO);
+
+		uint32 size = FCEUMOV_WriteState((EMUFILE_MEMORY*)0);
+		os->fputc(7);
+		write32le(size, os);
+		FCEUMOV_WriteState(os);
+		totalsize += 5 + size;
+	}
+	if(withBackBuffer)
+	{
+		extern uint8 *XBackBuf;
+		uint32 size = 256 * 256 + 8;
+		os->fputc(8);
+		write32le(size, os);
+		os->fwrite((char*)XBackBuf,size);
+		totalsize += 5 + size;
+	}
+
+	if(SPreSave) SPreSave();
+	totalsize+=WriteStateChunk(os,0x10,SFMDATA);
+	if(SPostSave) SPostSave();
+
+	return totalsize;
+}
+
 bool FCEUSS_SaveMS(EMUFILE* outstream, int compressionLevel)
 {
-    // NOTE(ross): NESTEK doesn't need to do this.
-    return 0;
+	//FCEUSS_LoadFP() doesn't inflate, so the chunks are always written as they are and
+	//compressionLevel is only kept for the callers' sake
+	(void)compressionLevel;
+
+	// reinit memory_savestate
+	memory_savestate.set_len(0);	// this also seeks to the beginning
+	memory_savestate.unfail();
+
+	uint32 totalsize = WriteStateChunks(&memory_savestate, true, true);
+
+	if((uint32)memory_savestate.size() != totalsize)
+	{
+		FCEUD_PrintError("sanity violation: totalsize != len");
+		return false;
+	}
+
+	uint8 header[16]="FCSX";
+	FCEU_en32lsb(header+4, totalsize);
+	FCEU_en32lsb(header+8, FCEU_VERSION_NUMERIC);
+	FCEU_en32lsb(header+12, (uint32)-1);
+
+	outstream->fwrite((char*)header,16);
+	outstream->fwrite((char*)memory_savestate.buf(),totalsize);
+
+	return !outstream->fail();
+}
+
+bool FCEUSS_SaveSnapshot(EMUFILE_MEMORY &ms)
+{
+	ms.set_len(0);
+	ms.unfail();
+	uint32 totalsize = WriteStateChunks(&ms, false, false);
+	return !ms.fail() && (uint32)ms.size() == totalsize;
+}
+
+bool FCEUSS_LoadSnapshot(EMUFILE_MEMORY &ms)
+{
+	ms.fseek(0, SEEK_SET);
+	ms.unfail();
+
+	if(!ReadStateChunks(&ms, ms.size()))
+		return false;
+
+	if(GameStateRestore)
+		GameStateRestore(FCEU_VERSION_NUMERIC);
+	FCEUPPU_LoadState(FCEU_VERSION_NUMERIC);
+	FCEUSND_LoadState(FCEU_VERSION_NUMERIC);
+	return true;
 }
 
 
+//savestate files are written by a thread of their own; the emulation thread only serializes them
+static StateWriter stateWriter;
+
+//saves to a slot, in the order they were queued, waiting to be reported
+struct PendingSlotSave
+{
+	std::string path;
+	int slot;
+	bool display_message;
+};
+static std::deque<PendingSlotSave> pendingSlotSaves;
+
+void FCEUSS_ReportWrites(void)
+{
+	std::vector<StateWriter::Result> results = stateWriter.takeResults();
+	for(size_t i=0;i<results.size();i++)
+	{
+		const StateWriter::Result &r = results[i];
+		if(!r.backup && !pendingSlotSaves.empty() && pendingSlotSaves.front().path == r.path)
+		{
+			PendingSlotSave save = pendingSlotSaves.front();
+			pendingSlotSaves.pop_front();
+			if(r.ok)
+			{
+				SaveStateStatus[save.slot] = 1;
+				if (save.display_message)
+					FCEU_DispMessage("State %d saved.", 0, save.slot);
+				continue;
+			}
+			if (save.display_message)
+				FCEU_DispMessage("State %d save error.", 0, save.slot);
+			FCEU_printf("Error writing savestate %s\n",r.path.c_str());
+			continue;
+		}
+		if(!r.ok)
+		{
+			FCEU_DispMessage("Error writing %s.",0,r.path.c_str());
+			FCEU_printf("Error writing savestate %s\n",r.path.c_str());
+		}
+	}
+}
+
+void FCEUSS_FlushWrites(void)
+{
+	stateWriter.flush();
+	FCEUSS_ReportWrites();
+}
+
 void FCEUSS_Save(const char *fname, bool display_message)
 {
-	EMUFILE* st = 0;
-	char fn[2048];
+	std::string fn;
 
 	if (geniestage==1)
 	{
@@ -376,52 +626,102 @@ void FCEUSS_Save(const char *fname, bool display_message)
 		return;
 	}
 
+	FCEUSS_ReportWrites();
+
 	if(fname)	//If filename is given use it.
 	{
-		st = FCEUD_UTF8_fstream(fname, "wb");
-		strcpy(fn, fname);
+		fn = fname;
 	}
 	else		//Else, generate one
 	{
 		//FCEU_PrintError("daCurrentState=%d",CurrentState);
-		strcpy(fn, FCEU_MakeFName(FCEUMKF_STATE,CurrentState,0).c_str());
+		fn = FCEU_MakeFName(FCEUMKF_STATE,CurrentState,0);
 
-		//backup existing savestate first
-		if (CheckFileExists(fn) && backupSavestates)	//adelikat:  If the files exists and we are allowed to make backup savestates
+		//backup existing savestate first. an earlier save to it may still be queued, so whether
+		//there is one is left to the writer, which only renames what it finds
+		if (backupSavestates)
 		{
-			CreateBackupSaveState(fn);		//Make a backup of previous savestate before overwriting it
-			strcpy(lastSavestateMade,fn);	//Remember what the last savestate filename was (for undoing later)
-			undoSS = true;					//Backup was created so undo is possible
+			CreateBackupSaveState(fn.c_str());		//Make a backup of previous savestate before overwriting it
+			strcpy(lastSavestateMade,fn.c_str());	//Remember what the last savestate filename was (for undoing later)
+			undoSS = true;					//SwapSaveState() checks the backup is really there
 		}
 		else
 			undoSS = false;					//so backup made so lastSavestateMade does have a backup file, so no undo
-
-		st = FCEUD_UTF8_fstream(fn,"wb");
 	}
 
-	if (st == NULL || st->get_fp() == NULL)
+	std::vector<uint8> image;
+	EMUFILE_MEMORY ms(&image);
+	if(!FCEUSS_SaveMS(&ms, FCEUMOV_Mode(MOVIEMODE_INACTIVE) ? -1 : 0))
 	{
 		if (display_message)
 			FCEU_DispMessage("State %d save error.", 0, CurrentState);
 		return;
 	}
-
-	if(FCEUMOV_Mode(MOVIEMODE_INACTIVE))
-		FCEUSS_SaveMS(st,-1);
-	else
-		FCEUSS_SaveMS(st,0);
-
-	delete st;
+	image.resize(ms.size());
+	stateWriter.write(fn, image);
 
 	if(!fname)
 	{
-		SaveStateStatus[CurrentState] = 1;
-		if (display_message)
-			FCEU_DispMessage("State %d saved.", 0, CurrentState);
+		PendingSlotSave save = { fn, CurrentState, display_message };
+		pendingSlotSaves.push_back(save);
 	}
 	redoSS = false;					//we have a new savestate so redo is not possible
 }
 
+//resume files: a full savestate, back buffer included, behind a header naming the emulator version
+//and the ROM it was made with, so one left by another build or another dump is never loaded
+#define RESUME_HEADER_SIZE 32
+
+bool FCEUSS_SaveResume(const char *fname)
+{
+	if (!GameInfo || geniestage==1)
+		return false;
+
+	FCEUSS_ReportWrites();
+
+	std::vector<uint8> image(RESUME_HEADER_SIZE, 0);
+	memcpy(&image[0], "FCRS", 4);
+	FCEU_en32lsb(&image[4], FCEU_VERSION_NUMERIC);
+	memcpy(&image[8], GameInfo->MD5.data, 16);
+
+	EMUFILE_MEMORY ms(&image);
+	ms.fseek(RESUME_HEADER_SIZE, SEEK_SET);
+	if(!FCEUSS_SaveMS(&ms, -1))
+		return false;
+	image.resize(ms.size());
+	stateWriter.write(fname, image);
+	return true;
+}
+
+bool FCEUSS_LoadResume(const char *fname)
+{
+	if (!GameInfo)
+		return false;
+
+	FCEUSS_FlushWrites();
+
+	//a few dozen kilobytes, read in one go
+	FILE *fp = FCEUD_UTF8fopen(fname, "rb");
+	if (!fp)
+		return false;
+	fseek(fp, 0, SEEK_END);
+	long size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	std::vector<uint8> image(size > RESUME_HEADER_SIZE ? (size_t)size : 0);
+	bool ok = !image.empty() && fread(&image[0], 1, image.size(), fp) == image.size();
+	fclose(fp);
+
+	if (!ok
+		|| memcmp(&image[0], "FCRS", 4)
+		|| FCEU_de32lsb(&image[4]) != FCEU_VERSION_NUMERIC
+		|| memcmp(&image[8], GameInfo->MD5.data, 16))
+		return false;
+
+	EMUFILE_MEMORY ms(&image);
+	ms.fseek(RESUME_HEADER_SIZE, SEEK_SET);
+	return FCEUSS_LoadFP(&ms, SSLOADPARAM_NOBACKUP);
+}
+
 int FCEUSS_LoadFP_old(EMUFILE* is, ENUM_SSLOADPARAMS params)
 {
 	//if(params==SSLOADPARAM_DUMMY && suppress_scan_chunks)
@@ -584,6 +884,9 @@ bool FCEUSS_Load(const char *fname, bool display_message)
 	EMUFILE* st;
 	char fn[2048];
 
+	//the state may still be on its way to the disk
+	FCEUSS_FlushWrites();
+
 	//mbg movie - this needs to be overhauled
 	////this fixes read-only toggle problems
 	//if(FCEUMOV_IsRecording()) {
@@ -671,6 +974,7 @@ void FCEUSS_CheckStates(void)
 	FILE *st=NULL;
 	int ssel;
 
+	FCEUSS_FlushWrites();
 	for(ssel=0;ssel<10;ssel++)
 	{
 		st=FCEUD_UTF8fopen(FCEU_MakeFName(FCEUMKF_STATE,ssel,0),"rb");
@@ -687,6 +991,288 @@ void FCEUSS_CheckStates(void)
 	StateShow=0;
 }
 
+//-----------------------------------------------------------------------------
+//flat snapshots
+
+struct FlatCopy
+{
+	uint8 *v;	//the data, or NULL when it's reached through vp
+	uint8 **vp;	//for FCEUSTATE_INDIRECT, where the pointer to the data is kept
+	uint32 size;
+};
+
+static std::vector<FlatCopy> flatPlan;
+static uint32 flatPlanSize = 0;
+static bool flatPlanBuilt = false;
+
+static void StateLayoutChanged()
+{
+	flatPlanBuilt = false;
+	stateLayoutId++;
+	if(!stateLayoutId) stateLayoutId++;
+}
+
+static void AddToFlatPlan(SFORMAT *sf)
+{
+	for(;sf->v;sf++)
+	{
+		if(sf->s==~0)		// Link to another SFORMAT structure.
+		{
+			AddToFlatPlan((SFORMAT *)sf->v);
+			continue;
+		}
+
+		uint32 size = sf->s&(~FCEUSTATE_FLAGS);
+		if(!size)
+			continue;
+		flatPlanSize += size;
+
+		//indirect pointers are followed on every copy, in case the data moves
+		if(sf->s&FCEUSTATE_INDIRECT)
+		{
+			FlatCopy c = { 0, (uint8 **)sf->v, size };
+			flatPlan.push_back(c);
+			continue;
+		}
+
+		//variables that sit next to each other are copied in one go
+		uint8 *v = (uint8 *)sf->v;
+		if(!flatPlan.empty() && flatPlan.back().v && flatPlan.back().v + flatPlan.back().size == v)
+			flatPlan.back().size += size;
+		else
+		{
+			FlatCopy c = { v, 0, size };
+			flatPlan.push_back(c);
+		}
+	}
+}
+
+//the same lists as WriteStateChunks(), without the movie and the back buffer
+static void BuildFlatPlan()
+{
+	flatPlan.clear();
+	flatPlanSize = 0;
+	AddToFlatPlan(SFCPU);
+	AddToFlatPlan(SFCPUC);
+	AddToFlatPlan(FCEUPPU_STATEINFO);
+	AddToFlatPlan(FCEU_NEWPPU_STATEINFO);
+	AddToFlatPlan(FCEUCTRL_STATEINFO);
+	AddToFlatPlan(FCEUSND_STATEINFO);
+	AddToFlatPlan(SFMDATA);
+	flatPlanBuilt = true;
+}
+
+uint32 FCEUSS_GetFlatSize(void)
+{
+	if(!flatPlanBuilt)
+		BuildFlatPlan();
+	return flatPlanSize;
+}
+
+bool FCEUSS_SaveFlat(FCEUFlatSnapshot &snap)
+{
+	if(!flatPlanBuilt)
+		BuildFlatPlan();
+	if(snap.data.size() != flatPlanSize)
+		snap.data.resize(flatPlanSize);
+
+	FCEUPPU_SaveState();
+	FCEUSND_SaveState();
+	if(SPreSave) SPreSave();
+
+	uint8 *out = snap.data.data();
+	for(size_t i=0;i<flatPlan.size();i++)
+	{
+		const FlatCopy &c = flatPlan[i];
+		memcpy(out, c.vp ? *c.vp : c.v, c.size);
+		out += c.size;
+	}
+
+	if(SPostSave) SPostSave();
+	snap.plan = stateLayoutId;
+	return true;
+}
+
+bool FCEUSS_LoadFlat(const FCEUFlatSnapshot &snap)
+{
+	if(!flatPlanBuilt || snap.plan != stateLayoutId || snap.data.size() != flatPlanSize)
+		return false;
+
+	const uint8 *in = snap.data.data();
+	for(size_t i=0;i<flatPlan.size();i++)
+	{
+		const FlatCopy &c = flatPlan[i];
+		memcpy(c.vp ? *c.vp : c.v, in, c.size);
+		in += c.size;
+	}
+	RAMDirty = ~0u;
+
+	//the sound state is always there, as if its chunk had been read
+	extern int resetDMCacc;
+	resetDMCacc=0;
+
+	if(GameStateRestore)
+		GameStateRestore(FCEU_VERSION_NUMERIC);
+	FCEUPPU_LoadState(FCEU_VERSION_NUMERIC);
+	FCEUSND_LoadState(FCEU_VERSION_NUMERIC);
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+//state digests
+
+static const char *digestPartNames[DIGEST_PARTS] = { "CPU", "RAM", "PPU", "APU", "input", "cartridge" };
+
+static uint64 ramPageHash[8];
+static uint8 *ramPagesOf = NULL;	//the RAM the page hashes were taken from
+
+struct TrackedMemory
+{
+	uint8 *p;
+	uint32 size;
+	std::vector<uint8> dirty;		//one for each 1KB page
+	std::vector<uint64> pageHash;
+};
+static std::vector<TrackedMemory> trackedMemory;
+
+static const uint64 fnvOffset = 14695981039346656037ULL;
+
+//FNV-1a's prime over eight bytes at a time, with a shift to fold the high bits back down
+static uint64 HashBytes(uint64 h, const uint8 *p, uint32 size)
+{
+	for(;size>=8;p+=8,size-=8)
+	{
+		uint64 w;
+		memcpy(&w,p,8);
+		h = (h ^ w) * 1099511628211ULL;
+		h ^= h >> 29;
+	}
+	for(;size;p++,size--)
+		h = (h ^ *p) * 1099511628211ULL;
+	return h;
+}
+
+void FCEUSS_TrackWrites(uint8 *p, uint32 size)
+{
+	for(size_t i=0;i<trackedMemory.size();i++)
+		if(trackedMemory[i].p == p)
+		{
+			trackedMemory.erase(trackedMemory.begin()+i);
+			break;
+		}
+
+	TrackedMemory t;
+	t.p = p;
+	t.size = size;
+	t.dirty.assign((size+0x3FF)>>10, 1);
+	t.pageHash.assign(t.dirty.size(), 0);
+	trackedMemory.push_back(t);
+}
+
+void FCEUSS_MarkWritten(const uint8 *p, uint32 size)
+{
+	if(!size)
+		return;
+	for(size_t i=0;i<trackedMemory.size();i++)
+	{
+		TrackedMemory &t = trackedMemory[i];
+		if(p < t.p || p >= t.p + t.size)
+			continue;
+		uint32 start = (uint32)(p - t.p);
+		uint32 end = std::min(start + size, t.size);
+		for(uint32 page=start>>10;page<=(end-1)>>10;page++)
+			t.dirty[page] = 1;
+	}
+}
+
+static TrackedMemory *FindTracked(const uint8 *v, uint32 size)
+{
+	for(size_t i=0;i<trackedMemory.size();i++)
+	{
+		TrackedMemory &t = trackedMemory[i];
+		if(v >= t.p && v + size <= t.p + t.size)
+			return &t;
+	}
+	return NULL;
+}
+
+//the hashes of the pages the entry covers, rehashing the ones written since the last digest
+static uint64 HashTracked(uint64 h, TrackedMemory &t, const uint8 *v, uint32 size)
+{
+	uint32 start = (uint32)(v - t.p);
+	for(uint32 page=start>>10;page<=(start+size-1)>>10;page++)
+	{
+		if(t.dirty[page])
+		{
+			uint32 offset = page<<10;
+			t.pageHash[page] = HashBytes(fnvOffset, t.p + offset, std::min<uint32>(0x400, t.size - offset));
+			t.dirty[page] = 0;
+		}
+		h = HashBytes(h, (uint8 *)&t.pageHash[page], 8);
+	}
+	return h;
+}
+
+static uint64 HashStateList(uint64 h, SFORMAT *sf)
+{
+	for(;sf->v;sf++)
+	{
+		if(sf->s==~0)		// Link to another SFORMAT structure.
+		{
+			h = HashStateList(h, (SFORMAT *)sf->v);
+			continue;
+		}
+
+		uint32 size = sf->s&(~FCEUSTATE_FLAGS);
+		uint8 *v = (sf->s&FCEUSTATE_INDIRECT) ? *(uint8 **)sf->v : (uint8 *)sf->v;
+		if(!size || v == RAM)	//RAM has a part of its own
+			continue;
+		TrackedMemory *t = FindTracked(v, size);
+		h = t ? HashTracked(h, *t, v, size) : HashBytes(h, v, size);
+	}
+	return h;
+}
+
+static uint32 FoldHash(uint64 h)
+{
+	return (uint32)(h ^ (h >> 32));
+}
+
+void FCEUSS_Digest(FCEUStateDigest &digest)
+{
+	const uint64 seed = fnvOffset;
+
+	if(ramPagesOf != RAM)
+	{
+		RAMDirty = ~0u;
+		ramPagesOf = RAM;
+	}
+	if(RAMDirty & ~0xFFu)
+		for(size_t i=0;i<trackedMemory.size();i++)
+			std::fill(trackedMemory[i].dirty.begin(), trackedMemory[i].dirty.end(), 1);
+	for(int i=0;i<8;i++)
+		if(RAMDirty & (1<<i))
+			ramPageHash[i] = HashBytes(seed, RAM + (i<<8), 0x100);
+	RAMDirty = 0;
+
+	FCEUPPU_SaveState();
+	FCEUSND_SaveState();
+
+	digest.part[DIGEST_CPU] = FoldHash(HashStateList(HashStateList(seed, SFCPU), SFCPUC));
+	digest.part[DIGEST_RAM] = FoldHash(HashBytes(seed, (uint8 *)ramPageHash, sizeof(ramPageHash)));
+	digest.part[DIGEST_PPU] = FoldHash(HashStateList(HashStateList(seed, FCEUPPU_STATEINFO), FCEU_NEWPPU_STATEINFO));
+	digest.part[DIGEST_APU] = FoldHash(HashStateList(seed, FCEUSND_STATEINFO));
+	digest.part[DIGEST_INPUT] = FoldHash(HashStateList(seed, FCEUCTRL_STATEINFO));
+	digest.part[DIGEST_CART] = FoldHash(HashStateList(seed, SFMDATA));
+}
+
+const char *FCEUSS_DigestPartName(int part)
+{
+	return part >= 0 && part < DIGEST_PARTS ? digestPartNames[part] : "?";
+}
+
+//-----------------------------------------------------------------------------
+
 void ResetExState(void (*PreSave)(void), void (*PostSave)(void))
 {
 	int x;
@@ -701,6 +1287,8 @@ void ResetExState(void (*PreSave)(void), void (*PostSave)(void))
 	SPreSave = PreSave;
 	SPostSave = PostSave;
 	SFEXINDEX=0;
+	trackedMemory.clear();
+	StateLayoutChanged();
 }
 
 void AddExState(void *v, uint32 s, int type, const char *desc)
@@ -750,6 +1338,7 @@ void AddExState(void *v, uint32 s, int type, const char *desc)
 		}
 	}
 	SFMDATA[SFEXINDEX].v=0;		// End marker.
+	StateLayoutChanged();
 }
 
 void FCEUI_SelectStateNext(int n)
@@ -886,9 +1475,7 @@ string GenerateBackupSaveStateFn(const char *fname)
 void CreateBackupSaveState(const char *fname)
 {
 	string newFilename = GenerateBackupSaveStateFn(fname);	//Get backup savestate filename
-	if (CheckFileExists(newFilename.c_str()))				//See if backup already exists
-		remove(newFilename.c_str())	;						//If so, delete it
-	rename(fname,newFilename.c_str());						//Rename savestate to backup filename
+	stateWriter.backup(fname,newFilename);					//Replace the old backup with the savestate, after any queued write to it
 	undoSS = true;		//There is a backup savestate file to mast last loaded, so undo is possible
 }
 
@@ -898,6 +1485,7 @@ void SwapSaveState()
 	//Both files must exist
 	//--------------------------------------------------------------------------------------------
 
+	FCEUSS_FlushWrites();
 	if (!lastSavestateMade)
 	{
 		FCEUI_DispMessage("Can't Undo",0);
@@ -24,14 +24,46 @@ enum ENUM_SSLOADPARAMS
 	SSLOADPARAM_BACKUP,
 };
 
+//the file is written in the background, FCEUSS_FlushWrites() waits for it. a save to a slot is
+//reported, and marked in the slot display, once it's written, by FCEUSS_ReportWrites() (called
+//every frame, paused or not)
 void FCEUSS_Save(const char *, bool display_message=true);
+void FCEUSS_FlushWrites(void);
+void FCEUSS_ReportWrites(void);
 bool FCEUSS_Load(const char *, bool display_message=true);
 
+//suspend/resume: a full savestate (back buffer included) stamped with the emulator version and the
+//ROM's MD5. loading one fails, leaving the machine alone, unless both match the running game
+bool FCEUSS_SaveResume(const char *fname);
+bool FCEUSS_LoadResume(const char *fname);
+
  //zlib values: 0 (none) through 9 (max) or -1 (default)
 bool FCEUSS_SaveMS(EMUFILE* outstream, int compressionLevel);
 
 bool FCEUSS_LoadFP(EMUFILE* is, ENUM_SSLOADPARAMS params);
 
+//snapshots that never leave memory, for run-ahead and the like: the machine state alone, without
+//the header, the movie data or the back buffer. loading one makes no backup and redraws nothing
+bool FCEUSS_SaveSnapshot(EMUFILE_MEMORY &ms);
+bool FCEUSS_LoadSnapshot(EMUFILE_MEMORY &ms);
+
+//flat snapshots: every registered state variable copied straight into one buffer, following a
+//copy plan built from the SFORMAT lists the first time it's needed after they change. no chunk
+//headers, no byte order fixups and, once the buffer has its size, no allocation. they're only
+//good for the game and the registrations they were made with
+struct FCEUFlatSnapshot
+{
+	std::vector<uint8> data;
+	uint32 plan; //the copy plan that filled data, 0 if none
+
+	FCEUFlatSnapshot() : plan(0) {}
+};
+
+bool FCEUSS_SaveFlat(FCEUFlatSnapshot &snap);
+bool FCEUSS_LoadFlat(const FCEUFlatSnapshot &snap);
+//the size of a flat snapshot of the current game
+uint32 FCEUSS_GetFlatSize(void);
+
 extern int CurrentState;
 void FCEUSS_CheckStates(void);
 
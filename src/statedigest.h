@@ -0,0 +1,55 @@
+#ifndef _STATEDIGEST_H_
+#define _STATEDIGEST_H_
+
+#include "types.h"
+
+//State digests.
+//
+//A hash of each part of the machine, for finding the frame and the part where two runs that
+//should match go their own ways. Internal RAM is only rehashed in the 256-byte pages written since
+//the last digest (see RAMDirty), and so is cartridge memory registered with FCEUSS_TrackWrites(),
+//in 1KB pages; everything else is hashed whole.
+enum
+{
+	DIGEST_CPU,     //registers and timing
+	DIGEST_RAM,     //the 2KB of internal RAM
+	DIGEST_PPU,     //registers, OAM, palette and nametable RAM
+	DIGEST_APU,
+	DIGEST_INPUT,
+	DIGEST_CART,    //mapper registers, WRAM and CHR-RAM
+	DIGEST_PARTS
+};
+
+struct FCEUStateDigest
+{
+	uint32 part[DIGEST_PARTS]; //all 0 if none was taken
+
+	FCEUStateDigest() { for(int i=0;i<DIGEST_PARTS;i++) part[i] = 0; }
+
+	bool isSet() const
+	{
+		for(int i=0;i<DIGEST_PARTS;i++)
+			if(part[i]) return true;
+		return false;
+	}
+
+	//the first part that differs, -1 if none does
+	int compare(const FCEUStateDigest &other) const
+	{
+		for(int i=0;i<DIGEST_PARTS;i++)
+			if(part[i] != other.part[i]) return i;
+		return -1;
+	}
+};
+
+//defined with the rest of the state code, in state.cpp
+void FCEUSS_Digest(FCEUStateDigest &digest);
+const char *FCEUSS_DigestPartName(int part);
+
+//Cartridge RAM, CHR-RAM and disk sides are tracked by whoever maps them, which then has to mark
+//every write to them; power-on and state loads set RAMDirty to ~0u instead, which rehashes all of
+//it. The list is cleared with the rest of the cartridge state, by ResetExState().
+void FCEUSS_TrackWrites(uint8 *p, uint32 size);
+void FCEUSS_MarkWritten(const uint8 *p, uint32 size = 1);
+
+#endif
@@ -0,0 +1,160 @@
+/* FCE Ultra - NES/Famicom Emulator
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "statewriter.h"
+#include "driver.h"
+
+#include <cstdio>
+
+#ifdef WIN32
+#include <windows.h>
+#endif
+
+//rename() doesn't replace an existing file on Windows
+static bool MoveOver(const std::string &from, const std::string &to)
+{
+#ifdef WIN32
+	return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	return rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+static bool FileExists(const std::string &path)
+{
+	FILE *fp = fopen(path.c_str(), "rb");
+	if(!fp)
+		return false;
+	fclose(fp);
+	return true;
+}
+
+StateWriter::StateWriter()
+	: quit(false)
+{}
+
+StateWriter::~StateWriter()
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		quit = true;
+	}
+	wake.notify_one();
+	if(worker.joinable())
+		worker.join();
+}
+
+void StateWriter::write(const std::string &path, std::vector<uint8> &data)
+{
+	Job job;
+	job.path = path;
+	job.data.swap(data);
+	queue(job);
+}
+
+void StateWriter::backup(const std::string &path, const std::string &backup)
+{
+	Job job;
+	job.path = path;
+	job.backup = backup;
+	queue(job);
+}
+
+void StateWriter::queue(Job &job)
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		jobs.push_back(std::move(job));
+
+		//started on first use, so nothing runs for those who never save
+		if(!worker.joinable())
+			worker = std::thread(&StateWriter::run, this);
+	}
+	wake.notify_one();
+}
+
+void StateWriter::flush()
+{
+	std::unique_lock<std::mutex> guard(lock);
+	while(!jobs.empty())
+		done.wait(guard);
+}
+
+bool StateWriter::busy()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	return !jobs.empty();
+}
+
+std::vector<StateWriter::Result> StateWriter::takeResults()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	std::vector<Result> out;
+	out.swap(results);
+	return out;
+}
+
+void StateWriter::run()
+{
+	std::unique_lock<std::mutex> guard(lock);
+	for(;;)
+	{
+		while(jobs.empty() && !quit)
+			wake.wait(guard);
+		if(jobs.empty())
+			return;
+
+		//the front job stays queued while it runs, so flush() waits for it
+		guard.unlock();
+		bool ok = perform(jobs.front());
+		guard.lock();
+
+		Result result;
+		result.path = jobs.front().path;
+		result.backup = !jobs.front().backup.empty();
+		result.ok = ok;
+		results.push_back(result);
+		jobs.pop_front();
+		done.notify_all();
+	}
+}
+
+bool StateWriter::perform(const Job &job)
+{
+	if(!job.backup.empty())
+	{
+		if(!FileExists(job.path))
+			return true;
+		remove(job.backup.c_str());
+		return MoveOver(job.path, job.backup);
+	}
+
+	std::string temp = job.path + ".tmp";
+	FILE *fp = FCEUD_UTF8fopen(temp.c_str(), "wb");
+	if(!fp)
+		return false;
+
+	bool ok = job.data.empty() || fwrite(&job.data[0], 1, job.data.size(), fp) == job.data.size();
+	if(fclose(fp) != 0)
+		ok = false;
+
+	if(ok)
+		ok = MoveOver(temp, job.path);
+	if(!ok)
+		remove(temp.c_str());
+	return ok;
+}
@@ -0,0 +1,71 @@
+#ifndef _STATEWRITER_H_
+#define _STATEWRITER_H_
+
+#include "types.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//Background savestate writer.
+//
+//The emulation thread serializes a state into memory and queues it here; a thread of its own
+//writes it to a temporary file next to the target and renames that over the target once it's
+//complete, so a slow disk doesn't stall a frame and a crash or a full disk never leaves half a
+//state behind. Jobs run in the order they were queued, including the renames that keep a backup
+//of the state being replaced.
+class StateWriter
+{
+public:
+	StateWriter();
+	~StateWriter(); //finishes the queued jobs
+
+	//queues data (taken, data is left empty) to be written to path
+	void write(const std::string &path, std::vector<uint8> &data);
+
+	//queues renaming path to backup, replacing any old backup. nothing happens if there's no path
+	void backup(const std::string &path, const std::string &backup);
+
+	//waits until every queued job is done
+	void flush();
+
+	//true while jobs are queued or running
+	bool busy();
+
+	struct Result
+	{
+		std::string path;
+		bool backup;  //a backup rename, not a write
+		bool ok;
+	};
+
+	//the jobs finished since the last call, in the order they were queued
+	std::vector<Result> takeResults();
+
+private:
+	struct Job
+	{
+		std::string path;
+		std::string backup;   //if set, path is renamed to this instead of written
+		std::vector<uint8> data;
+	};
+
+	void queue(Job &job);
+	void run();
+	bool perform(const Job &job);
+
+	std::thread worker;
+	std::mutex lock;
+	std::condition_variable wake, done;
+	std::deque<Job> jobs;
+	bool quit;
+	std::vector<Result> results;
+
+	StateWriter(const StateWriter &);
+	StateWriter &operator=(const StateWriter &);
+};
+
+#endif
@@ -0,0 +1,105 @@
+#ifndef _RINGBUFFER_H_
+#define _RINGBUFFER_H_
+
+#include <atomic>
+#include <vector>
+#include <cstring>
+
+//fixed-capacity single-producer/single-consumer queue.
+//one thread may use the write side (write, space) while another uses the read side
+//(size, peek, skip, read) without any locking. the capacity is rounded up to a power of two.
+//only meant for trivially copyable element types.
+template<typename T>
+class RingBuffer
+{
+public:
+	RingBuffer(int capacity)
+		: head(0)
+		, tail(0)
+	{
+		int cap = 1;
+		while(cap < capacity) cap <<= 1;
+		buf.resize(cap);
+		mask = cap - 1;
+	}
+
+	int capacity() const { return mask + 1; }
+
+	//number of elements that can be read. safe to call from either side
+	int size() const { return (int)(head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire)); }
+
+	//number of elements that can be written. safe to call from either side
+	int space() const { return capacity() - size(); }
+
+	//producer: enqueues up to count elements, returns how many fit
+	int write(const T *src, int count)
+	{
+		unsigned int h = head.load(std::memory_order_relaxed);
+		unsigned int t = tail.load(std::memory_order_acquire);
+		int avail = capacity() - (int)(h - t);
+		if(count > avail) count = avail;
+		if(count <= 0) return 0;
+
+		int start = h & mask;
+		int first = capacity() - start;
+		if(first > count) first = count;
+		memcpy(&buf[start], src, first * sizeof(T));
+		memcpy(&buf[0], src + first, (count - first) * sizeof(T));
+
+		head.store(h + count, std::memory_order_release);
+		return count;
+	}
+
+	//consumer: returns the element at the given offset from the front without dequeuing it.
+	//index must be less than size()
+	T peek(int index) const
+	{
+		return buf[(tail.load(std::memory_order_relaxed) + index) & mask];
+	}
+
+	//consumer: drops up to count elements from the front, returns how many were dropped
+	int skip(int count)
+	{
+		unsigned int t = tail.load(std::memory_order_relaxed);
+		int avail = (int)(head.load(std::memory_order_acquire) - t);
+		if(count > avail) count = avail;
+		if(count <= 0) return 0;
+		tail.store(t + count, std::memory_order_release);
+		return count;
+	}
+
+	//consumer: dequeues up to count elements, returns how many were read
+	int read(T *dst, int count)
+	{
+		unsigned int t = tail.load(std::memory_order_relaxed);
+		int avail = (int)(head.load(std::memory_order_acquire) - t);
+		if(count > avail) count = avail;
+		if(count <= 0) return 0;
+
+		int start = t & mask;
+		int first = capacity() - start;
+		if(first > count) first = count;
+		memcpy(dst, &buf[start], first * sizeof(T));
+		memcpy(dst + first, &buf[0], (count - first) * sizeof(T));
+
+		tail.store(t + count, std::memory_order_release);
+		return count;
+	}
+
+	//consumer: drops everything that is currently queued
+	void clear()
+	{
+		tail.store(head.load(std::memory_order_acquire), std::memory_order_release);
+	}
+
+private:
+	std::vector<T> buf;
+	int mask;
+	std::atomic<unsigned int> head; //next write position, only advanced by the producer
+	std::atomic<unsigned int> tail; //next read position, only advanced by the consumer
+
+	RingBuffer(const RingBuffer &);
+	RingBuffer &operator=(const RingBuffer &);
+};
+
+#endif
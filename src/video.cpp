@@ -32,6 +32,7 @@
 #include "vsuni.h"
 #include "drawing.h"
 #include "driver.h"
+#include "perftrace.h"
 #include "drivers/common/vidblit.h"
 
 #ifdef WIN32
@@ -199,8 +200,48 @@ static uint32 GetButtonColor(uint32 held, uint32 c, uint32 ci, int bit)
 	return color;
 }
 
+//Pipelined presentation. A driver that presents on another thread hands over a buffer of its
+//own before every frame, and XBuf and XDBuf point there until the next one: the PPU renders
+//straight into it and the overlays are drawn on it in place, and it goes to the driver as it is.
+//The only copy is the one every frame gets anyway, of the clean picture into XBackBuf before
+//the overlays.
+static uint8 *ownXBuf = NULL;       //the core's own buffers, while the driver's are in use
+static uint8 *ownXDBuf = NULL;
+static bool backKept = false;       //FCEU_KeepBackBuffer() took the back buffer for this frame
+
+void FCEUI_SetPresentationBuffer(uint8 *pixels, uint8 *deemph)
+{
+	if(pixels)
+	{
+		if(!ownXBuf)
+		{
+			ownXBuf = XBuf;
+			ownXDBuf = XDBuf;
+		}
+		XBuf = pixels;
+		XDBuf = deemph;
+	}
+	else if(ownXBuf)
+	{
+		//the driver's buffers are going away; the last frame stays in the core's
+		memcpy(ownXBuf, XBuf, 256*256);
+		memcpy(ownXDBuf, XDBuf, 256*256);
+		XBuf = ownXBuf;
+		XDBuf = ownXDBuf;
+		ownXBuf = ownXDBuf = NULL;
+	}
+}
+
+void FCEU_KeepBackBuffer(void)
+{
+	memcpy(XBackBuf, XBuf, 256*256);
+	backKept = true;
+}
+
 void FCEU_PutImage(void)
 {
+	PerfScope perf(PERF_OVERLAYS);
+
 	if(dosnapsave==2)	//Save screenshot as, currently only flagged & run by the Win32 build. //TODO SDL: implement this?
 	{
 		char nameo[512];
@@ -226,7 +267,7 @@ void FCEU_PutImage(void)
 	else
 	{
 		//Save backbuffer before overlay stuff is written.
-		if(!FCEUI_EmulationPaused())
+		if(!FCEUI_EmulationPaused() && !backKept)
 			memcpy(XBackBuf, XBuf, 256*256);
 
 		//Some messages need to be displayed before the avi is dumped
@@ -377,6 +418,7 @@ void FCEU_PutImage(void)
 		}
 	} else DrawMessage(false);
 
+	backKept = false;
 }
 void snapAVI()
 {
@@ -38,4 +38,9 @@ void FCEUI_SetShowFPS(bool showFPS);
 void FCEUI_ToggleShowFPS();
 void ShowFPS();
 void snapAVI();
+
+//The back buffer: the last frame emulated, before its overlays, which a pause goes on showing and
+//savestates keep. FCEU_PutImage() takes it from XBuf, unless FCEU_KeepBackBuffer() has already
+//taken it for the frame.
+void FCEU_KeepBackBuffer(void);
 #endif
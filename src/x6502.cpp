@@ -23,6 +23,7 @@
 #include "fceu.h"
 #include "debug.h"
 #include "sound.h"
+#include "perftrace.h"
 
 #include "x6502abbrev.h"
 
@@ -63,6 +64,7 @@ static INLINE uint8 RdRAM(unsigned int A)
 static INLINE void WrRAM(unsigned int A, uint8 V)
 {
 	RAM[A]=V;
+	RAMDirty|=1<<(A>>8);
 }
 
 uint8 X6502_DMR(uint32 A)
@@ -406,6 +408,8 @@ void X6502_Power(void)
 
 void X6502_Run(int32 cycles)
 {
+  PerfCPUScope perf;
+
   if(PAL)
    cycles*=15;    // 15*4=60
   else